@@ -0,0 +1,98 @@
+#include "compressorcontext.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+/*
+ * Throughput of the compressor context on batches of small log records.
+ * Usage: bench_batch
+ */
+
+using Buffer = std::vector<unsigned char>;
+
+constexpr size_t RECORDS_COUNT = 1 << 18;
+constexpr size_t BATCH_SIZE = 1024;
+constexpr int RUNS_COUNT = 3;
+
+std::vector<Buffer> GenerateRecords()
+{
+    std::mt19937 generator(1);
+    std::vector<std::string> paths = { "/api/v1/items", "/api/v1/users", "/health", "/login" };
+
+    std::vector<Buffer> records;
+    for (size_t i = 0; i < RECORDS_COUNT; ++i)
+    {
+        std::string line = "2024-05-01 12:" + std::to_string(10 + i / 6000 % 50)
+            + " INFO request served path=" + paths[generator() % paths.size()]
+            + " duration_ms=" + std::to_string(generator() % 300);
+        records.emplace_back(line.begin(), line.end());
+    }
+    return records;
+}
+
+int main()
+{
+    auto records = GenerateRecords();
+    size_t records_size = 0;
+    for (const auto& record : records)
+    {
+        records_size += record.size();
+    }
+    std::vector<std::span<const unsigned char>> record_spans(records.begin(), records.end());
+
+    CompressorContext context;
+    std::vector<unsigned char> output;
+    std::vector<size_t> record_ends;
+    std::vector<unsigned char> content;
+
+    double compress_seconds = 0;
+    double decompress_seconds = 0;
+    size_t compressed_size = 0;
+    for (int run = 0; run < RUNS_COUNT; ++run)
+    {
+        std::chrono::duration<double> compress_time {};
+        std::chrono::duration<double> decompress_time {};
+        compressed_size = 0;
+        for (size_t begin = 0; begin < records.size(); begin += BATCH_SIZE)
+        {
+            auto batch = std::span(record_spans)
+                             .subspan(begin, std::min(BATCH_SIZE, records.size() - begin));
+
+            auto start = std::chrono::steady_clock::now();
+            context.CompressBatch(batch, output, record_ends);
+            compress_time += std::chrono::steady_clock::now() - start;
+            compressed_size += output.size();
+
+            start = std::chrono::steady_clock::now();
+            size_t record_begin = 0;
+            for (auto record_end : record_ends)
+            {
+                content.clear();
+                auto record = std::span(output).subspan(record_begin, record_end - record_begin);
+                context.Decompress(record, content);
+                record_begin = record_end;
+            }
+            decompress_time += std::chrono::steady_clock::now() - start;
+        }
+        compress_seconds = run == 0 ? compress_time.count()
+                                    : std::min(compress_seconds, compress_time.count());
+        decompress_seconds = run == 0 ? decompress_time.count()
+                                      : std::min(decompress_seconds, decompress_time.count());
+    }
+
+    std::printf("%zu records of %.1f bytes: compress %.2f M records/s (%.1f MB/s), decompress %.2f "
+                "M records/s (%.1f MB/s), size %.1f%%\n",
+                records.size(),
+                static_cast<double>(records_size) / static_cast<double>(records.size()),
+                static_cast<double>(records.size()) / compress_seconds / 1e6,
+                static_cast<double>(records_size) / compress_seconds / 1e6,
+                static_cast<double>(records.size()) / decompress_seconds / 1e6,
+                static_cast<double>(records_size) / decompress_seconds / 1e6,
+                100.0 * static_cast<double>(compressed_size) / static_cast<double>(records_size));
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "daemon.h"
+#include "huffman.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Latency of the jobs sent to the daemon over one connection: small buffers and a small file.
+ * Usage: bench_daemon
+ */
+
+constexpr size_t BUFFER_JOBS_COUNT = 20000;
+constexpr size_t FILE_JOBS_COUNT = 500;
+constexpr int RUNS_COUNT = 3;
+
+int main()
+{
+    auto directory = std::filesystem::temp_directory_path() / "bench_daemon";
+    std::filesystem::create_directories(directory);
+    std::string socket_path = (directory / "daemon.sock").string();
+    std::string file_path = (directory / "record.txt").string();
+    std::string archive_path = (directory / "record.huff").string();
+
+    std::string line = "2024-05-01 12:00:10 INFO request served path=/api/v1/items duration_ms=42";
+    std::ofstream(file_path) << line;
+    std::vector<unsigned char> buffer(line.begin(), line.end());
+
+    CompressionServer server(socket_path, 1);
+    std::thread server_thread([&server] { server.Run(); });
+
+    double buffer_seconds = 0;
+    double file_seconds = 0;
+    {
+        CompressionClient client(socket_path);
+        std::vector<unsigned char> record;
+        std::vector<unsigned char> content;
+        for (int run = 0; run < RUNS_COUNT; ++run)
+        {
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < BUFFER_JOBS_COUNT; ++i)
+            {
+                client.CompressBuffer(buffer, record);
+                client.DecompressBuffer(record, content);
+            }
+            std::chrono::duration<double> buffer_time = std::chrono::steady_clock::now() - start;
+
+            start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < FILE_JOBS_COUNT; ++i)
+            {
+                client.CompressFiles(archive_path, { file_path }, DEFAULT_LEVEL);
+            }
+            std::chrono::duration<double> file_time = std::chrono::steady_clock::now() - start;
+
+            buffer_seconds = run == 0 ? buffer_time.count()
+                                      : std::min(buffer_seconds, buffer_time.count());
+            file_seconds = run == 0 ? file_time.count() : std::min(file_seconds, file_time.count());
+        }
+    }
+    server.Stop();
+    server_thread.join();
+    std::filesystem::remove_all(directory);
+
+    std::printf("buffer of %zu bytes: %.1f us per compress and decompress, file of %zu bytes: "
+                "%.1f us per archive\n",
+                buffer.size(),
+                buffer_seconds / static_cast<double>(BUFFER_JOBS_COUNT) * 1e6,
+                buffer.size(),
+                file_seconds / static_cast<double>(FILE_JOBS_COUNT) * 1e6);
+    return 0;
+}
@@ -0,0 +1,271 @@
+#include "filereader.h"
+#include "filewriter.h"
+#include "huffman.h"
+#include "perfcounters.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+ * Throughput of the main stages of the coder on 1 MiB blocks with one table for the whole corpus:
+ * the histogram pass, the symbol loop of the encoder and the decoding loop, of generated text and
+ * random bytes or of the given files, and the decoding loop of the same blocks coded with rANS.
+ * With --counters the hardware counters of each stage are printed as well.
+ * Usage: bench_stages [--counters] [file...]
+ */
+
+using Block = std::vector<unsigned char>;
+
+constexpr size_t BLOCK_SIZE = 1 << 20;
+constexpr size_t CORPUS_SIZE = 8 << 20;
+constexpr int RUNS_COUNT = 3;
+
+/*
+ * The coder with its stages open to the benchmark.
+ */
+class StageHuffmanCoder : public HuffmanCoder
+{
+public:
+    using HuffmanCoder::BuildCodeTable;
+    using HuffmanCoder::EncodeBlock;
+    using HuffmanCoder::GetBlockFrequencies;
+    using HuffmanCoder::GetCharacterFrequencies;
+    using HuffmanCoder::HuffmanCoder;
+    using HuffmanCoder::RestoreNextBlock;
+    using HuffmanCoder::WriteAnsBlock;
+};
+
+Block GenerateText()
+{
+    std::mt19937 generator(2);
+    std::vector<std::string> words = { "the",   "of",   "and",    "to",     "a",       "in",
+                                       "is",    "that", "for",    "it",     "as",      "was",
+                                       "with",  "be",   "by",     "on",     "not",     "he",
+                                       "which", "this", "empire", "french", "century", "war" };
+
+    Block corpus;
+    while (corpus.size() < CORPUS_SIZE)
+    {
+        const auto& word = words[generator() % words.size()];
+        corpus.insert(corpus.end(), word.begin(), word.end());
+        corpus.push_back(generator() % 12 == 0 ? '\n' : ' ');
+    }
+    return corpus;
+}
+
+Block GenerateRandom()
+{
+    std::mt19937 generator(3);
+    Block corpus(CORPUS_SIZE);
+    std::generate(corpus.begin(), corpus.end(), [&] { return generator() & UINT8_MAX; });
+    return corpus;
+}
+
+Block ReadCorpus(const std::string& file_path)
+{
+    FileReader reader(file_path);
+    return reader.ReadCharacters(reader.GetFileSize());
+}
+
+/*
+ * The best run of a stage.
+ */
+struct StageRun
+{
+    double seconds = 0;
+    PerfCounts counts {};
+};
+
+/*
+ * Run a stage a few times and keep the fastest run with its counts.
+ */
+StageRun MeasureStage(PerfCounters* counters, const std::function<void()>& run)
+{
+    StageRun best_run { .seconds = 0 };
+    for (int i = 0; i < RUNS_COUNT; ++i)
+    {
+        if (counters != nullptr)
+        {
+            counters->Start();
+        }
+        auto start = std::chrono::steady_clock::now();
+        run();
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+        auto counts = counters != nullptr ? counters->Stop() : PerfCounts {};
+
+        if (i == 0 || seconds.count() < best_run.seconds)
+        {
+            best_run = { .seconds = seconds.count(), .counts = counts };
+        }
+    }
+    return best_run;
+}
+
+/*
+ * Print the rate of a stage and, if counted, its cycles per byte, instructions per cycle, branch
+ * misses per symbol and cache misses per KiB. A symbol is a byte of the corpus.
+ */
+void PrintStage(const std::string& corpus_name,
+                const std::string& stage_name,
+                size_t corpus_size,
+                const StageRun& run)
+{
+    auto size = static_cast<double>(corpus_size);
+    std::printf("%-10s %-10s %8.1f MB/s",
+                corpus_name.c_str(),
+                stage_name.c_str(),
+                size / run.seconds / 1e6);
+
+    auto print_ratio = [](const char* label, std::optional<uint64_t> count, double divisor)
+    {
+        if (count && divisor > 0)
+        {
+            std::printf("  %8.3f %s", static_cast<double>(*count) / divisor, label);
+        }
+        else
+        {
+            std::printf("  %8s %s", "n/a", label);
+        }
+    };
+    const auto& counts = run.counts;
+    if (std::any_of(counts.values.begin(),
+                    counts.values.end(),
+                    [](const auto& value) { return value.has_value(); }))
+    {
+        auto cycles = counts.Get(PerfEvent::Cycles);
+        print_ratio("cycles/B", cycles, size);
+        print_ratio("IPC", counts.Get(PerfEvent::Instructions), cycles ? *cycles : 0.0);
+        print_ratio("branch misses/symbol", counts.Get(PerfEvent::BranchMisses), size);
+        print_ratio("L1d misses/KiB", counts.Get(PerfEvent::L1dMisses), size / 1024);
+        print_ratio("LLC misses/KiB", counts.Get(PerfEvent::LlcMisses), size / 1024);
+    }
+    std::printf("\n");
+}
+
+void RunBenchmarks(const std::string& corpus_name, const Block& corpus, PerfCounters* counters)
+{
+    std::vector<Block> blocks;
+    for (size_t position = 0; position < corpus.size(); position += BLOCK_SIZE)
+    {
+        size_t block_size = std::min(BLOCK_SIZE, corpus.size() - position);
+        blocks.emplace_back(corpus.begin() + position, corpus.begin() + position + block_size);
+    }
+
+    // One table for the corpus and no stored blocks, so that the symbol loops dominate
+    StageHuffmanCoder huffman_coder({ .table_scope = TableScope::File,
+                                      .block_size = BLOCK_SIZE,
+                                      .stored_threshold = 0 });
+    auto corpus_path = std::filesystem::temp_directory_path() / "bench_stages.txt";
+    auto encoded_path = std::filesystem::temp_directory_path() / "bench_stages.huff";
+    auto ans_encoded_path = std::filesystem::temp_directory_path() / "bench_stages.ans";
+    {
+        FileWriter writer(corpus_path.string());
+        writer.WriteCharacters(corpus);
+    }
+    std::optional<CodeTable> file_table;
+    {
+        FileReader reader(corpus_path.string());
+        file_table = huffman_coder.BuildCodeTable(huffman_coder.GetCharacterFrequencies(reader));
+    }
+
+    auto encode_blocks = [&](FileWriter& writer)
+    {
+        std::optional<CodeTable> previous_table;
+        for (size_t i = 0; i < blocks.size(); ++i)
+        {
+            huffman_coder.EncodeBlock(
+                blocks[i], i + 1 == blocks.size(), file_table, previous_table, writer);
+        }
+    };
+    {
+        FileWriter writer(encoded_path.string());
+        encode_blocks(writer);
+    }
+    {
+        // The same blocks as rANS blocks, laid out as EncodeBlock writes them
+        FileWriter writer(ans_encoded_path.string());
+        for (size_t i = 0; i < blocks.size(); ++i)
+        {
+            writer.WriteHuffmanInt(static_cast<uint16_t>(BlockType::Ans));
+            huffman_coder.WriteAnsBlock(
+                blocks[i], i + 1 == blocks.size() ? FILENAME_END : BLOCK_END, writer);
+            writer.AlignToByte();
+        }
+    }
+    auto decode_blocks = [&](const std::filesystem::path& path)
+    {
+        FileReader reader(path.string());
+        std::optional<CanonicalCode> previous_code;
+        Block content;
+        while (huffman_coder.RestoreNextBlock(reader, content, previous_code, BLOCK_SIZE)
+               == BLOCK_END)
+        {
+            content.clear();
+        }
+    };
+
+    auto histogram_run = MeasureStage(counters,
+                                      [&]
+                                      {
+                                          bool is_sampled = false;
+                                          for (const auto& block : blocks)
+                                          {
+                                              huffman_coder.GetBlockFrequencies(block, is_sampled);
+                                          }
+                                      });
+    auto encode_run = MeasureStage(counters,
+                                   [&]
+                                   {
+                                       FileWriter writer;
+                                       encode_blocks(writer);
+                                   });
+    auto decode_run = MeasureStage(counters, [&] { decode_blocks(encoded_path); });
+    auto ans_decode_run = MeasureStage(counters, [&] { decode_blocks(ans_encoded_path); });
+    std::filesystem::remove(corpus_path);
+    std::filesystem::remove(encoded_path);
+    std::filesystem::remove(ans_encoded_path);
+
+    PrintStage(corpus_name, "histogram", corpus.size(), histogram_run);
+    PrintStage(corpus_name, "encode", corpus.size(), encode_run);
+    PrintStage(corpus_name, "decode", corpus.size(), decode_run);
+    PrintStage(corpus_name, "ans decode", corpus.size(), ans_decode_run);
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> file_paths(argv + 1, argv + argc);
+    std::optional<PerfCounters> counters;
+    auto counters_option = std::find(file_paths.begin(), file_paths.end(), "--counters");
+    if (counters_option != file_paths.end())
+    {
+        file_paths.erase(counters_option);
+        counters.emplace();
+        if (!counters->IsAvailable())
+        {
+            std::fprintf(stderr,
+                         "No hardware counters: the machine has none or "
+                         "/proc/sys/kernel/perf_event_paranoid forbids them\n");
+        }
+    }
+    PerfCounters* stage_counters = counters ? &*counters : nullptr;
+
+    if (!file_paths.empty())
+    {
+        for (const auto& file_path : file_paths)
+        {
+            RunBenchmarks(file_path, ReadCorpus(file_path), stage_counters);
+        }
+        return 0;
+    }
+
+    RunBenchmarks("text", GenerateText(), stage_counters);
+    RunBenchmarks("random", GenerateRandom(), stage_counters);
+    return 0;
+}
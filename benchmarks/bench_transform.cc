@@ -0,0 +1,158 @@
+#include "filereader.h"
+#include "transform.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+ * Throughput of the block transforms on 1 MiB blocks of generated corpora, or of the given files.
+ * Usage: bench_transform [file...]
+ */
+
+using Block = std::vector<unsigned char>;
+
+constexpr size_t BLOCK_SIZE = 1 << 20;
+constexpr size_t CORPUS_SIZE = 8 << 20;
+constexpr int RUNS_COUNT = 3;
+
+Block GenerateLogs()
+{
+    std::mt19937 generator(1);
+    std::vector<std::string> paths = { "/api/v1/items", "/api/v1/users", "/health", "/login" };
+    std::vector<std::string> statuses = { "200", "200", "200", "404", "500" };
+
+    Block corpus;
+    for (size_t i = 0; corpus.size() < CORPUS_SIZE; ++i)
+    {
+        std::string line = "2024-05-01 12:" + std::to_string(10 + i / 6000 % 50) + ":"
+            + std::to_string(10 + i / 100 % 50) + " INFO request served status="
+            + statuses[generator() % statuses.size()] + " path=" + paths[generator() % paths.size()]
+            + " duration_ms=" + std::to_string(generator() % 300) + "\n";
+        corpus.insert(corpus.end(), line.begin(), line.end());
+    }
+    return corpus;
+}
+
+Block GenerateText()
+{
+    std::mt19937 generator(2);
+    std::vector<std::string> words = { "the",   "of",   "and",    "to",     "a",       "in",
+                                       "is",    "that", "for",    "it",     "as",      "was",
+                                       "with",  "be",   "by",     "on",     "not",     "he",
+                                       "which", "this", "empire", "french", "century", "war" };
+
+    Block corpus;
+    while (corpus.size() < CORPUS_SIZE)
+    {
+        const auto& word = words[generator() % words.size()];
+        corpus.insert(corpus.end(), word.begin(), word.end());
+        corpus.push_back(generator() % 12 == 0 ? '\n' : ' ');
+    }
+    return corpus;
+}
+
+Block GenerateRandom()
+{
+    std::mt19937 generator(3);
+    Block corpus(CORPUS_SIZE);
+    std::generate(corpus.begin(), corpus.end(), [&] { return generator() & UINT8_MAX; });
+    return corpus;
+}
+
+Block ReadCorpus(const std::string& file_path)
+{
+    FileReader reader(file_path);
+    return reader.ReadCharacters(reader.GetFileSize());
+}
+
+/*
+ * Run the function on every block and return the best rate in MB/s of the original corpus.
+ */
+double MeasureRate(const std::vector<Block>& blocks,
+                   size_t corpus_size,
+                   const std::function<Block(const Block&)>& run)
+{
+    double best_seconds = 0;
+    for (int i = 0; i < RUNS_COUNT; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (const auto& block : blocks)
+        {
+            run(block);
+        }
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+        best_seconds = i == 0 ? seconds.count() : std::min(best_seconds, seconds.count());
+    }
+    return static_cast<double>(corpus_size) / best_seconds / 1e6;
+}
+
+void RunBenchmarks(const std::string& corpus_name, const Block& corpus)
+{
+    std::vector<Block> blocks;
+    for (size_t position = 0; position < corpus.size(); position += BLOCK_SIZE)
+    {
+        size_t block_size = std::min(BLOCK_SIZE, corpus.size() - position);
+        blocks.emplace_back(corpus.begin() + position, corpus.begin() + position + block_size);
+    }
+
+    struct Stage
+    {
+        std::string name;
+        uint16_t transforms;
+    };
+    std::vector<Stage> stages = { { "bwt", static_cast<uint16_t>(Transform::Bwt) },
+                                  { "mtf", static_cast<uint16_t>(Transform::Mtf) },
+                                  { "rle", static_cast<uint16_t>(Transform::Rle) },
+                                  { "bwt+mtf+rle", ALL_TRANSFORMS } };
+
+    for (const auto& stage : stages)
+    {
+        std::vector<Block> transformed_blocks;
+        size_t transformed_size = 0;
+        for (const auto& block : blocks)
+        {
+            transformed_blocks.push_back(ApplyTransforms(block, stage.transforms));
+            transformed_size += transformed_blocks.back().size();
+        }
+
+        double forward_rate
+            = MeasureRate(blocks,
+                          corpus.size(),
+                          [&](const Block& block) { return ApplyTransforms(block, stage.transforms); });
+        double inverse_rate
+            = MeasureRate(transformed_blocks,
+                          corpus.size(),
+                          [&](const Block& block)
+                          { return InvertTransforms(block, stage.transforms); });
+
+        std::printf("%-10s %-12s forward %8.1f MB/s  inverse %8.1f MB/s  size %6.1f%%\n",
+                    corpus_name.c_str(),
+                    stage.name.c_str(),
+                    forward_rate,
+                    inverse_rate,
+                    100.0 * static_cast<double>(transformed_size)
+                        / static_cast<double>(corpus.size()));
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            RunBenchmarks(argv[i], ReadCorpus(argv[i]));
+        }
+        return 0;
+    }
+
+    RunBenchmarks("logs", GenerateLogs());
+    RunBenchmarks("text", GenerateText());
+    RunBenchmarks("random", GenerateRandom());
+    return 0;
+}
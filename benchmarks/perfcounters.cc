@@ -0,0 +1,118 @@
+#include "perfcounters.h"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <utility>
+
+namespace
+{
+/*
+ * Get the perf type and config of an event.
+ * @param event The event.
+ * @return The type and the config.
+ */
+std::pair<uint32_t, uint64_t> GetEventConfig(PerfEvent event)
+{
+    constexpr uint64_t READ_MISS
+        = PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+    switch (event)
+    {
+    case PerfEvent::Cycles:
+        return { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES };
+    case PerfEvent::Instructions:
+        return { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS };
+    case PerfEvent::BranchMisses:
+        return { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES };
+    case PerfEvent::L1dMisses:
+        return { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | READ_MISS };
+    case PerfEvent::LlcMisses:
+        return { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | READ_MISS };
+    }
+    return { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES };
+}
+}
+
+PerfCounters::PerfCounters()
+{
+    // Each event is opened on its own, so that one the machine lacks does not drop the others
+    for (size_t i = 0; i < PERF_EVENTS_COUNT; ++i)
+    {
+        auto [type, config] = GetEventConfig(static_cast<PerfEvent>(i));
+        perf_event_attr attributes {};
+        attributes.size = sizeof(attributes);
+        attributes.type = type;
+        attributes.config = config;
+        attributes.disabled = 1;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        file_descriptors_[i]
+            = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+    for (int file_descriptor : file_descriptors_)
+    {
+        if (file_descriptor >= 0)
+        {
+            close(file_descriptor);
+        }
+    }
+}
+
+bool PerfCounters::IsAvailable() const
+{
+    for (int file_descriptor : file_descriptors_)
+    {
+        if (file_descriptor >= 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PerfCounters::Start()
+{
+    for (int file_descriptor : file_descriptors_)
+    {
+        if (file_descriptor >= 0)
+        {
+            ioctl(file_descriptor, PERF_EVENT_IOC_RESET, 0);
+            ioctl(file_descriptor, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+PerfCounts PerfCounters::Stop()
+{
+    for (int file_descriptor : file_descriptors_)
+    {
+        if (file_descriptor >= 0)
+        {
+            ioctl(file_descriptor, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+
+    PerfCounts counts;
+    for (size_t i = 0; i < PERF_EVENTS_COUNT; ++i)
+    {
+        // The count, the time the event was enabled and the time it was counted
+        uint64_t values[3] = {};
+        if (file_descriptors_[i] < 0
+            || read(file_descriptors_[i], values, sizeof(values)) != sizeof(values)
+            || values[2] == 0)
+        {
+            continue;
+        }
+        counts.values[i] = values[2] == values[1]
+            ? values[0]
+            : static_cast<uint64_t>(static_cast<double>(values[0]) * static_cast<double>(values[1])
+                                    / static_cast<double>(values[2]));
+    }
+    return counts;
+}
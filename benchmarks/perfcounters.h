@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+/*
+ * Hardware counters of the calling thread read with perf_event_open, user space only. The events
+ * the processor, the virtual machine or perf_event_paranoid do not allow are left out, and their
+ * counts are missing.
+ */
+
+/*
+ * The counted events.
+ */
+enum class PerfEvent : size_t
+{
+    Cycles,
+    Instructions,
+    BranchMisses,
+    L1dMisses, // L1 data cache read misses
+    LlcMisses, // last level cache read misses
+};
+
+constexpr size_t PERF_EVENTS_COUNT = 5;
+
+/*
+ * The counts of one measurement, scaled up when the kernel multiplexed the counters.
+ */
+struct PerfCounts
+{
+    std::array<std::optional<uint64_t>, PERF_EVENTS_COUNT> values;
+
+    /*
+     * Get the count of an event.
+     * @param event The event.
+     * @return The count, or std::nullopt if the event is not counted.
+     */
+    std::optional<uint64_t> Get(PerfEvent event) const
+    {
+        return values[static_cast<size_t>(event)];
+    }
+};
+
+/*
+ * Counters of the events around a measured stage.
+ */
+class PerfCounters
+{
+public:
+    /*
+     * Constructor. Opens the events, disabled.
+     */
+    PerfCounters();
+
+    /*
+     * Destructor. Closes the events.
+     */
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    /*
+     * Check whether any event is counted.
+     * @return Whether any event is counted.
+     */
+    bool IsAvailable() const;
+
+    /*
+     * Reset the counts and start counting.
+     */
+    void Start();
+
+    /*
+     * Stop counting.
+     * @return The counts since the start.
+     */
+    PerfCounts Stop();
+
+private:
+    std::array<int, PERF_EVENTS_COUNT> file_descriptors_; // -1 for the events not counted
+};
@@ -0,0 +1,191 @@
+#include "ans.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+/*
+ * Lower bound of a normalized state, the states stay in [ANS_LOWER_BOUND, 256 * ANS_LOWER_BOUND).
+ */
+constexpr uint32_t ANS_LOWER_BOUND = 1 << 23;
+
+constexpr uint32_t ANS_TOTAL = 1 << ANS_SCALE_BITS;
+
+AnsFrequencies NormalizeAnsFrequencies(const std::array<uint64_t, UINT8_MAX + 1>& counts)
+{
+    uint64_t total = 0;
+    for (auto count : counts)
+    {
+        total += count;
+    }
+
+    AnsFrequencies frequencies {};
+    if (total == 0)
+    {
+        return frequencies;
+    }
+
+    int64_t frequencies_sum = 0;
+    for (size_t character = 0; character <= UINT8_MAX; ++character)
+    {
+        if (counts[character] > 0)
+        {
+            auto scaled = static_cast<uint64_t>(
+                static_cast<double>(counts[character]) * ANS_TOTAL / static_cast<double>(total));
+            frequencies[character]
+                = static_cast<uint16_t>(std::clamp<uint64_t>(scaled, 1, ANS_TOTAL));
+            frequencies_sum += frequencies[character];
+        }
+    }
+
+    // Hand the rounding error to the largest frequencies, where it costs the least
+    while (frequencies_sum != ANS_TOTAL)
+    {
+        size_t largest = 0;
+        for (size_t character = 1; character <= UINT8_MAX; ++character)
+        {
+            if (frequencies[character] > frequencies[largest])
+            {
+                largest = character;
+            }
+        }
+
+        if (frequencies_sum < ANS_TOTAL)
+        {
+            frequencies[largest] += static_cast<uint16_t>(ANS_TOTAL - frequencies_sum);
+            frequencies_sum = ANS_TOTAL;
+        }
+        else
+        {
+            auto excess = static_cast<uint16_t>(
+                std::min<int64_t>(frequencies_sum - ANS_TOTAL, frequencies[largest] / 2));
+            frequencies[largest] -= excess;
+            frequencies_sum -= excess;
+        }
+    }
+    return frequencies;
+}
+
+uint64_t CountAnsBits(const std::array<uint64_t, UINT8_MAX + 1>& counts,
+                      const AnsFrequencies& frequencies)
+{
+    double bits = 0;
+    for (size_t character = 0; character <= UINT8_MAX; ++character)
+    {
+        if (counts[character] > 0)
+        {
+            bits += static_cast<double>(counts[character])
+                * (ANS_SCALE_BITS - std::log2(static_cast<double>(frequencies[character])));
+        }
+    }
+    return static_cast<uint64_t>(std::ceil(bits));
+}
+
+std::vector<unsigned char> EncodeAns(const std::vector<unsigned char>& block,
+                                     const AnsFrequencies& frequencies)
+{
+    std::array<uint32_t, UINT8_MAX + 1> starts {};
+    for (size_t character = 1; character <= UINT8_MAX; ++character)
+    {
+        starts[character] = starts[character - 1] + frequencies[character - 1];
+    }
+
+    // Code the block backwards, so that the decoder reads it forwards from the reversed bytes
+    std::vector<unsigned char> code;
+    code.reserve(block.size() / 2 + 16);
+    std::array<uint32_t, 2> states = { ANS_LOWER_BOUND, ANS_LOWER_BOUND };
+    for (size_t i = block.size(); i-- > 0;)
+    {
+        auto character = block[i];
+        uint32_t frequency = frequencies[character];
+        if (frequency == 0)
+        {
+            throw std::invalid_argument("The frequencies miss a character of the block");
+        }
+
+        uint32_t& state = states[i & 1];
+        uint32_t state_limit = ((ANS_LOWER_BOUND >> ANS_SCALE_BITS) << 8) * frequency;
+        while (state >= state_limit)
+        {
+            code.push_back(static_cast<unsigned char>(state & UINT8_MAX));
+            state >>= 8;
+        }
+        state = ((state / frequency) << ANS_SCALE_BITS) + state % frequency + starts[character];
+    }
+
+    for (size_t i = states.size(); i-- > 0;)
+    {
+        for (size_t byte = 0; byte < 4; ++byte)
+        {
+            code.push_back(static_cast<unsigned char>(states[i] >> (8 * byte)));
+        }
+    }
+    std::reverse(code.begin(), code.end());
+    return code;
+}
+
+std::vector<unsigned char>
+DecodeAns(const std::vector<unsigned char>& code, const AnsFrequencies& frequencies, size_t size)
+{
+    // Map every slot of the total to its character, frequency and start
+    struct Slot
+    {
+        uint16_t frequency;
+        uint16_t offset; // the slot minus the start of its character
+        unsigned char character;
+    };
+    std::vector<Slot> slots(ANS_TOTAL);
+    uint32_t start = 0;
+    for (size_t character = 0; character <= UINT8_MAX; ++character)
+    {
+        for (uint32_t i = 0; i < frequencies[character]; ++i)
+        {
+            if (start + i >= ANS_TOTAL)
+            {
+                throw std::runtime_error("The rANS frequencies exceed their total");
+            }
+            slots[start + i] = { .frequency = frequencies[character],
+                                 .offset = static_cast<uint16_t>(i),
+                                 .character = static_cast<unsigned char>(character) };
+        }
+        start += frequencies[character];
+    }
+    if (start != ANS_TOTAL && size > 0)
+    {
+        throw std::runtime_error("The rANS frequencies do not add up to their total");
+    }
+
+    size_t position = 0;
+    auto read_byte = [&]() -> uint32_t
+    {
+        if (position >= code.size())
+        {
+            throw std::runtime_error("The rANS code is truncated");
+        }
+        return code[position++];
+    };
+
+    std::array<uint32_t, 2> states {};
+    for (auto& state : states)
+    {
+        for (size_t byte = 0; byte < 4; ++byte)
+        {
+            state = (state << 8) | read_byte();
+        }
+    }
+
+    std::vector<unsigned char> block(size);
+    for (size_t i = 0; i < size; ++i)
+    {
+        uint32_t& state = states[i & 1];
+        const auto& slot = slots[state & (ANS_TOTAL - 1)];
+        block[i] = slot.character;
+
+        state = slot.frequency * (state >> ANS_SCALE_BITS) + slot.offset;
+        while (state < ANS_LOWER_BOUND)
+        {
+            state = (state << 8) | read_byte();
+        }
+    }
+    return block;
+}
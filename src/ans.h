@@ -0,0 +1,54 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Range asymmetric numeral systems (rANS) over the 256 characters. The frequencies are scaled to
+ * a total of 2^ANS_SCALE_BITS, and two interleaved states code the even and the odd characters,
+ * so that the decoder works on two independent dependency chains.
+ */
+constexpr size_t ANS_SCALE_BITS = 12;
+
+/*
+ * Scaled frequency of each character, zero for the characters missing from the block.
+ */
+using AnsFrequencies = std::array<uint16_t, UINT8_MAX + 1>;
+
+/*
+ * Scale the counts of the characters to a total of 2^ANS_SCALE_BITS, every counted character
+ * keeps a frequency of at least one.
+ * @param counts The counts of the characters.
+ * @return The scaled frequencies, all zero if nothing is counted.
+ */
+AnsFrequencies NormalizeAnsFrequencies(const std::array<uint64_t, UINT8_MAX + 1>& counts);
+
+/*
+ * Estimate the size of the characters coded with the scaled frequencies.
+ * @param counts The counts of the characters.
+ * @param frequencies The scaled frequencies, non-zero for every counted character.
+ * @return The size in bits, without the final states.
+ */
+uint64_t CountAnsBits(const std::array<uint64_t, UINT8_MAX + 1>& counts,
+                      const AnsFrequencies& frequencies);
+
+/*
+ * Code the block.
+ * @param block The block content.
+ * @param frequencies The scaled frequencies, non-zero for every character of the block.
+ * @return The bytes of the code, the final states first.
+ */
+std::vector<unsigned char> EncodeAns(const std::vector<unsigned char>& block,
+                                     const AnsFrequencies& frequencies);
+
+/*
+ * Decode a block.
+ * @param code The bytes of the code.
+ * @param frequencies The scaled frequencies the block was coded with.
+ * @param size The number of characters of the block.
+ * @return The block content.
+ */
+std::vector<unsigned char>
+DecodeAns(const std::vector<unsigned char>& code, const AnsFrequencies& frequencies, size_t size);
@@ -1,35 +1,797 @@
 #include "archiver.h"
 
+#include "filecache.h"
 #include "filereader.h"
 #include "filewriter.h"
 #include "huffman.h"
+#include "memorybudget.h"
+#include "threadpool.h"
+#include "trace.h"
 
-Archiver::Archiver(const std::string& archive_path, const std::vector<std::string>& file_paths)
-    : archive_path_(archive_path), file_paths_(file_paths)
+#include <algorithm>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <unordered_set>
+
+/*
+ * Size of the terminator record: the 9-bit ARCHIVE_END padded to a byte boundary.
+ */
+constexpr size_t ARCHIVE_END_SIZE = 2;
+
+/*
+ * Size of the file record size that follows ONE_MORE_FILE.
+ */
+constexpr size_t FILE_RECORD_SIZE_BYTES = 8;
+
+/*
+ * Size of the number of sync points that ends a file record.
+ */
+constexpr size_t SYNC_POINTS_COUNT_BYTES = 4;
+
+/*
+ * Size of a sync point: the offset in the file and the bit offset in the record.
+ */
+constexpr size_t SYNC_POINT_BYTES = 16;
+
+/*
+ * Size of the chunks the encoded content of a file is copied by.
+ */
+constexpr size_t COPIED_CHUNK_SIZE = 1 << 20;
+
+namespace
+{
+/*
+ * Copy bytes of a file as they are.
+ * @param reader The reader of the bytes.
+ * @param begin The offset of the first byte.
+ * @param end The offset past the last byte.
+ * @param writer The writer at a byte boundary.
+ */
+void CopyBytes(FileReader& reader, uint64_t begin, uint64_t end, FileWriter& writer)
+{
+    reader.SetPosition(begin);
+    for (uint64_t position = begin; position < end;)
+    {
+        auto characters
+            = reader.ReadCharacters(std::min<uint64_t>(COPIED_CHUNK_SIZE, end - position));
+        if (characters.empty())
+        {
+            throw std::runtime_error("The copied file is truncated");
+        }
+        writer.WriteCharacters(characters);
+        position += characters.size();
+    }
+}
+
+/*
+ * Copy the encoded content of a file: its blocks, then its seek table with the bit offsets moved.
+ * @param reader The reader of the content.
+ * @param begin The offset of the content in bytes.
+ * @param end The offset past the seek table that ends the content in bytes.
+ * @param bit_offset_shift The number of bits to add to the bit offsets of the sync points.
+ * @param writer The writer at a byte boundary.
+ * @return The size of the seek table in bytes.
+ */
+uint64_t CopyEncodedContent(FileReader& reader,
+                            uint64_t begin,
+                            uint64_t end,
+                            int64_t bit_offset_shift,
+                            FileWriter& writer)
+{
+    if (end - begin < SYNC_POINTS_COUNT_BYTES)
+    {
+        throw std::runtime_error("The encoded file has no seek table");
+    }
+    reader.SetPosition(end - SYNC_POINTS_COUNT_BYTES);
+    uint64_t sync_points_count = reader.ReadHuffmanInt(SYNC_POINTS_COUNT_BYTES * 8);
+    if (sync_points_count > (end - begin - SYNC_POINTS_COUNT_BYTES) / SYNC_POINT_BYTES)
+    {
+        throw std::runtime_error("The seek table of the encoded file is corrupted");
+    }
+    uint64_t seek_table_size = sync_points_count * SYNC_POINT_BYTES + SYNC_POINTS_COUNT_BYTES;
+
+    CopyBytes(reader, begin, end - seek_table_size, writer);
+
+    for (uint64_t i = 0; i < sync_points_count; ++i)
+    {
+        writer.WriteHuffmanInt(reader.ReadHuffmanInt(64), 64);
+        writer.WriteHuffmanInt(reader.ReadHuffmanInt(64) + static_cast<uint64_t>(bit_offset_shift),
+                               64);
+    }
+    writer.WriteHuffmanInt(sync_points_count, SYNC_POINTS_COUNT_BYTES * 8);
+    return seek_table_size;
+}
+
+/*
+ * Write an archive apart and rename it in place once it is complete, a failed writing leaves the
+ * archive as it was.
+ * @param archive_path The path to the archive.
+ * @param write_records Write the records of the archive, the terminator is written after them.
+ */
+void WriteArchiveApart(const std::string& archive_path,
+                       const std::function<void(FileWriter&)>& write_records)
+{
+    std::string temporary_path = archive_path + ".tmp";
+    try
+    {
+        {
+            FileWriter writer(temporary_path);
+            write_records(writer);
+            writer.WriteHuffmanInt(ARCHIVE_END);
+            writer.AlignToByte();
+        }
+        std::filesystem::rename(temporary_path, archive_path);
+    }
+    catch (...)
+    {
+        std::filesystem::remove(temporary_path);
+        throw;
+    }
+}
+}
+
+Archiver::Archiver(const std::string& archive_path,
+                   const std::vector<std::string>& file_paths,
+                   const EncodingOptions& options)
+    : archive_path_(archive_path), options_(FitToMemoryLimit(options))
+{
+    if (options_.memory_limit > 0)
+    {
+        ReturnFreedMemory();
+    }
+
+    for (const auto& file_path : file_paths)
+    {
+        if (!std::filesystem::is_directory(file_path))
+        {
+            files_.push_back({ .path = file_path,
+                               .name = std::filesystem::path(file_path).filename().string() });
+            continue;
+        }
+
+        // The names start with the directory itself, e.g. "docs/notes/a.txt" for "path/to/docs"
+        auto directory = std::filesystem::absolute(file_path).lexically_normal();
+        if (!directory.has_filename())
+        {
+            directory = directory.parent_path();
+        }
+
+        std::vector<ArchivedFile> directory_files;
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(directory))
+        {
+            if (entry.is_regular_file())
+            {
+                directory_files.push_back(
+                    { .path = entry.path().string(),
+                      .name = entry.path()
+                                  .lexically_relative(directory.parent_path())
+                                  .generic_string() });
+            }
+        }
+        std::sort(directory_files.begin(),
+                  directory_files.end(),
+                  [](const auto& lhs, const auto& rhs) { return lhs.name < rhs.name; });
+        files_.insert(files_.end(), directory_files.begin(), directory_files.end());
+    }
+}
+
+Archiver::Archiver(const std::string& archive_path, size_t threads_count, size_t memory_limit)
+    : archive_path_(archive_path),
+      options_ { .threads_count = threads_count, .memory_limit = memory_limit }
 {
+    if (memory_limit > 0)
+    {
+        GetBudgetedMemory(memory_limit);
+        ReturnFreedMemory();
+    }
 }
 
-Archiver::Archiver(const std::string& archive_path) : archive_path_(archive_path) { }
+std::vector<EncodingStats> Archiver::Compress() const
+{
+    std::vector<EncodingStats> stats;
+    std::vector<CacheEntry> cache_entries;
+    {
+        FileWriter writer(archive_path_);
+        stats = EncodeFiles(writer, cache_entries);
+    }
+    StoreCacheEntries(cache_entries, 0);
+    return stats;
+}
 
-void Archiver::Compress() const
+std::vector<EncodingStats> Archiver::Append() const
 {
-    FileWriter writer(archive_path_);
-    for (const auto& file_path : file_paths_)
+    // The archive should end with the terminator record, which the new records replace
+    size_t archive_size = 0;
+    {
+        FileReader reader(archive_path_);
+        archive_size = reader.GetFileSize();
+        if (archive_size < ARCHIVE_END_SIZE)
+        {
+            throw std::runtime_error("The archive is too short to append to");
+        }
+
+        reader.SetPosition(archive_size - ARCHIVE_END_SIZE);
+        if (reader.ReadHuffmanInt() != ARCHIVE_END || reader.ReadHuffmanInt(7) != 0)
+        {
+            throw std::runtime_error("The archive does not end with a byte-aligned terminator");
+        }
+    }
+
+    std::filesystem::resize_file(archive_path_, archive_size - ARCHIVE_END_SIZE);
+    std::vector<EncodingStats> stats;
+    std::vector<CacheEntry> cache_entries;
+    try
+    {
+        FileWriter writer(archive_path_, true);
+        stats = EncodeFiles(writer, cache_entries);
+    }
+    catch (...)
     {
-        HuffmanCoder huffman_coder;
-        FileReader reader(file_path);
-        bool is_last_file = file_path == file_paths_.back();
-        huffman_coder.Encode(reader, writer, is_last_file);
+        // Drop the partly written records and put the terminator back
+        std::filesystem::resize_file(archive_path_, archive_size - ARCHIVE_END_SIZE);
+        {
+            FileWriter writer(archive_path_, true);
+            writer.WriteHuffmanInt(ARCHIVE_END);
+        }
+        throw;
     }
+    StoreCacheEntries(cache_entries, archive_size - ARCHIVE_END_SIZE);
+    return stats;
 }
 
-void Archiver::Decompress() const
+std::vector<EncodingStats> Archiver::EncodeFiles(FileWriter& writer,
+                                                 std::vector<CacheEntry>& cache_entries) const
 {
+    std::vector<EncodingStats> stats;
+    HuffmanCoder huffman_coder(options_);
+
+    // Write the shared table in front of the files
+    if (options_.table_scope == TableScope::Archive && !files_.empty())
+    {
+        for (const auto& file : files_)
+        {
+            FileReader reader(file.path);
+            huffman_coder.CountSharedFrequencies(reader);
+        }
+
+        writer.WriteHuffmanInt(SHARED_TABLE);
+        huffman_coder.EncodeSharedTable(writer);
+        writer.AlignToByte();
+    }
+
+    struct EncodedSegment
+    {
+        std::unique_ptr<FileWriter> writer; // nullptr if the segment went to the archive directly
+        CharacterCounts character_counts {};
+    };
+
+    auto encode_segment = [&](const Segment& segment, FileWriter* segment_writer)
+    {
+        EncodedSegment encoded_segment;
+        if (segment_writer == nullptr)
+        {
+            encoded_segment.writer = std::make_unique<FileWriter>();
+            segment_writer = encoded_segment.writer.get();
+        }
+
+        SetTraceFile(files_[segment.file_index].name);
+        FileReader reader(files_[segment.file_index].path);
+        huffman_coder.EncodeRange(reader,
+                                  segment.begin,
+                                  segment.end,
+                                  *segment_writer,
+                                  options_.collect_stats ? &encoded_segment.character_counts
+                                                         : nullptr);
+        return encoded_segment;
+    };
+
+    // Look the files up in the cache, the blocks of a file depend on the shared table otherwise
+    std::unique_ptr<FileCache> file_cache;
+    std::vector<std::string> cache_entry_paths(files_.size());
+    std::vector<bool> is_cached(files_.size());
+    std::vector<CharacterCounts> cached_character_counts(files_.size());
+    if (!options_.cache_directory.empty() && options_.table_scope != TableScope::Archive)
+    {
+        file_cache = std::make_unique<FileCache>(options_.cache_directory, options_);
+        for (size_t file_index = 0; file_index < files_.size(); ++file_index)
+        {
+            FileReader reader(files_[file_index].path);
+            cache_entry_paths[file_index] = file_cache->GetEntryPath(
+                reader,
+                options_.collect_stats ? &cached_character_counts[file_index] : nullptr);
+            is_cached[file_index] = file_cache->Contains(cache_entry_paths[file_index]);
+        }
+    }
+
+    // Encode the segments ahead on the pool, a window of them is kept in memory at most
+    auto segments = SplitIntoSegments(is_cached);
+    std::unique_ptr<ThreadPool> thread_pool;
+    std::unique_ptr<MemoryBudget> memory_budget;
+    std::deque<std::pair<std::future<EncodedSegment>, size_t>> encoded_segments; // with the bytes
+    size_t submitted_segments_count = 0;
+    if (options_.threads_count > 1)
+    {
+        thread_pool = std::make_unique<ThreadPool>(options_.threads_count);
+        if (options_.memory_limit > 0)
+        {
+            size_t budget = GetBudgetedMemory(options_.memory_limit);
+            memory_budget = std::make_unique<MemoryBudget>(budget);
+        }
+    }
+
+    CharacterCounts file_character_counts {};
+    std::vector<std::pair<uint64_t, uint64_t>> sync_points; // (offset in the file, bit offset)
+    uint64_t file_record_position = 0;
+    uint64_t file_bits_before = 0;
+    uint64_t file_content_position = 0;
+    for (const auto& segment : segments)
+    {
+        const auto& file = files_[segment.file_index];
+        SetTraceFile(file.name);
+        if (is_cached[segment.file_index])
+        {
+            // A cached file is copied with its header written anew, as its name may differ
+            writer.WriteHuffmanInt(ONE_MORE_FILE);
+            writer.AlignToByte();
+            file_record_position = writer.GetBitsWritten() / 8;
+            writer.WriteHuffmanInt(0, FILE_RECORD_SIZE_BYTES * 8);
+            huffman_coder.EncodeFileHeader(file.name, segment.file_size, writer);
+            uint64_t header_bits
+                = writer.GetBitsWritten() - (file_record_position + FILE_RECORD_SIZE_BYTES) * 8;
+
+            const auto& entry_path = cache_entry_paths[segment.file_index];
+            FileReader reader(entry_path);
+            uint64_t seek_table_size = CopyEncodedContent(
+                reader, 0, reader.GetFileSize(), static_cast<int64_t>(header_bits), writer);
+
+            if (options_.collect_stats)
+            {
+                const auto& character_counts = cached_character_counts[segment.file_index];
+                uint64_t encoded_bits
+                    = header_bits + (reader.GetFileSize() - seek_table_size) * 8;
+                stats.push_back(huffman_coder.GetStats(
+                    file.name, segment.file_size, encoded_bits, character_counts));
+            }
+            else
+            {
+                stats.emplace_back();
+            }
+
+            uint64_t file_record_end = writer.GetBitsWritten() / 8;
+            writer.RewriteBytes(file_record_position,
+                                file_record_end - file_record_position - FILE_RECORD_SIZE_BYTES,
+                                FILE_RECORD_SIZE_BYTES);
+            continue;
+        }
+
+        if (segment.begin == 0)
+        {
+            // The size of the rest of the record is known once the file is encoded
+            writer.WriteHuffmanInt(ONE_MORE_FILE);
+            writer.AlignToByte();
+            file_record_position = writer.GetBitsWritten() / 8;
+            writer.WriteHuffmanInt(0, FILE_RECORD_SIZE_BYTES * 8);
+
+            file_bits_before = writer.GetBitsWritten();
+            huffman_coder.EncodeFileHeader(file.name, segment.file_size, writer);
+            file_content_position = writer.GetBitsWritten() / 8;
+            file_character_counts = {};
+            sync_points.clear();
+        }
+
+        // Every segment is a sync point, its blocks do not depend on the blocks in front of it
+        uint64_t file_record_bits = (file_record_position + FILE_RECORD_SIZE_BYTES) * 8;
+        sync_points.emplace_back(segment.begin, writer.GetBitsWritten() - file_record_bits);
+
+        // The records are written in the order of the segments whichever thread encodes them
+        EncodedSegment encoded_segment;
+        if (thread_pool)
+        {
+            while (submitted_segments_count < segments.size()
+                   && encoded_segments.size() < 2 * thread_pool->GetThreadsCount())
+            {
+                const auto& next_segment = segments[submitted_segments_count];
+                if (is_cached[next_segment.file_index])
+                {
+                    ++submitted_segments_count;
+                    continue;
+                }
+
+                // A segment is admitted once the memory of its encoding is free, the budget is
+                // all free while none is in flight
+                size_t reserved_bytes = 0;
+                if (memory_budget)
+                {
+                    uint64_t range_size = next_segment.end - next_segment.begin;
+                    reserved_bytes = EstimateEncodedRangeMemory(options_, range_size);
+                    if (!memory_budget->TryAcquire(reserved_bytes))
+                    {
+                        break;
+                    }
+                }
+                ++submitted_segments_count;
+                encoded_segments.emplace_back(
+                    thread_pool->Submit([&encode_segment, &next_segment]
+                                        { return encode_segment(next_segment, nullptr); }),
+                    reserved_bytes);
+            }
+            auto& [encoded_segment_future, reserved_bytes] = encoded_segments.front();
+            encoded_segment = encoded_segment_future.get();
+            writer.AppendBits(*encoded_segment.writer);
+            encoded_segment.writer.reset();
+            if (memory_budget)
+            {
+                memory_budget->Release(reserved_bytes);
+            }
+            encoded_segments.pop_front();
+        }
+        else
+        {
+            encoded_segment = encode_segment(segment, &writer);
+        }
+
+        for (size_t character = 0; character < file_character_counts.size(); ++character)
+        {
+            file_character_counts[character] += encoded_segment.character_counts[character];
+        }
+
+        if (segment.end == segment.file_size)
+        {
+            if (options_.collect_stats)
+            {
+                stats.push_back(huffman_coder.GetStats(file.name,
+                                                       segment.file_size,
+                                                       writer.GetBitsWritten() - file_bits_before,
+                                                       file_character_counts));
+            }
+            else
+            {
+                stats.emplace_back();
+            }
+            writer.AlignToByte();
+
+            // The seek table ends the record, so that it is found from the record size
+            for (const auto& [position, bit_offset] : sync_points)
+            {
+                writer.WriteHuffmanInt(position, 64);
+                writer.WriteHuffmanInt(bit_offset, 64);
+            }
+            writer.WriteHuffmanInt(sync_points.size(), SYNC_POINTS_COUNT_BYTES * 8);
+
+            uint64_t file_record_end = writer.GetBitsWritten() / 8;
+            writer.RewriteBytes(file_record_position,
+                                file_record_end - file_record_position - FILE_RECORD_SIZE_BYTES,
+                                FILE_RECORD_SIZE_BYTES);
+
+            if (file_cache)
+            {
+                uint64_t header_bits
+                    = (file_content_position - file_record_position - FILE_RECORD_SIZE_BYTES) * 8;
+                cache_entries.push_back({ .path = cache_entry_paths[segment.file_index],
+                                          .begin = file_content_position,
+                                          .end = file_record_end,
+                                          .header_bits = header_bits });
+            }
+        }
+    }
+    writer.WriteHuffmanInt(ARCHIVE_END);
+    writer.AlignToByte();
+
+    return stats;
+}
+
+void Archiver::StoreCacheEntries(const std::vector<CacheEntry>& cache_entries,
+                                 uint64_t start_position) const
+{
+    if (cache_entries.empty())
+    {
+        return;
+    }
+
+    // The bit offsets of the sync points are kept from the start of the encoded content
+    FileCache file_cache(options_.cache_directory, options_);
     FileReader reader(archive_path_);
-    bool need_to_decode_next_file = true;
-    while (need_to_decode_next_file)
+    for (const auto& cache_entry : cache_entries)
+    {
+        file_cache.Store(cache_entry.path,
+                         [&](FileWriter& writer)
+                         {
+                             CopyEncodedContent(reader,
+                                                start_position + cache_entry.begin,
+                                                start_position + cache_entry.end,
+                                                -static_cast<int64_t>(cache_entry.header_bits),
+                                                writer);
+                         });
+    }
+}
+
+std::vector<Archiver::Segment> Archiver::SplitIntoSegments(const std::vector<bool>& is_cached) const
+{
+    size_t block_size = std::max<size_t>(options_.block_size, 1);
+    size_t segment_size = std::max(block_size, options_.sync_interval / block_size * block_size);
+
+    std::vector<Segment> segments;
+    for (size_t file_index = 0; file_index < files_.size(); ++file_index)
+    {
+        FileReader reader(files_[file_index].path);
+        size_t file_size = reader.GetFileSize();
+        if (is_cached[file_index])
+        {
+            segments.push_back(
+                { .file_index = file_index, .begin = 0, .end = file_size, .file_size = file_size });
+            continue;
+        }
+
+        size_t begin = 0;
+        do
+        {
+            size_t end = std::min(file_size, begin + segment_size);
+            segments.push_back(
+                { .file_index = file_index, .begin = begin, .end = end, .file_size = file_size });
+            begin = end;
+        } while (begin < file_size);
+    }
+    return segments;
+}
+
+void Archiver::Decompress(const std::string& output_directory) const
+{
+    auto file_records = ReadFileRecords();
+
+    // A file overwrites the files with the same name in front of it
+    std::unordered_set<std::string> file_names;
+    std::vector<const FileRecord*> last_file_records;
+    for (auto it = file_records.rbegin(); it != file_records.rend(); ++it)
+    {
+        if (file_names.insert(it->file_name).second)
+        {
+            last_file_records.push_back(&*it);
+        }
+    }
+    std::reverse(last_file_records.begin(), last_file_records.end());
+
+    auto decode_file = [this, &output_directory](const FileRecord& file_record)
+    {
+        FileReader reader(archive_path_);
+        reader.SetPosition(file_record.position);
+        file_record.huffman_coder->Decode(reader, output_directory);
+    };
+
+    // The blocks are as large as the encoder made them, hence a file is refused before decoding
+    // rather than decoded past the limit. On several threads a file waits for the memory of its
+    // decoding on its worker.
+    auto estimate_memory = [](const FileRecord& file_record)
+    {
+        return EstimateDecodingMemory(
+            file_record.file_size, file_record.block_size, file_record.transforms);
+    };
+    std::unique_ptr<MemoryBudget> memory_budget;
+    if (options_.memory_limit > 0)
+    {
+        size_t budget = GetBudgetedMemory(options_.memory_limit);
+        for (const auto* file_record : last_file_records)
+        {
+            if (estimate_memory(*file_record) > budget)
+            {
+                throw std::runtime_error("The file " + file_record->file_name
+                                         + " needs more memory to decode than the limit");
+            }
+        }
+        memory_budget = std::make_unique<MemoryBudget>(budget);
+    }
+
+    if (options_.threads_count <= 1)
+    {
+        for (const auto* file_record : last_file_records)
+        {
+            decode_file(*file_record);
+        }
+        return;
+    }
+
+    ThreadPool thread_pool(options_.threads_count);
+    std::vector<std::future<void>> decoded_files;
+    for (const auto* file_record : last_file_records)
+    {
+        decoded_files.push_back(thread_pool.Submit(
+            [&decode_file, &estimate_memory, &memory_budget, file_record]
+            {
+                std::optional<MemoryReservation> reservation;
+                if (memory_budget)
+                {
+                    reservation.emplace(*memory_budget, estimate_memory(*file_record));
+                }
+                decode_file(*file_record);
+            }));
+    }
+    for (auto& decoded_file : decoded_files)
+    {
+        decoded_file.get();
+    }
+}
+
+std::vector<unsigned char>
+Archiver::ExtractRange(const std::string& file_name, uint64_t offset, uint64_t length) const
+{
+    SetTraceFile(file_name);
+    auto file_records = ReadFileRecords();
+    auto file_record = std::find_if(file_records.rbegin(),
+                                    file_records.rend(),
+                                    [&](const auto& record)
+                                    { return record.file_name == file_name; });
+    if (file_record == file_records.rend())
+    {
+        throw std::runtime_error("The archive has no file " + file_name);
+    }
+
+    // Find the last sync point at or before the range in the seek table at the end of the record
+    FileReader reader(archive_path_);
+    size_t file_record_end = file_record->position + file_record->size;
+    if (file_record->size < SYNC_POINTS_COUNT_BYTES)
+    {
+        throw std::runtime_error("The file record has no seek table");
+    }
+    reader.SetPosition(file_record_end - SYNC_POINTS_COUNT_BYTES);
+    uint64_t sync_points_count = reader.ReadHuffmanInt(SYNC_POINTS_COUNT_BYTES * 8);
+    if (sync_points_count == 0
+        || sync_points_count > (file_record->size - SYNC_POINTS_COUNT_BYTES) / SYNC_POINT_BYTES)
+    {
+        throw std::runtime_error("The seek table of " + file_name + " is corrupted");
+    }
+
+    reader.SetPosition(file_record_end - SYNC_POINTS_COUNT_BYTES
+                       - sync_points_count * SYNC_POINT_BYTES);
+    uint64_t sync_position = 0;
+    uint64_t sync_bit_offset = 0;
+    for (uint64_t i = 0; i < sync_points_count; ++i)
+    {
+        uint64_t position = reader.ReadHuffmanInt(64);
+        uint64_t bit_offset = reader.ReadHuffmanInt(64);
+        if (i == 0 || position <= offset)
+        {
+            sync_position = position;
+            sync_bit_offset = bit_offset;
+        }
+    }
+    if (sync_position > offset || sync_bit_offset / 8 >= file_record->size)
+    {
+        throw std::runtime_error("The seek table of " + file_name + " is corrupted");
+    }
+
+    // Sync points fall inside bytes, hence the bits in front of it are skipped
+    reader.SetPosition(file_record->position + sync_bit_offset / 8);
+    reader.ReadHuffmanInt(sync_bit_offset % 8);
+    uint64_t end = offset + std::min(length, UINT64_MAX - offset);
+    return file_record->huffman_coder->DecodeRange(
+        reader, sync_position, offset, end, file_record->block_size);
+}
+
+void Archiver::Merge(const std::vector<std::string>& archive_paths) const
+{
+    auto write_records = [&](FileWriter& writer)
+    {
+        // The records are byte-aligned, and every archive has the SHARED_TABLE record in front of
+        // the files coded with it, hence the records of the archives can follow one another
+        for (const auto& merged_path : archive_paths)
+        {
+            uint64_t archive_end = 0;
+            Archiver(merged_path).ReadFileRecords(&archive_end);
+            FileReader reader(merged_path);
+            CopyBytes(reader, 0, archive_end, writer);
+        }
+    };
+    WriteArchiveApart(archive_path_, write_records);
+}
+
+void Archiver::ExtractRaw(const std::string& output_path,
+                          const std::vector<std::string>& file_names) const
+{
+    auto file_records = ReadFileRecords();
+    std::vector<const FileRecord*> extracted_file_records;
+    for (const auto& file_name : file_names)
+    {
+        auto file_record = std::find_if(file_records.rbegin(),
+                                        file_records.rend(),
+                                        [&](const auto& record)
+                                        { return record.file_name == file_name; });
+        if (file_record == file_records.rend())
+        {
+            throw std::runtime_error("The archive has no file " + file_name);
+        }
+        extracted_file_records.push_back(&*file_record);
+    }
+
+    // The records point into the vector of the archive, hence they sort in its order
+    std::sort(extracted_file_records.begin(), extracted_file_records.end());
+    extracted_file_records.erase(
+        std::unique(extracted_file_records.begin(), extracted_file_records.end()),
+        extracted_file_records.end());
+
+    auto write_records = [&](FileWriter& writer)
+    {
+        // A file gets the shared table in front of it unless the table is copied already
+        FileReader reader(archive_path_);
+        uint64_t copied_shared_table_end = 0;
+        for (const auto* file_record : extracted_file_records)
+        {
+            if (file_record->shared_table_end != 0
+                && file_record->shared_table_end != copied_shared_table_end)
+            {
+                CopyBytes(
+                    reader, file_record->shared_table_begin, file_record->shared_table_end, writer);
+                copied_shared_table_end = file_record->shared_table_end;
+            }
+            uint64_t file_record_end = file_record->position + file_record->size;
+            CopyBytes(reader, file_record->begin, file_record_end, writer);
+        }
+    };
+    WriteArchiveApart(output_path, write_records);
+}
+
+std::vector<Archiver::FileRecord> Archiver::ReadFileRecords(uint64_t* archive_end) const
+{
+    FileReader reader(archive_path_);
+
+    // A file is decoded with the shared table in front of it, hence the coders are kept per table
+    EncodingOptions decoding_options { .memory_limit = options_.memory_limit };
+    auto huffman_coder = std::make_shared<HuffmanCoder>(decoding_options);
+    uint64_t shared_table_begin = 0;
+    uint64_t shared_table_end = 0;
+    std::vector<FileRecord> file_records;
+
+    // Every record starts at a byte boundary
+    uint64_t record_begin = reader.GetPosition();
+    uint16_t record = reader.ReadHuffmanInt();
+    while (record != ARCHIVE_END)
+    {
+        if (record == SHARED_TABLE)
+        {
+            huffman_coder = std::make_shared<HuffmanCoder>(decoding_options);
+            huffman_coder->DecodeSharedTable(reader);
+            reader.AlignToByte();
+            shared_table_begin = record_begin;
+            shared_table_end = reader.GetPosition();
+        }
+        else if (record == ONE_MORE_FILE)
+        {
+            // Skip the file by the size of its record
+            reader.AlignToByte();
+            uint64_t file_record_size = reader.ReadHuffmanInt(FILE_RECORD_SIZE_BYTES * 8);
+            size_t position = reader.GetPosition();
+            if (file_record_size > reader.GetFileSize() - position)
+            {
+                throw std::runtime_error("The file record is longer than the archive");
+            }
+            auto header = huffman_coder->RestoreFileHeader(reader);
+            file_records.push_back({ .huffman_coder = huffman_coder,
+                                     .begin = record_begin,
+                                     .position = position,
+                                     .size = file_record_size,
+                                     .file_name = std::move(header.file_name),
+                                     .file_size = header.file_size,
+                                     .block_size = header.block_size,
+                                     .transforms = header.transforms,
+                                     .shared_table_begin = shared_table_begin,
+                                     .shared_table_end = shared_table_end });
+            reader.SetPosition(position + file_record_size);
+        }
+        else
+        {
+            throw std::runtime_error("Unknown record in the archive");
+        }
+
+        record_begin = reader.GetPosition();
+        record = reader.ReadHuffmanInt();
+    }
+
+    if (archive_end != nullptr)
     {
-        HuffmanCoder huffman_coder;
-        need_to_decode_next_file = huffman_coder.Decode(reader);
+        *archive_end = record_begin;
     }
+    return file_records;
 }
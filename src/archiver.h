@@ -1,5 +1,8 @@
 #pragma once
 
+#include "huffman.h"
+
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -12,27 +15,157 @@ public:
     /*
      * Constructor.
      * @param archive_path The path to the archive file.
-     * @param file_paths The paths to the files to archive.
+     * @param file_paths The paths to the files to archive. The files of a directory are archived
+     * recursively in the order of their names, which keep the path from the directory on.
+     * @param options The encoder options, fitted to their memory limit if any.
      */
-    Archiver(const std::string& archive_path, const std::vector<std::string>& file_paths);
+    Archiver(const std::string& archive_path,
+             const std::vector<std::string>& file_paths,
+             const EncodingOptions& options = {});
 
     /*
      * Constructor.
      * @param archive_path The path to the archive file.
+     * @param threads_count The number of threads decoding the files.
+     * @param memory_limit The bytes of the process the decoding threads share, 0 for no limit.
      */
-    Archiver(const std::string& archive_path);
+    Archiver(const std::string& archive_path, size_t threads_count = 1, size_t memory_limit = 0);
 
     /*
      * Compress the files to the archive.
+     * @return The statistics of each compressed file, filled in only if requested in the options.
+     */
+    std::vector<EncodingStats> Compress() const;
+
+    /*
+     * Add the files to the end of an existing archive, only its terminator is rewritten.
+     * If encoding fails, the archive is left as it was.
+     * @return The statistics of each compressed file, filled in only if requested in the options.
+     */
+    std::vector<EncodingStats> Append() const;
+
+    /*
+     * Decompress the archive to get the files. With several threads the files are decoded
+     * concurrently, each file record tells its size so that the next one is found without
+     * decoding it. Under a memory limit a file waits until the memory of its decoding is free.
+     * If several files have the same name, only the last one is decoded.
+     * @param output_directory The directory the files are restored under, the current one if
+     * empty.
+     */
+    void Decompress(const std::string& output_directory = {}) const;
+
+    /*
+     * Decompress a range of a file from the sync point nearest to its start.
+     * @param file_name The name of the file in the archive, the last one if several files have it.
+     * @param offset The offset of the range in the file in bytes.
+     * @param length The length of the range in bytes.
+     * @return The content of the range, shorter if the file ends before the range does.
      */
-    void Compress() const;
+    std::vector<unsigned char>
+    ExtractRange(const std::string& file_name, uint64_t offset, uint64_t length) const;
 
     /*
-     * Decompress the archive to get the files.
+     * Write the records of other archives one after another to the archive, copying their bytes
+     * without decoding them, with one terminator at the end. The archive is written apart and
+     * renamed in place, hence it may be one of the merged archives.
+     * @param archive_paths The paths to the archives to merge, in the order of their records.
      */
-    void Decompress() const;
+    void Merge(const std::vector<std::string>& archive_paths) const;
+
+    /*
+     * Copy the records of some files to a new archive without decoding them, each with the
+     * shared table it is coded with. The new archive is written apart and renamed in place.
+     * @param output_path The path to the new archive.
+     * @param file_names The names of the files in the archive, the last file if several have a
+     * name. The records are copied in the order of the archive.
+     */
+    void ExtractRaw(const std::string& output_path,
+                    const std::vector<std::string>& file_names) const;
 
 private:
+    /*
+     * An encoded file to keep in the cache once the archive is written.
+     */
+    struct CacheEntry
+    {
+        std::string path; // the path of the entry
+        uint64_t begin; // the offset of the encoded content after the file header
+        uint64_t end; // the offset past the file record
+        uint64_t header_bits; // the bits between the record size and the encoded content
+    };
+
+    /*
+     * Write the records of the files and the terminator, each record starts at a byte boundary.
+     * The files found in the cache are copied from it.
+     * @param writer The archive writer.
+     * @param cache_entries Set to the encoded files missing from the cache, with the offsets from
+     * the start of the writing.
+     * @return The statistics of each compressed file, filled in only if requested in the options.
+     */
+    std::vector<EncodingStats> EncodeFiles(FileWriter& writer,
+                                           std::vector<CacheEntry>& cache_entries) const;
+
+    /*
+     * Copy the encoded files from the written archive to the cache.
+     * @param cache_entries The encoded files.
+     * @param start_position The offset in the archive the writing started from.
+     */
+    void StoreCacheEntries(const std::vector<CacheEntry>& cache_entries,
+                           uint64_t start_position) const;
+
+    /*
+     * A file to archive.
+     */
+    struct ArchivedFile
+    {
+        std::string path;
+        std::string name; // the name stored in the archive
+    };
+
+    /*
+     * A range of a file encoded on its own, so that the ranges can be encoded in parallel.
+     */
+    struct Segment
+    {
+        size_t file_index;
+        size_t begin;
+        size_t end;
+        size_t file_size;
+    };
+
+    /*
+     * Split the files into segments. The split does not depend on the number of threads, hence
+     * the archive does not either.
+     * @param is_cached Whether each file is copied from the cache, such a file is one segment.
+     * @return The segments in the order of the files, an empty file has one empty segment.
+     */
+    std::vector<Segment> SplitIntoSegments(const std::vector<bool>& is_cached) const;
+
+    /*
+     * A file in the archive.
+     */
+    struct FileRecord
+    {
+        std::shared_ptr<const HuffmanCoder> huffman_coder; // holds the shared table of the file
+        size_t begin; // the offset of the ONE_MORE_FILE that starts the record
+        size_t position; // the offset of the record after its size
+        uint64_t size; // the size of the record after its size
+        std::string file_name;
+        uint64_t file_size; // the size of the decoded file
+        uint64_t block_size; // the largest block of the file
+        uint16_t transforms; // the transforms its blocks may use
+        uint64_t shared_table_begin; // the SHARED_TABLE record in front of the file, empty if none
+        uint64_t shared_table_end;
+    };
+
+    /*
+     * Find the files in the archive, skipping their content by the sizes of their records.
+     * @param archive_end Set to the offset of the terminator unless nullptr.
+     * @return The files in the order of the archive.
+     */
+    std::vector<FileRecord> ReadFileRecords(uint64_t* archive_end = nullptr) const;
+
     std::string archive_path_;
-    std::vector<std::string> file_paths_;
+    std::vector<ArchivedFile> files_;
+    EncodingOptions options_;
 };
@@ -0,0 +1,30 @@
+#include "canonicalcode.h"
+
+CanonicalCode BuildCanonicalCode(std::span<const uint8_t> code_lengths)
+{
+    CanonicalCode code;
+    size_t max_length = code_lengths.empty()
+        ? 0
+        : *std::max_element(code_lengths.begin(), code_lengths.end());
+    if (max_length > MAX_CANONICAL_CODE_LENGTH)
+    {
+        throw std::invalid_argument("The code is longer than 64 bits");
+    }
+
+    size_t symbols_count = std::count_if(
+        code_lengths.begin(), code_lengths.end(), [](uint8_t length) { return length != 0; });
+    code.symbols.resize(symbols_count);
+    code.length_counts.resize(max_length + 1);
+    std::vector<uint64_t> reversed_codes(code_lengths.size());
+    AssignCanonicalCodes(code_lengths,
+                         std::span(reversed_codes),
+                         std::span(code.symbols),
+                         std::span(code.length_counts));
+
+    code.codes.resize(code_lengths.size());
+    for (size_t symbol = 0; symbol < code_lengths.size(); ++symbol)
+    {
+        code.codes[symbol] = { reversed_codes[symbol], code_lengths[symbol] };
+    }
+    return code;
+}
@@ -0,0 +1,370 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/*
+ * Bits a decoding table looks up at once, the longer codes are decoded one bit at a time.
+ */
+constexpr size_t DECODING_TABLE_BITS = 10;
+
+/*
+ * Table decoding the codes up to its number of bits with one lookup of the next bits of the
+ * input, first bit in the LSB: the entry of a code is repeated for every value of the bits after
+ * it. An entry holds the symbol in its low 16 bits and the code length above them, or zero if
+ * the bits start a longer code or none.
+ */
+struct DecodingTable
+{
+    size_t bits = 0;
+    std::vector<uint32_t> entries;
+};
+
+/*
+ * Canonical Huffman code derived from the code lengths with integers only, as deflate does: the
+ * symbols are sorted by their code lengths, then by their values, the first code of each length
+ * follows from the number of shorter codes, and the codes of one length are consecutive.
+ */
+struct CanonicalCode
+{
+    std::vector<uint16_t> symbols; // the symbols with a code in the canonical order
+    std::vector<size_t> length_counts; // the number of codes of each length up to the longest,
+                                       // indexed by the length
+    std::vector<std::pair<uint64_t, size_t>> codes; // the code with its first bit in the LSB and
+                                                    // the length of each symbol, zero if none
+    DecodingTable decoding_table; // built by the decoder only, see BuildDecodingTable
+};
+
+/*
+ * Longest code a canonical code may have.
+ */
+constexpr size_t MAX_CANONICAL_CODE_LENGTH = 64;
+
+/*
+ * Work arrays of BuildCodeLengths for an alphabet of up to MaxSymbols symbols, kept by the caller
+ * so that building the lengths allocates nothing.
+ */
+template <size_t MaxSymbols>
+struct CodeLengthWorkspace
+{
+    std::array<uint16_t, MaxSymbols> symbols {}; // the counted symbols from the lightest one
+    std::array<uint64_t, 2 * MaxSymbols> weights {}; // the leaves, then the merged nodes
+    std::array<uint32_t, 2 * MaxSymbols> nodes {}; // the parent of each node, then its depth
+    std::array<uint32_t, MaxSymbols> length_counts {}; // the number of leaves at each depth
+};
+
+/*
+ * Build the length-limited Huffman code lengths of the counted symbols with integers only, at
+ * compile time as well. The symbols are sorted by their counts, hence the leaves are sorted and
+ * so are the merged nodes, and the two lightest nodes are at the fronts of these two queues. The
+ * codes longer than the limit are shortened by moving two of the longest leaves up, one of them
+ * splitting a shorter leaf, and the lengths are handed out from the most frequent symbol on.
+ * @param counts The count of each symbol, the symbols without a count get no code.
+ * @param max_code_length The code length limit, raised to the bits the number of symbols needs.
+ * @param code_lengths The code length of each symbol, as long as the counts.
+ * @param workspace The work arrays, see CodeLengthWorkspace, large enough for the counts.
+ * @return The longest code length, 1 for a single symbol and 0 for none.
+ */
+template <typename Workspace>
+constexpr size_t BuildCodeLengths(std::span<const uint64_t> counts,
+                                  size_t max_code_length,
+                                  std::span<uint8_t> code_lengths,
+                                  Workspace& workspace)
+{
+    auto& symbols = workspace.symbols;
+    auto& weights = workspace.weights;
+    auto& nodes = workspace.nodes;
+    auto& length_counts = workspace.length_counts;
+    if (counts.size() > symbols.size() || code_lengths.size() < counts.size())
+    {
+        throw std::invalid_argument("The code length workspace is too small for the alphabet");
+    }
+
+    size_t symbols_count = 0;
+    for (size_t symbol = 0; symbol < counts.size(); ++symbol)
+    {
+        code_lengths[symbol] = 0;
+        if (counts[symbol] > 0)
+        {
+            symbols[symbols_count++] = static_cast<uint16_t>(symbol);
+        }
+    }
+    if (symbols_count < 2)
+    {
+        if (symbols_count == 1)
+        {
+            code_lengths[symbols[0]] = 1;
+        }
+        return symbols_count;
+    }
+
+    // Merge the two lightest nodes, a leaf goes first among equal weights
+    std::sort(symbols.begin(),
+              symbols.begin() + static_cast<std::ptrdiff_t>(symbols_count),
+              [&](uint16_t lhs, uint16_t rhs)
+              { return std::pair(counts[lhs], lhs) < std::pair(counts[rhs], rhs); });
+    for (size_t i = 0; i < symbols_count; ++i)
+    {
+        weights[i] = counts[symbols[i]];
+    }
+
+    size_t next_leaf = 0;
+    size_t next_merged = symbols_count;
+    size_t nodes_count = symbols_count;
+    auto take_lightest = [&]
+    {
+        bool has_merged = next_merged < nodes_count;
+        if (next_leaf < symbols_count
+            && (!has_merged || weights[next_leaf] <= weights[next_merged]))
+        {
+            return next_leaf++;
+        }
+        return next_merged++;
+    };
+    while (nodes_count < 2 * symbols_count - 1)
+    {
+        size_t left = take_lightest();
+        size_t right = take_lightest();
+        weights[nodes_count] = weights[left] + weights[right];
+        nodes[left] = static_cast<uint32_t>(nodes_count);
+        nodes[right] = static_cast<uint32_t>(nodes_count);
+        ++nodes_count;
+    }
+
+    // A parent is merged after its children, so its depth replaces its parent before theirs do
+    nodes[nodes_count - 1] = 0;
+    for (size_t node = nodes_count - 1; node-- > 0;)
+    {
+        nodes[node] = nodes[nodes[node]] + 1;
+    }
+
+    std::fill_n(length_counts.begin(), symbols_count, 0);
+    size_t max_depth = 0;
+    for (size_t i = 0; i < symbols_count; ++i)
+    {
+        ++length_counts[nodes[i]];
+        max_depth = std::max<size_t>(max_depth, nodes[i]);
+    }
+
+    // Take two codes of the longest length: their parent becomes a code one bit shorter, while
+    // one of them takes the place of a shorter code, which is split into itself and the other one
+    size_t length_limit = std::max<size_t>(max_code_length, std::bit_width(symbols_count - 1));
+    for (size_t length = max_depth; length > length_limit; --length)
+    {
+        while (length_counts[length] > 0)
+        {
+            size_t shorter_length = length - 2;
+            while (length_counts[shorter_length] == 0)
+            {
+                --shorter_length;
+            }
+
+            length_counts[length] -= 2;
+            ++length_counts[length - 1];
+            length_counts[shorter_length + 1] += 2;
+            --length_counts[shorter_length];
+        }
+    }
+
+    // The most frequent symbols keep the shortest codes
+    size_t length = 1;
+    for (size_t i = symbols_count; i-- > 0;)
+    {
+        while (length_counts[length] == 0)
+        {
+            ++length;
+        }
+        --length_counts[length];
+        code_lengths[symbols[i]] = static_cast<uint8_t>(length);
+    }
+    return length;
+}
+
+/*
+ * Assign the canonical codes of the code lengths into the arrays of the caller, at compile time
+ * as well.
+ * @param code_lengths The code length of each symbol, zero for the symbols without a code.
+ * @param reversed_codes The code of each symbol with its first bit in the LSB, as long as the
+ * code lengths, or empty if only the decoding tables are needed.
+ * @param symbols The symbols with a code in the canonical order, at least as many as the codes.
+ * @param length_counts The number of codes of each length, indexed by the length, longer than
+ * the longest code.
+ * @return The number of symbols with a code.
+ */
+template <typename Code, typename Count>
+constexpr size_t AssignCanonicalCodes(std::span<const uint8_t> code_lengths,
+                                      std::span<Code> reversed_codes,
+                                      std::span<uint16_t> symbols,
+                                      std::span<Count> length_counts)
+{
+    // Count the codes of each length, bl_count of deflate
+    std::fill(length_counts.begin(), length_counts.end(), Count { 0 });
+    for (auto length : code_lengths)
+    {
+        if (length >= length_counts.size() || length > MAX_CANONICAL_CODE_LENGTH)
+        {
+            throw std::invalid_argument("The code is longer than its canonical code allows");
+        }
+        if (length != 0)
+        {
+            ++length_counts[length];
+        }
+    }
+
+    // The first code and the first place in the symbols of each length, next_code of deflate
+    std::array<uint64_t, MAX_CANONICAL_CODE_LENGTH + 1> next_codes {};
+    std::array<size_t, MAX_CANONICAL_CODE_LENGTH + 1> next_indices {};
+    uint64_t next_code = 0;
+    size_t symbols_count = 0;
+    size_t lengths_count = std::min(length_counts.size(), MAX_CANONICAL_CODE_LENGTH + 1);
+    for (size_t length = 1; length < lengths_count; ++length)
+    {
+        next_codes[length] = next_code;
+        next_indices[length] = symbols_count;
+        next_code = (next_code + length_counts[length]) << 1;
+        symbols_count += length_counts[length];
+    }
+    if (symbols_count > symbols.size())
+    {
+        throw std::invalid_argument("The canonical code has more codes than symbols");
+    }
+
+    // Hand out the codes in the order of the symbols, which also sorts them by their lengths
+    for (size_t symbol = 0; symbol < code_lengths.size(); ++symbol)
+    {
+        size_t length = code_lengths[symbol];
+        if (length == 0)
+        {
+            continue;
+        }
+
+        symbols[next_indices[length]++] = static_cast<uint16_t>(symbol);
+        if (!reversed_codes.empty())
+        {
+            uint64_t canonical_code = next_codes[length]++;
+            uint64_t reversed_code = 0;
+            for (size_t i = 0; i < length; ++i)
+            {
+                reversed_code |= ((canonical_code >> i) & 1) << (length - 1 - i);
+            }
+            reversed_codes[symbol] = static_cast<Code>(reversed_code);
+        }
+    }
+    return symbols_count;
+}
+
+/*
+ * Decode a symbol of a canonical code one bit at a time: the codes of a length follow each
+ * other, so one comparison per length finds the symbol.
+ * @param symbols The symbols in the canonical order.
+ * @param length_counts The number of codes of each length, indexed by the length.
+ * @param read_bit The function reading the next bit.
+ * @return The symbol, or std::nullopt if the bits read are no code of the table.
+ */
+template <typename Count, typename ReadBit>
+constexpr std::optional<uint16_t> DecodeCanonicalSymbol(std::span<const uint16_t> symbols,
+                                                        std::span<const Count> length_counts,
+                                                        ReadBit&& read_bit)
+{
+    uint64_t code = 0;
+    uint64_t first_code = 0;
+    size_t first_index = 0;
+    for (size_t length = 1; length < length_counts.size(); ++length)
+    {
+        code = (code << 1) | static_cast<uint64_t>(read_bit());
+        uint64_t count = length_counts[length];
+        if (code - first_code < count)
+        {
+            return symbols[first_index + (code - first_code)];
+        }
+        first_index += count;
+        first_code = (first_code + count) << 1;
+    }
+    return std::nullopt;
+}
+
+/*
+ * Build the decoding table of a canonical code, over the bits of its longest code up to a limit.
+ * @param symbols The symbols in the canonical order.
+ * @param length_counts The number of codes of each length, indexed by the length.
+ * @param max_bits The limit of the bits looked up.
+ * @return The decoding table.
+ */
+template <typename Count>
+DecodingTable BuildDecodingTable(std::span<const uint16_t> symbols,
+                                 std::span<const Count> length_counts,
+                                 size_t max_bits = DECODING_TABLE_BITS)
+{
+    DecodingTable table;
+    table.bits = std::min(max_bits, length_counts.empty() ? 0 : length_counts.size() - 1);
+    table.entries.resize(size_t { 1 } << table.bits);
+
+    // Walk the codes in the canonical order, only complete codes go to the table so that it
+    // agrees with DecodeCanonicalSymbol on corrupted lengths as well
+    uint64_t code = 0;
+    size_t index = 0;
+    for (size_t length = 1; length <= table.bits; ++length)
+    {
+        for (size_t i = 0; i < length_counts[length] && index < symbols.size(); ++i, ++code)
+        {
+            uint16_t symbol = symbols[index++];
+            if (code >> length != 0)
+            {
+                continue;
+            }
+
+            uint64_t reversed_code = 0;
+            for (size_t bit = 0; bit < length; ++bit)
+            {
+                reversed_code |= ((code >> bit) & 1) << (length - 1 - bit);
+            }
+            uint32_t entry = symbol | static_cast<uint32_t>(length) << 16;
+            for (size_t next_bits = reversed_code; next_bits < table.entries.size();
+                 next_bits += size_t { 1 } << length)
+            {
+                table.entries[next_bits] = entry;
+            }
+        }
+        code <<= 1;
+    }
+    return table;
+}
+
+/*
+ * Decode a symbol with one lookup in a decoding table, a code longer than the table is decoded
+ * one bit at a time from its first bit.
+ * @param table The decoding table of the code.
+ * @param symbols The symbols in the canonical order.
+ * @param length_counts The number of codes of each length, indexed by the length.
+ * @param reader The reader of the bits, with PeekBits, SkipBits and ReadBit.
+ * @return The symbol, or std::nullopt if the bits read are no code of the table.
+ */
+template <typename Count, typename BitReader>
+std::optional<uint16_t> DecodeTableSymbol(const DecodingTable& table,
+                                          std::span<const uint16_t> symbols,
+                                          std::span<const Count> length_counts,
+                                          BitReader& reader)
+{
+    uint32_t entry = table.entries[reader.PeekBits(table.bits)];
+    if (entry != 0)
+    {
+        reader.SkipBits(entry >> 16);
+        return static_cast<uint16_t>(entry);
+    }
+    return DecodeCanonicalSymbol(symbols, length_counts, [&reader] { return reader.ReadBit(); });
+}
+
+/*
+ * Build the canonical code of the code lengths.
+ * @param code_lengths The code length of each symbol, zero for the symbols without a code.
+ * @return The canonical code, the codes are indexed as the lengths.
+ */
+CanonicalCode BuildCanonicalCode(std::span<const uint8_t> code_lengths);
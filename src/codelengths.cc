@@ -0,0 +1,134 @@
+#include "codelengths.h"
+
+#include "canonicalcode.h"
+
+#include <algorithm>
+
+size_t TokenizeCodeLengths(std::span<const uint8_t> code_lengths,
+                           std::span<CodeLengthToken> tokens)
+{
+    size_t tokens_count = 0;
+    auto add_token = [&](uint16_t symbol, size_t extra)
+    { tokens[tokens_count++] = { .symbol = symbol, .extra = static_cast<uint8_t>(extra) }; };
+
+    for (size_t i = 0; i < code_lengths.size();)
+    {
+        uint8_t length = code_lengths[i];
+        if (length > MAX_HEADER_CODE_LENGTH)
+        {
+            throw std::invalid_argument("The code is too long for a table header");
+        }
+
+        size_t run_length = 1;
+        while (i + run_length < code_lengths.size() && code_lengths[i + run_length] == length)
+        {
+            ++run_length;
+        }
+        i += run_length;
+
+        // A code length is written once and then repeated, zeros are repeated from the start
+        if (length != 0)
+        {
+            add_token(length, 0);
+            --run_length;
+        }
+        while (run_length >= 3)
+        {
+            if (length != 0)
+            {
+                size_t repeats = std::min<size_t>(run_length, 6);
+                add_token(REPEAT_PREVIOUS_LENGTH, repeats - 3);
+                run_length -= repeats;
+            }
+            else if (run_length >= 11)
+            {
+                size_t repeats = std::min<size_t>(run_length, 138);
+                add_token(REPEAT_ZERO_LONG, repeats - 11);
+                run_length -= repeats;
+            }
+            else
+            {
+                add_token(REPEAT_ZERO_SHORT, run_length - 3);
+                run_length = 0;
+            }
+        }
+        for (; run_length > 0; --run_length)
+        {
+            add_token(length, 0);
+        }
+    }
+    return tokens_count;
+}
+
+CodeLengthCode BuildCodeLengthCode(std::span<const uint8_t> code_lengths,
+                                   std::span<const CodeLengthToken> tokens)
+{
+    CodeLengthCode code;
+    for (auto length : code_lengths)
+    {
+        code.max_length = std::max<size_t>(code.max_length, length);
+    }
+
+    std::array<uint64_t, CODE_LENGTH_SYMBOLS_COUNT> counts {};
+    for (const auto& token : tokens)
+    {
+        ++counts[token.symbol];
+    }
+
+    CodeLengthWorkspace<CODE_LENGTH_SYMBOLS_COUNT> workspace;
+    BuildCodeLengths(counts, MAX_CODE_LENGTH_CODE_LENGTH, code.lengths, workspace);
+
+    std::array<uint16_t, CODE_LENGTH_SYMBOLS_COUNT> symbols {};
+    std::array<uint16_t, MAX_CODE_LENGTH_CODE_LENGTH + 1> length_counts {};
+    AssignCanonicalCodes(std::span<const uint8_t>(code.lengths),
+                         std::span<uint8_t>(code.reversed_codes),
+                         std::span<uint16_t>(symbols),
+                         std::span<uint16_t>(length_counts));
+
+    for (size_t i = 0; i < code.max_length + 4; ++i)
+    {
+        if (code.lengths[GetListedCodeLengthSymbol(i, code.max_length)] != 0)
+        {
+            code.listed_count = i + 1;
+        }
+    }
+    return code;
+}
+
+uint64_t CountCodeLengthsBits(const CodeLengthCode& code,
+                              std::span<const CodeLengthToken> tokens,
+                              size_t symbol_bits)
+{
+    uint64_t bits = symbol_bits + 6 + 7 + 3 * code.listed_count;
+    for (const auto& token : tokens)
+    {
+        bits += code.lengths[token.symbol] + GetCodeLengthExtraBits(token.symbol);
+    }
+    return bits;
+}
+
+CodeLengthDecoder BuildCodeLengthDecoder(const CodeLengthCode& code)
+{
+    CodeLengthDecoder decoder;
+    size_t symbols_count = AssignCanonicalCodes(std::span<const uint8_t>(code.lengths),
+                                                std::span<uint8_t>(),
+                                                std::span<uint16_t>(decoder.symbols),
+                                                std::span<uint16_t>(decoder.length_counts));
+
+    // The codes of a length may not run out of the values of the length
+    uint64_t available_codes = 1;
+    for (size_t length = 1; length <= MAX_CODE_LENGTH_CODE_LENGTH; ++length)
+    {
+        available_codes = 2 * available_codes;
+        if (decoder.length_counts[length] > available_codes)
+        {
+            throw std::runtime_error("The code-length code of the table header is corrupted");
+        }
+        available_codes -= decoder.length_counts[length];
+    }
+    if (symbols_count == 0)
+    {
+        throw std::runtime_error("The code-length code of the table header is empty");
+    }
+    return decoder;
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include "canonicalcode.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+
+/*
+ * Compact code table headers. A table is described by the code length of every symbol up to the
+ * largest one, zero for the symbols without a code, and the lengths are coded as in deflate: runs
+ * of equal lengths become repeat symbols, and the lengths and the repeats are coded with a
+ * Huffman code of their own, the code-length code, whose 3-bit code lengths go first.
+ */
+
+/*
+ * Longest code a table header describes.
+ */
+constexpr size_t MAX_HEADER_CODE_LENGTH = 63;
+
+/*
+ * Symbols of the code-length code after the code lengths from 0 to MAX_HEADER_CODE_LENGTH.
+ */
+constexpr uint16_t REPEAT_PREVIOUS_LENGTH = 64; // 3 to 6 more of the previous length, 2 extra bits
+constexpr uint16_t REPEAT_ZERO_SHORT = 65; // 3 to 10 zero lengths, 3 extra bits
+constexpr uint16_t REPEAT_ZERO_LONG = 66; // 11 to 138 zero lengths, 7 extra bits
+constexpr size_t CODE_LENGTH_SYMBOLS_COUNT = 67;
+
+/*
+ * Longest code of the code-length code, so that its lengths fit 3 bits.
+ */
+constexpr size_t MAX_CODE_LENGTH_CODE_LENGTH = 7;
+
+/*
+ * A symbol of the code-length code and the value of its extra bits.
+ */
+struct CodeLengthToken
+{
+    uint16_t symbol;
+    uint8_t extra;
+};
+
+/*
+ * The code-length code of a table header.
+ */
+struct CodeLengthCode
+{
+    size_t max_length = 0; // the longest code length of the table
+    size_t listed_count = 0; // the code lengths of the code-length code written in the header
+    std::array<uint8_t, CODE_LENGTH_SYMBOLS_COUNT> lengths {};
+    std::array<uint8_t, CODE_LENGTH_SYMBOLS_COUNT> reversed_codes {}; // the first bit in the LSB
+};
+
+/*
+ * Get the symbol whose code length goes at the given place of the header: the repeats, the zero
+ * length, then the code lengths from the longest one down, so that the rarely used short ones
+ * are left out at the end.
+ * @param index The place in the header.
+ * @param max_length The longest code length of the table.
+ * @return The symbol of the code-length code.
+ */
+constexpr uint16_t GetListedCodeLengthSymbol(size_t index, size_t max_length)
+{
+    constexpr std::array<uint16_t, 4> first_symbols
+        = { REPEAT_PREVIOUS_LENGTH, REPEAT_ZERO_SHORT, REPEAT_ZERO_LONG, 0 };
+    return index < first_symbols.size() ? first_symbols[index]
+                                        : static_cast<uint16_t>(max_length + 4 - index);
+}
+
+/*
+ * Get the number of extra bits following a symbol of the code-length code.
+ * @param symbol The symbol.
+ * @return The number of bits.
+ */
+constexpr size_t GetCodeLengthExtraBits(uint16_t symbol)
+{
+    switch (symbol)
+    {
+    case REPEAT_PREVIOUS_LENGTH:
+        return 2;
+    case REPEAT_ZERO_SHORT:
+        return 3;
+    case REPEAT_ZERO_LONG:
+        return 7;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Turn the code lengths into the symbols of the code-length code.
+ * @param code_lengths The code length of each symbol, up to MAX_HEADER_CODE_LENGTH.
+ * @param tokens The buffer for the tokens, at least as large as the code lengths.
+ * @return The number of tokens.
+ */
+size_t TokenizeCodeLengths(std::span<const uint8_t> code_lengths,
+                           std::span<CodeLengthToken> tokens);
+
+/*
+ * Build the code-length code of the tokens.
+ * @param code_lengths The code lengths the tokens describe.
+ * @param tokens The tokens.
+ * @return The code-length code.
+ */
+CodeLengthCode BuildCodeLengthCode(std::span<const uint8_t> code_lengths,
+                                   std::span<const CodeLengthToken> tokens);
+
+/*
+ * Count the bits of a table header.
+ * @param code The code-length code.
+ * @param tokens The tokens.
+ * @param symbol_bits The width of the number of code lengths.
+ * @return The number of bits.
+ */
+uint64_t CountCodeLengthsBits(const CodeLengthCode& code,
+                              std::span<const CodeLengthToken> tokens,
+                              size_t symbol_bits);
+
+/*
+ * Code-length code arranged for canonical decoding.
+ */
+struct CodeLengthDecoder
+{
+    std::array<uint16_t, CODE_LENGTH_SYMBOLS_COUNT> symbols {}; // in the canonical order
+    std::array<uint16_t, MAX_CODE_LENGTH_CODE_LENGTH + 1> length_counts {};
+};
+
+/*
+ * Arrange the code-length code for decoding.
+ * @param code The code-length code, only its lengths are used.
+ * @return The decoder.
+ */
+CodeLengthDecoder BuildCodeLengthDecoder(const CodeLengthCode& code);
+
+/*
+ * Write a table header.
+ * @param code The code-length code.
+ * @param tokens The tokens.
+ * @param lengths_count The number of code lengths the tokens describe.
+ * @param symbol_bits The width of the number of code lengths.
+ * @param write_bits The function writing the lowest bits of a number, from the lowest one.
+ */
+template <typename WriteBits>
+void WriteCodeLengths(const CodeLengthCode& code,
+                      std::span<const CodeLengthToken> tokens,
+                      size_t lengths_count,
+                      size_t symbol_bits,
+                      WriteBits&& write_bits)
+{
+    write_bits(lengths_count - 1, symbol_bits);
+    write_bits(code.max_length, 6);
+    write_bits(code.listed_count, 7);
+    for (size_t i = 0; i < code.listed_count; ++i)
+    {
+        write_bits(code.lengths[GetListedCodeLengthSymbol(i, code.max_length)], 3);
+    }
+
+    for (const auto& token : tokens)
+    {
+        write_bits(code.reversed_codes[token.symbol], code.lengths[token.symbol]);
+        write_bits(token.extra, GetCodeLengthExtraBits(token.symbol));
+    }
+}
+
+/*
+ * Read a table header.
+ * @param read_bits The function reading a number of the given width, from the lowest bit.
+ * @param symbol_bits The width of the number of code lengths.
+ * @param code_lengths The buffer for the code lengths, at least 2^symbol_bits long.
+ * @return The number of code lengths read.
+ */
+template <typename ReadBits>
+size_t ReadCodeLengths(ReadBits&& read_bits, size_t symbol_bits, std::span<uint8_t> code_lengths)
+{
+    size_t lengths_count = read_bits(symbol_bits) + 1;
+    CodeLengthCode code;
+    code.max_length = read_bits(6);
+    code.listed_count = read_bits(7);
+    if (lengths_count > code_lengths.size() || code.listed_count > code.max_length + 4)
+    {
+        throw std::runtime_error("The table header is corrupted");
+    }
+    for (size_t i = 0; i < code.listed_count; ++i)
+    {
+        code.lengths[GetListedCodeLengthSymbol(i, code.max_length)] = read_bits(3);
+    }
+    auto decoder = BuildCodeLengthDecoder(code);
+
+    size_t lengths_read = 0;
+    while (lengths_read < lengths_count)
+    {
+        auto symbol = DecodeCanonicalSymbol(std::span<const uint16_t>(decoder.symbols),
+                                            std::span<const uint16_t>(decoder.length_counts),
+                                            [&read_bits] { return read_bits(1); });
+        if (!symbol)
+        {
+            throw std::runtime_error("The table header has a code missing from its code");
+        }
+
+        size_t extra = read_bits(GetCodeLengthExtraBits(*symbol));
+        size_t run_length = 1;
+        uint8_t run_value = 0;
+        switch (*symbol)
+        {
+        case REPEAT_PREVIOUS_LENGTH:
+            if (lengths_read == 0 || code_lengths[lengths_read - 1] == 0)
+            {
+                throw std::runtime_error("The table header repeats a missing code length");
+            }
+            run_length = extra + 3;
+            run_value = code_lengths[lengths_read - 1];
+            break;
+        case REPEAT_ZERO_SHORT:
+            run_length = extra + 3;
+            break;
+        case REPEAT_ZERO_LONG:
+            run_length = extra + 11;
+            break;
+        default:
+            if (*symbol > code.max_length)
+            {
+                throw std::runtime_error("The table header has a code length over its limit");
+            }
+            run_value = static_cast<uint8_t>(*symbol);
+        }
+
+        if (run_length > lengths_count - lengths_read)
+        {
+            throw std::runtime_error("The table header has too many code lengths");
+        }
+        std::fill_n(code_lengths.begin() + lengths_read, run_length, run_value);
+        lengths_read += run_length;
+    }
+    return lengths_count;
+}
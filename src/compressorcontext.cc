@@ -0,0 +1,331 @@
+#include "compressorcontext.h"
+
+#include "canonicalcode.h"
+#include "huffman.h"
+#include "statictables.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+/*
+ * Bit packing in the order of FileWriter into a byte vector.
+ */
+class BitPacker
+{
+public:
+    explicit BitPacker(std::vector<unsigned char>& output) : output_(output) { }
+
+    /*
+     * Write the lowest bits of a number, from the lowest one.
+     * @param number The number to write.
+     * @param num_bits The number of bits to write, up to 32.
+     */
+    void Write(uint64_t number, size_t num_bits)
+    {
+        buffer_ |= number << bit_count_;
+        bit_count_ += num_bits;
+        while (bit_count_ >= 8)
+        {
+            output_.push_back(static_cast<unsigned char>(buffer_ & UINT8_MAX));
+            buffer_ >>= 8;
+            bit_count_ -= 8;
+        }
+    }
+
+    /*
+     * Pad the last byte with zero bits.
+     */
+    void Flush()
+    {
+        if (bit_count_ > 0)
+        {
+            output_.push_back(static_cast<unsigned char>(buffer_ & UINT8_MAX));
+            buffer_ = 0;
+            bit_count_ = 0;
+        }
+    }
+
+private:
+    std::vector<unsigned char>& output_;
+    uint64_t buffer_ { 0 };
+    size_t bit_count_ { 0 };
+};
+
+/*
+ * Bit unpacking in the order of FileReader from a byte span.
+ */
+class BitUnpacker
+{
+public:
+    explicit BitUnpacker(std::span<const unsigned char> input) : input_(input) { }
+
+    bool ReadBit()
+    {
+        if (byte_pos_ >= input_.size())
+        {
+            throw std::runtime_error("The record is truncated");
+        }
+
+        bool bit = input_[byte_pos_] & (1 << bit_pos_);
+        if (++bit_pos_ == 8)
+        {
+            bit_pos_ = 0;
+            ++byte_pos_;
+        }
+        return bit;
+    }
+
+    uint64_t Read(size_t num_bits)
+    {
+        uint64_t number = 0;
+        for (size_t i = 0; i < num_bits; ++i)
+        {
+            number |= static_cast<uint64_t>(ReadBit()) << i;
+        }
+        return number;
+    }
+
+    /*
+     * Get the number of bits left to read.
+     * @return The number of bits.
+     */
+    uint64_t GetBitsLeft() const
+    {
+        return (input_.size() - byte_pos_) * 8 - bit_pos_;
+    }
+
+    /*
+     * Get the number of bytes read, the current byte included.
+     * @return The number of bytes.
+     */
+    size_t GetBytesRead() const
+    {
+        return byte_pos_ + (bit_pos_ > 0);
+    }
+
+private:
+    std::span<const unsigned char> input_;
+    size_t byte_pos_ { 0 };
+    uint8_t bit_pos_ { 0 };
+};
+}
+
+CompressorContext::CompressorContext(size_t max_code_length) : max_code_length_(max_code_length)
+{
+    if (max_code_length < 9 || max_code_length > 32)
+    {
+        throw std::invalid_argument("The code length limit should be from 9 to 32 bits");
+    }
+}
+
+void CompressorContext::CompressBatch(std::span<const std::span<const unsigned char>> buffers,
+                                      std::vector<unsigned char>& output,
+                                      std::vector<size_t>& record_ends)
+{
+    output.clear();
+    record_ends.clear();
+    for (const auto& buffer : buffers)
+    {
+        Compress(buffer, output);
+        record_ends.push_back(output.size());
+    }
+}
+
+void CompressorContext::Compress(std::span<const unsigned char> buffer,
+                                 std::vector<unsigned char>& output)
+{
+    if (buffer.size() > UINT32_MAX)
+    {
+        throw std::invalid_argument("The buffer is too large for a record");
+    }
+
+    counts_.fill(0);
+    for (auto character : buffer)
+    {
+        ++counts_[character];
+    }
+    counts_[FILENAME_END] = 1;
+
+    size_t symbols_count = 0;
+    for (uint16_t symbol = 0; symbol < SYMBOLS_COUNT; ++symbol)
+    {
+        if (counts_[symbol] > 0)
+        {
+            symbols_[symbols_count++] = symbol;
+        }
+    }
+
+    // Keep the table only if it codes into fewer bits than storing the buffer
+    uint64_t stored_bits = 9 + 32 + 8 * buffer.size() + 9;
+    uint64_t coded_bits = UINT64_MAX;
+    size_t tokens_count = 0;
+    CodeLengthCode code_length_code;
+    if (symbols_count > 1)
+    {
+        BuildCodes();
+        tokens_count = TokenizeCodeLengths(code_lengths_, header_tokens_);
+        auto tokens = std::span(header_tokens_).first(tokens_count);
+        code_length_code = BuildCodeLengthCode(code_lengths_, tokens);
+
+        coded_bits = 9 + CountCodeLengthsBits(code_length_code, tokens, 9);
+        for (size_t i = 0; i < symbols_count; ++i)
+        {
+            coded_bits += counts_[symbols_[i]] * code_lengths_[symbols_[i]];
+        }
+    }
+
+    // A built-in table has no header, which often wins on short buffers
+    uint64_t static_bits = UINT64_MAX;
+    size_t static_table_index = 0;
+    for (size_t table_index = 0; table_index < GetStaticTablesCount(); ++table_index)
+    {
+        const auto& table = GetStaticTable(table_index);
+        uint64_t bits = 9 + 8;
+        for (size_t i = 0; i < symbols_count; ++i)
+        {
+            bits += counts_[symbols_[i]] * table.code_lengths[symbols_[i]];
+        }
+        if (bits < static_bits)
+        {
+            static_bits = bits;
+            static_table_index = table_index;
+        }
+    }
+
+    BitPacker packer(output);
+    if (static_bits < std::min(coded_bits, stored_bits))
+    {
+        packer.Write(static_cast<uint16_t>(BlockType::Static), 9);
+        packer.Write(static_table_index, 8);
+        const auto& table = GetStaticTable(static_table_index);
+        for (auto character : buffer)
+        {
+            packer.Write(table.reversed_codes[character], table.code_lengths[character]);
+        }
+        packer.Write(table.reversed_codes[FILENAME_END], table.code_lengths[FILENAME_END]);
+    }
+    else if (coded_bits < stored_bits)
+    {
+        packer.Write(static_cast<uint16_t>(BlockType::Huffman), 9);
+        WriteCodeLengths(code_length_code,
+                         std::span(header_tokens_).first(tokens_count),
+                         SYMBOLS_COUNT,
+                         9,
+                         [&packer](uint64_t number, size_t num_bits)
+                         { packer.Write(number, num_bits); });
+
+        for (auto character : buffer)
+        {
+            packer.Write(reversed_codes_[character], code_lengths_[character]);
+        }
+        packer.Write(reversed_codes_[FILENAME_END], code_lengths_[FILENAME_END]);
+    }
+    else
+    {
+        packer.Write(static_cast<uint16_t>(BlockType::Stored), 9);
+        packer.Write(buffer.size(), 32);
+        for (auto character : buffer)
+        {
+            packer.Write(character, 8);
+        }
+        packer.Write(FILENAME_END, 9);
+    }
+    packer.Flush();
+}
+
+size_t CompressorContext::Decompress(std::span<const unsigned char> record,
+                                     std::vector<unsigned char>& output)
+{
+    BitUnpacker unpacker(record);
+
+    auto block_type = static_cast<BlockType>(unpacker.Read(9));
+    if (block_type == BlockType::Stored)
+    {
+        uint64_t size = unpacker.Read(32);
+        if (size * 8 + 9 > unpacker.GetBitsLeft())
+        {
+            throw std::runtime_error("The record is truncated");
+        }
+        for (uint64_t i = 0; i < size; ++i)
+        {
+            output.push_back(static_cast<unsigned char>(unpacker.Read(8)));
+        }
+        if (unpacker.Read(9) != FILENAME_END)
+        {
+            throw std::runtime_error("The stored record does not end with FILENAME_END");
+        }
+        return unpacker.GetBytesRead();
+    }
+    if (block_type == BlockType::Static)
+    {
+        const auto& table = GetStaticTable(unpacker.Read(8));
+        while (true)
+        {
+            uint16_t symbol = DecodeStaticSymbol(table, [&unpacker] { return unpacker.ReadBit(); });
+            if (symbol == FILENAME_END)
+            {
+                return unpacker.GetBytesRead();
+            }
+            if (symbol > UINT8_MAX)
+            {
+                throw std::runtime_error("The record has an unexpected symbol");
+            }
+            output.push_back(static_cast<unsigned char>(symbol));
+        }
+    }
+    if (block_type != BlockType::Huffman)
+    {
+        throw std::runtime_error("The record is neither a Huffman, a static nor a stored block");
+    }
+
+    // Read the table as HuffmanCoder::RestoreTable does, the symbols of a length keep their order
+    size_t lengths_count = ReadCodeLengths([&unpacker](size_t num_bits)
+                                           { return unpacker.Read(num_bits); },
+                                           9,
+                                           decoded_lengths_);
+    auto lengths = std::span<const uint8_t>(decoded_lengths_).first(lengths_count);
+    if (std::all_of(lengths.begin(), lengths.end(), [](uint8_t length) { return length == 0; }))
+    {
+        throw std::runtime_error("The table of the record is empty");
+    }
+    size_t max_length = *std::max_element(lengths.begin(), lengths.end());
+    AssignCanonicalCodes(lengths,
+                         std::span<uint64_t>(),
+                         std::span<uint16_t>(decoded_symbols_),
+                         std::span<uint64_t>(decoded_length_counts_).first(max_length + 1));
+    auto symbols = std::span<const uint16_t>(decoded_symbols_);
+    auto length_counts = std::span<const uint64_t>(decoded_length_counts_).first(max_length + 1);
+
+    // Decode the canonical codes one bit at a time
+    while (true)
+    {
+        auto decoded_symbol = DecodeCanonicalSymbol(
+            symbols, length_counts, [&unpacker] { return unpacker.ReadBit(); });
+        if (!decoded_symbol)
+        {
+            throw std::runtime_error("The record has a code missing from its table");
+        }
+
+        uint16_t symbol = *decoded_symbol;
+        if (symbol == FILENAME_END)
+        {
+            return unpacker.GetBytesRead();
+        }
+        if (symbol > UINT8_MAX)
+        {
+            throw std::runtime_error("The record has an unexpected symbol");
+        }
+        output.push_back(static_cast<unsigned char>(symbol));
+    }
+}
+
+void CompressorContext::BuildCodes()
+{
+    BuildCodeLengths(counts_, max_code_length_, code_lengths_, code_length_workspace_);
+    AssignCanonicalCodes(std::span<const uint8_t>(code_lengths_),
+                         std::span<uint32_t>(reversed_codes_),
+                         std::span<uint16_t>(canonical_symbols_),
+                         std::span<uint16_t>(length_counts_));
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "canonicalcode.h"
+#include "codelengths.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/*
+ * A reusable context for compressing many small buffers. Every buffer becomes a record of its
+ * own: a Huffman block with its own table, a block coded with a built-in table, or a stored
+ * block, whichever is the smallest, ended with FILENAME_END and padded to a byte boundary. The
+ * blocks have the layout of the blocks of an archive, so that a record can also be read with
+ * HuffmanCoder.
+ *
+ * The context keeps the histogram, the tree, the code tables and the decoding tables in fixed
+ * arrays, and the output vectors keep their capacity between the calls, hence compressing the
+ * next batch of similar buffers allocates nothing. A context is not shared between threads,
+ * keep one per thread instead.
+ */
+class CompressorContext
+{
+public:
+    /*
+     * Constructor.
+     * @param max_code_length The code length limit from 9 to 32 bits.
+     */
+    explicit CompressorContext(size_t max_code_length = 15);
+
+    /*
+     * Compress the buffers one after another.
+     * @param buffers The buffers to compress.
+     * @param output The records, replaced by the call.
+     * @param record_ends The offset past each record in the output, replaced by the call.
+     */
+    void CompressBatch(std::span<const std::span<const unsigned char>> buffers,
+                       std::vector<unsigned char>& output,
+                       std::vector<size_t>& record_ends);
+
+    /*
+     * Compress a buffer to the end of the output.
+     * @param buffer The buffer to compress.
+     * @param output The records to append the record to.
+     */
+    void Compress(std::span<const unsigned char> buffer, std::vector<unsigned char>& output);
+
+    /*
+     * Decompress a record.
+     * @param record The record.
+     * @param output The buffer to append the content to.
+     * @return The size of the record in bytes, the next record starts after it.
+     */
+    size_t Decompress(std::span<const unsigned char> record, std::vector<unsigned char>& output);
+
+private:
+    /*
+     * Number of symbols of a record: the 256 characters and FILENAME_END.
+     */
+    static constexpr size_t SYMBOLS_COUNT = 257;
+
+    /*
+     * Number of code lengths a table of a record being decoded may list, one per 9-bit symbol.
+     */
+    static constexpr size_t MAX_TABLE_SYMBOLS_COUNT = 512;
+
+    /*
+     * Longest code a record being decoded may have.
+     */
+    static constexpr size_t MAX_DECODED_CODE_LENGTH = 64;
+
+    /*
+     * Build the length-limited canonical codes of the counted symbols, at least two of them.
+     */
+    void BuildCodes();
+
+    size_t max_code_length_;
+
+    // Encoding scratch
+    std::array<uint64_t, SYMBOLS_COUNT> counts_ {};
+    std::array<uint16_t, SYMBOLS_COUNT> symbols_ {}; // the counted symbols
+    CodeLengthWorkspace<SYMBOLS_COUNT> code_length_workspace_;
+    std::array<uint8_t, SYMBOLS_COUNT> code_lengths_ {};
+    std::array<uint32_t, SYMBOLS_COUNT> reversed_codes_ {}; // the first code bit is the lowest
+    std::array<uint16_t, SYMBOLS_COUNT> canonical_symbols_ {};
+    std::array<uint16_t, MAX_HEADER_CODE_LENGTH + 1> length_counts_ {};
+    std::array<CodeLengthToken, SYMBOLS_COUNT> header_tokens_ {};
+
+    // Decoding scratch
+    std::array<uint8_t, MAX_TABLE_SYMBOLS_COUNT> decoded_lengths_ {};
+    std::array<uint16_t, MAX_TABLE_SYMBOLS_COUNT> decoded_symbols_ {};
+    std::array<uint64_t, MAX_DECODED_CODE_LENGTH + 1> decoded_length_counts_ {};
+};
@@ -0,0 +1,132 @@
+#include "contenthash.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+constexpr uint64_t PRIME_1 = 0x9E3779B185EBCA87;
+constexpr uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4F;
+constexpr uint64_t PRIME_3 = 0x165667B19E3779F9;
+constexpr uint64_t PRIME_4 = 0x85EBCA77C2B2AE63;
+constexpr uint64_t PRIME_5 = 0x27D4EB2F165667C5;
+
+namespace
+{
+uint64_t ReadLittleEndian(const unsigned char* bytes, size_t count)
+{
+    uint64_t number = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        number |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+    }
+    return number;
+}
+
+uint64_t Round(uint64_t accumulator, uint64_t lane)
+{
+    accumulator += lane * PRIME_2;
+    return std::rotl(accumulator, 31) * PRIME_1;
+}
+
+uint64_t MergeRound(uint64_t hash, uint64_t accumulator)
+{
+    hash ^= Round(0, accumulator);
+    return hash * PRIME_1 + PRIME_4;
+}
+}
+
+ContentHasher::ContentHasher(uint64_t seed)
+    : seed_(seed), accumulators_ { seed + PRIME_1 + PRIME_2, seed + PRIME_2, seed, seed - PRIME_1 }
+{
+}
+
+void ContentHasher::Update(std::span<const unsigned char> bytes)
+{
+    total_length_ += bytes.size();
+
+    // Complete the buffered stripe first, then hash the whole stripes in place
+    if (buffered_count_ > 0)
+    {
+        size_t count = std::min(bytes.size(), buffer_.size() - buffered_count_);
+        std::memcpy(buffer_.data() + buffered_count_, bytes.data(), count);
+        buffered_count_ += count;
+        bytes = bytes.subspan(count);
+        if (buffered_count_ < buffer_.size())
+        {
+            return;
+        }
+        ConsumeStripe(buffer_.data());
+        buffered_count_ = 0;
+    }
+
+    while (bytes.size() >= buffer_.size())
+    {
+        ConsumeStripe(bytes.data());
+        bytes = bytes.subspan(buffer_.size());
+    }
+    std::memcpy(buffer_.data(), bytes.data(), bytes.size());
+    buffered_count_ = bytes.size();
+}
+
+void ContentHasher::UpdateNumber(uint64_t number)
+{
+    std::array<unsigned char, 8> bytes {};
+    for (size_t i = 0; i < bytes.size(); ++i, number >>= 8)
+    {
+        bytes[i] = static_cast<unsigned char>(number & UINT8_MAX);
+    }
+    Update(bytes);
+}
+
+uint64_t ContentHasher::GetDigest() const
+{
+    uint64_t hash = 0;
+    if (total_length_ >= buffer_.size())
+    {
+        hash = std::rotl(accumulators_[0], 1) + std::rotl(accumulators_[1], 7)
+            + std::rotl(accumulators_[2], 12) + std::rotl(accumulators_[3], 18);
+        for (auto accumulator : accumulators_)
+        {
+            hash = MergeRound(hash, accumulator);
+        }
+    }
+    else
+    {
+        hash = seed_ + PRIME_5;
+    }
+    hash += total_length_;
+
+    // Mix in the tail of the content by 8, 4 and single bytes
+    size_t position = 0;
+    for (; position + 8 <= buffered_count_; position += 8)
+    {
+        hash ^= Round(0, ReadLittleEndian(buffer_.data() + position, 8));
+        hash = std::rotl(hash, 27) * PRIME_1 + PRIME_4;
+    }
+    if (position + 4 <= buffered_count_)
+    {
+        hash ^= ReadLittleEndian(buffer_.data() + position, 4) * PRIME_1;
+        hash = std::rotl(hash, 23) * PRIME_2 + PRIME_3;
+        position += 4;
+    }
+    for (; position < buffered_count_; ++position)
+    {
+        hash ^= buffer_[position] * PRIME_5;
+        hash = std::rotl(hash, 11) * PRIME_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME_2;
+    hash ^= hash >> 29;
+    hash *= PRIME_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+void ContentHasher::ConsumeStripe(const unsigned char* stripe)
+{
+    for (size_t lane = 0; lane < accumulators_.size(); ++lane)
+    {
+        accumulators_[lane] = Round(accumulators_[lane], ReadLittleEndian(stripe + 8 * lane, 8));
+    }
+}
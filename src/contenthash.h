@@ -0,0 +1,51 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+/*
+ * Streaming 64-bit content hash, the XXH64 function of xxHash. It is fast and spreads the bits
+ * well, but it is not cryptographic: it tells apart changed files, not forged ones.
+ */
+class ContentHasher
+{
+public:
+    /*
+     * Constructor.
+     * @param seed The seed, different seeds give unrelated hashes of the same content.
+     */
+    explicit ContentHasher(uint64_t seed = 0);
+
+    /*
+     * Hash the next bytes of the content.
+     * @param bytes The bytes.
+     */
+    void Update(std::span<const unsigned char> bytes);
+
+    /*
+     * Hash a number as its 8 bytes from the low one.
+     * @param number The number.
+     */
+    void UpdateNumber(uint64_t number);
+
+    /*
+     * Get the hash of the content so far, more bytes may follow.
+     * @return The hash.
+     */
+    uint64_t GetDigest() const;
+
+private:
+    /*
+     * Mix a stripe of 32 bytes into the accumulators.
+     * @param stripe The stripe.
+     */
+    void ConsumeStripe(const unsigned char* stripe);
+
+    uint64_t seed_;
+    std::array<uint64_t, 4> accumulators_;
+    std::array<unsigned char, 32> buffer_ {}; // the bytes of an incomplete stripe
+    size_t buffered_count_ { 0 };
+    uint64_t total_length_ { 0 };
+};
@@ -0,0 +1,544 @@
+#include "daemon.h"
+
+#include "archiver.h"
+#include "compressorcontext.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+
+/*
+ * Size of the header of a message: the job type or the status and the size of the payload.
+ */
+constexpr size_t MESSAGE_HEADER_SIZE = 12;
+
+/*
+ * Largest payload a message may have, a larger size is taken for a broken stream.
+ */
+constexpr uint64_t MAX_PAYLOAD_SIZE = uint64_t { 1 } << 32;
+
+/*
+ * Get the address of a socket.
+ * @param socket_path The path to the socket.
+ * @return The address.
+ */
+sockaddr_un GetSocketAddress(const std::string& socket_path)
+{
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path))
+    {
+        throw std::invalid_argument("The socket path should be from 1 to "
+                                    + std::to_string(sizeof(address.sun_path) - 1)
+                                    + " characters long: " + socket_path);
+    }
+    std::memcpy(address.sun_path, socket_path.data(), socket_path.size());
+    return address;
+}
+
+/*
+ * Send a message.
+ * @param connection The socket of the connection.
+ * @param tag The job type or the status.
+ * @param payload The payload.
+ */
+void SendMessage(int connection, uint32_t tag, std::span<const unsigned char> payload)
+{
+    std::array<unsigned char, MESSAGE_HEADER_SIZE> header {};
+    uint64_t payload_size = payload.size();
+    std::memcpy(header.data(), &tag, sizeof(tag));
+    std::memcpy(header.data() + sizeof(tag), &payload_size, sizeof(payload_size));
+
+    // The header and the payload go in one call, a short send is continued from where it stopped
+    std::array<iovec, 2> parts = {
+        iovec { .iov_base = header.data(), .iov_len = header.size() },
+        iovec { .iov_base = const_cast<unsigned char*>(payload.data()), .iov_len = payload.size() },
+    };
+    size_t part_index = 0;
+    while (part_index < parts.size())
+    {
+        msghdr message {};
+        message.msg_iov = parts.data() + part_index;
+        message.msg_iovlen = parts.size() - part_index;
+        ssize_t sent = sendmsg(connection, &message, MSG_NOSIGNAL);
+        if (sent == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw std::runtime_error("Cannot send a message: " + std::string(strerror(errno)));
+        }
+
+        auto remaining = static_cast<size_t>(sent);
+        while (part_index < parts.size() && remaining >= parts[part_index].iov_len)
+        {
+            remaining -= parts[part_index].iov_len;
+            ++part_index;
+        }
+        if (part_index < parts.size())
+        {
+            parts[part_index].iov_base = static_cast<unsigned char*>(parts[part_index].iov_base)
+                + remaining;
+            parts[part_index].iov_len -= remaining;
+        }
+    }
+}
+
+/*
+ * Read bytes from a connection.
+ * @param connection The socket of the connection.
+ * @param data The buffer for the bytes.
+ * @param size The number of bytes.
+ * @return False if the connection is closed before the first byte.
+ */
+bool Receive(int connection, unsigned char* data, size_t size)
+{
+    size_t received_size = 0;
+    while (received_size < size)
+    {
+        ssize_t received = recv(connection, data + received_size, size - received_size, 0);
+        if (received == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw std::runtime_error("Cannot receive a message: " + std::string(strerror(errno)));
+        }
+        if (received == 0)
+        {
+            if (received_size == 0)
+            {
+                return false;
+            }
+            throw std::runtime_error("The connection is closed in the middle of a message");
+        }
+        received_size += static_cast<size_t>(received);
+    }
+    return true;
+}
+
+/*
+ * Receive a message.
+ * @param connection The socket of the connection.
+ * @param tag Set to the job type or the status.
+ * @param payload Set to the payload, it keeps its capacity.
+ * @return False if the connection is closed between the messages.
+ */
+bool ReceiveMessage(int connection, uint32_t& tag, std::vector<unsigned char>& payload)
+{
+    std::array<unsigned char, MESSAGE_HEADER_SIZE> header {};
+    if (!Receive(connection, header.data(), header.size()))
+    {
+        return false;
+    }
+    uint64_t payload_size = 0;
+    std::memcpy(&tag, header.data(), sizeof(tag));
+    std::memcpy(&payload_size, header.data() + sizeof(tag), sizeof(payload_size));
+    if (payload_size > MAX_PAYLOAD_SIZE)
+    {
+        throw std::runtime_error("The message is too large");
+    }
+
+    payload.resize(payload_size);
+    if (payload_size > 0 && !Receive(connection, payload.data(), payload.size()))
+    {
+        throw std::runtime_error("The connection is closed in the middle of a message");
+    }
+    return true;
+}
+
+/*
+ * Add a string to the payload of a file job.
+ * @param payload The payload.
+ * @param string The string.
+ */
+void AppendString(std::vector<unsigned char>& payload, const std::string& string)
+{
+    uint64_t size = string.size();
+    const auto* size_bytes = reinterpret_cast<const unsigned char*>(&size);
+    payload.insert(payload.end(), size_bytes, size_bytes + sizeof(size));
+    payload.insert(payload.end(), string.begin(), string.end());
+}
+
+/*
+ * Get the strings of the payload of a file job.
+ * @param payload The payload.
+ * @return The strings.
+ */
+std::vector<std::string> ParseStrings(std::span<const unsigned char> payload)
+{
+    std::vector<std::string> strings;
+    size_t position = 0;
+    while (position < payload.size())
+    {
+        uint64_t size = 0;
+        if (payload.size() - position < sizeof(size))
+        {
+            throw std::runtime_error("The file job is corrupted");
+        }
+        std::memcpy(&size, payload.data() + position, sizeof(size));
+        position += sizeof(size);
+        if (size > payload.size() - position)
+        {
+            throw std::runtime_error("The file job is corrupted");
+        }
+        strings.emplace_back(payload.begin() + position, payload.begin() + position + size);
+        position += size;
+    }
+    return strings;
+}
+
+/*
+ * Run a job.
+ * @param job_type The type of the job.
+ * @param payload The payload of the job.
+ * @param context The compressor context of the worker.
+ * @param reply The payload of the reply, empty at the call.
+ */
+void RunJob(JobType job_type,
+            std::span<const unsigned char> payload,
+            CompressorContext& context,
+            std::vector<unsigned char>& reply)
+{
+    switch (job_type)
+    {
+    case JobType::CompressBuffer:
+        context.Compress(payload, reply);
+        return;
+    case JobType::DecompressBuffer:
+        if (context.Decompress(payload, reply) != payload.size())
+        {
+            throw std::runtime_error("The buffer has more than one record");
+        }
+        return;
+    case JobType::CompressFiles:
+    case JobType::AppendFiles:
+    {
+        auto strings = ParseStrings(payload);
+        if (strings.size() < 2)
+        {
+            throw std::runtime_error("The file job has no archive");
+        }
+        Archiver archiver(strings[1],
+                          std::vector<std::string>(strings.begin() + 2, strings.end()),
+                          GetLevelOptions(std::stoi(strings[0])));
+        if (job_type == JobType::AppendFiles)
+        {
+            archiver.Append();
+        }
+        else
+        {
+            archiver.Compress();
+        }
+        return;
+    }
+    case JobType::DecompressArchive:
+    {
+        auto strings = ParseStrings(payload);
+        if (strings.size() != 2)
+        {
+            throw std::runtime_error("The decompression job takes the archive and the directory");
+        }
+        Archiver(strings[0]).Decompress(strings[1]);
+        return;
+    }
+    }
+    throw std::runtime_error("Unknown job type " + std::to_string(static_cast<uint32_t>(job_type)));
+}
+
+} // namespace
+
+CompressionServer::CompressionServer(const std::string& socket_path, size_t threads_count)
+    : socket_path_(socket_path)
+{
+    auto address = GetSocketAddress(socket_path);
+    listening_socket_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (listening_socket_ == -1)
+    {
+        throw std::runtime_error("Cannot create the socket " + socket_path);
+    }
+    if (pipe2(wake_pipe_.data(), O_CLOEXEC | O_NONBLOCK) == -1)
+    {
+        close(listening_socket_);
+        throw std::runtime_error("Cannot create the wake-up pipe of the daemon");
+    }
+
+    // A socket file left by a daemon that did not stop cleanly is taken over
+    std::error_code error;
+    if (std::filesystem::is_socket(socket_path, error))
+    {
+        std::filesystem::remove(socket_path, error);
+    }
+
+    // The socket file is owner-only before anyone can connect to it
+    if (bind(listening_socket_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == -1
+        || chmod(socket_path.c_str(), S_IRUSR | S_IWUSR) == -1
+        || listen(listening_socket_, SOMAXCONN) == -1)
+    {
+        std::string message = strerror(errno);
+        close(listening_socket_);
+        close(wake_pipe_[0]);
+        close(wake_pipe_[1]);
+        throw std::runtime_error("Cannot listen on the socket " + socket_path + ": " + message);
+    }
+    thread_pool_ = std::make_unique<ThreadPool>(threads_count);
+}
+
+CompressionServer::~CompressionServer()
+{
+    Stop();
+
+    // The jobs still waiting for a worker are dropped with the pool
+    thread_pool_.reset();
+    for (int connection : connections_)
+    {
+        close(connection);
+    }
+    close(listening_socket_);
+    close(wake_pipe_[0]);
+    close(wake_pipe_[1]);
+    unlink(socket_path_.c_str());
+}
+
+void CompressionServer::Run()
+{
+    // The wake-up pipe and the listening socket come first, then the connections between jobs
+    std::vector<pollfd> polled = { { wake_pipe_[0], POLLIN, 0 }, { listening_socket_, POLLIN, 0 } };
+    while (!is_stopped_)
+    {
+        if (poll(polled.data(), polled.size(), -1) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw std::runtime_error("Cannot poll the connections: "
+                                     + std::string(strerror(errno)));
+        }
+
+        // A ready connection is polled again once its job is replied
+        for (size_t i = 2; i < polled.size();)
+        {
+            if (polled[i].revents == 0)
+            {
+                ++i;
+                continue;
+            }
+            int connection = polled[i].fd;
+            polled[i] = polled.back();
+            polled.pop_back();
+            thread_pool_->Submit([this, connection] { Serve(connection); });
+        }
+
+        if (polled[0].revents != 0)
+        {
+            std::array<char, 64> bytes {};
+            while (read(wake_pipe_[0], bytes.data(), bytes.size()) > 0)
+            {
+            }
+            std::lock_guard lock(mutex_);
+            for (int connection : served_connections_)
+            {
+                polled.push_back({ connection, POLLIN, 0 });
+            }
+            served_connections_.clear();
+        }
+
+        if (polled[1].revents != 0)
+        {
+            for (int connection = Accept(); connection != -1; connection = Accept())
+            {
+                polled.push_back({ connection, POLLIN, 0 });
+            }
+        }
+    }
+
+    // The workers see the end of their connections once the running jobs are replied
+    std::lock_guard lock(mutex_);
+    for (int connection : connections_)
+    {
+        shutdown(connection, SHUT_RDWR);
+    }
+}
+
+void CompressionServer::Stop()
+{
+    // The calls are async-signal-safe, a full pipe already wakes up the polling thread
+    is_stopped_ = true;
+    shutdown(listening_socket_, SHUT_RDWR);
+    [[maybe_unused]] ssize_t written = write(wake_pipe_[1], "", 1);
+}
+
+int CompressionServer::Accept()
+{
+    while (true)
+    {
+        int connection = accept4(listening_socket_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (connection == -1)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return -1;
+            }
+            throw std::runtime_error("Cannot accept a connection: "
+                                     + std::string(strerror(errno)));
+        }
+
+        // The jobs read and write files as the daemon, so only its user may send them
+        ucred credentials {};
+        socklen_t credentials_size = sizeof(credentials);
+        if (getsockopt(connection, SOL_SOCKET, SO_PEERCRED, &credentials, &credentials_size) == -1
+            || credentials.uid != geteuid())
+        {
+            close(connection);
+            continue;
+        }
+
+        std::lock_guard lock(mutex_);
+        connections_.insert(connection);
+        return connection;
+    }
+}
+
+void CompressionServer::Serve(int connection)
+{
+    thread_local CompressorContext context;
+    thread_local std::vector<unsigned char> payload;
+    thread_local std::vector<unsigned char> reply;
+
+    try
+    {
+        uint32_t job_type = 0;
+        if (!ReceiveMessage(connection, job_type, payload))
+        {
+            Close(connection);
+            return;
+        }
+
+        JobStatus status = JobStatus::Done;
+        reply.clear();
+        try
+        {
+            RunJob(static_cast<JobType>(job_type), payload, context, reply);
+        }
+        catch (const std::exception& error)
+        {
+            status = JobStatus::Failed;
+            std::string message = error.what();
+            reply.assign(message.begin(), message.end());
+        }
+        SendMessage(connection, static_cast<uint32_t>(status), reply);
+    }
+    catch (const std::exception&)
+    {
+        // The client is gone or breaks the framing, its connection is dropped
+        Close(connection);
+        return;
+    }
+
+    {
+        std::lock_guard lock(mutex_);
+        served_connections_.push_back(connection);
+    }
+    [[maybe_unused]] ssize_t written = write(wake_pipe_[1], "", 1);
+}
+
+void CompressionServer::Close(int connection)
+{
+    std::lock_guard lock(mutex_);
+    connections_.erase(connection);
+    close(connection);
+}
+
+CompressionClient::CompressionClient(const std::string& socket_path)
+{
+    auto address = GetSocketAddress(socket_path);
+    socket_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socket_ == -1)
+    {
+        throw std::runtime_error("Cannot create the socket " + socket_path);
+    }
+    if (connect(socket_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == -1)
+    {
+        std::string message = strerror(errno);
+        close(socket_);
+        throw std::runtime_error("Cannot connect to the daemon at " + socket_path + ": "
+                                 + message);
+    }
+}
+
+CompressionClient::~CompressionClient()
+{
+    close(socket_);
+}
+
+void CompressionClient::CompressBuffer(std::span<const unsigned char> buffer,
+                                       std::vector<unsigned char>& record)
+{
+    Call(JobType::CompressBuffer, buffer, record);
+}
+
+void CompressionClient::DecompressBuffer(std::span<const unsigned char> record,
+                                         std::vector<unsigned char>& buffer)
+{
+    Call(JobType::DecompressBuffer, record, buffer);
+}
+
+void CompressionClient::CompressFiles(const std::string& archive_path,
+                                      const std::vector<std::string>& file_paths,
+                                      int level,
+                                      bool is_append)
+{
+    std::vector<unsigned char> payload;
+    AppendString(payload, std::to_string(level));
+    AppendString(payload, std::filesystem::absolute(archive_path).string());
+    for (const auto& file_path : file_paths)
+    {
+        AppendString(payload, std::filesystem::absolute(file_path).string());
+    }
+    Call(is_append ? JobType::AppendFiles : JobType::CompressFiles, payload, reply_);
+}
+
+void CompressionClient::DecompressArchive(const std::string& archive_path,
+                                          const std::string& output_directory)
+{
+    std::vector<unsigned char> payload;
+    AppendString(payload, std::filesystem::absolute(archive_path).string());
+    AppendString(payload,
+                 std::filesystem::absolute(output_directory.empty() ? "." : output_directory)
+                     .lexically_normal()
+                     .string());
+    Call(JobType::DecompressArchive, payload, reply_);
+}
+
+void CompressionClient::Call(JobType job_type,
+                             std::span<const unsigned char> payload,
+                             std::vector<unsigned char>& reply)
+{
+    SendMessage(socket_, static_cast<uint32_t>(job_type), payload);
+    uint32_t status = 0;
+    if (!ReceiveMessage(socket_, status, reply))
+    {
+        throw std::runtime_error("The daemon closed the connection");
+    }
+    if (status != static_cast<uint32_t>(JobStatus::Done))
+    {
+        throw std::runtime_error(std::string(reply.begin(), reply.end()));
+    }
+}
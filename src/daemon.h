@@ -0,0 +1,176 @@
+#pragma once
+
+#include "threadpool.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+/*
+ * Jobs the daemon runs. A message is the 32-bit job type, or the 32-bit status of a reply, then
+ * the 64-bit size of the payload and the payload, in the byte order of the machine. The payload
+ * of a file job is a list of strings, each one after its 64-bit size.
+ */
+enum class JobType : uint32_t
+{
+    CompressBuffer = 0, // a buffer to a CompressorContext record
+    DecompressBuffer = 1, // a CompressorContext record to the buffer
+    CompressFiles = 2, // the level, the archive path and the file paths to the archive
+    AppendFiles = 3, // the level, the archive path and the file paths to the end of the archive
+    DecompressArchive = 4, // the archive path and the output directory to the files
+};
+
+/*
+ * Status of a reply, the payload of an error is its message.
+ */
+enum class JobStatus : uint32_t
+{
+    Done = 0,
+    Failed = 1,
+};
+
+/*
+ * A server running the jobs of the clients connected to a Unix domain socket, so that a job
+ * pays neither the start of a process nor cold caches. The socket is only open to the user of
+ * the daemon, and so are its connections. The accepting thread polls the idle connections and
+ * hands each job to a worker of the thread pool, which gives the connection back once the job is
+ * replied, hence an idle client holds no worker. Each worker keeps its compressor context from
+ * one job to the next, and the jobs past the number of the workers wait for a free worker. The
+ * paths of the file jobs are taken as they are, a client sends absolute ones.
+ */
+class CompressionServer
+{
+public:
+    /*
+     * Constructor, starts listening on the socket. A stale socket file is replaced.
+     * @param socket_path The path to the socket.
+     * @param threads_count The number of jobs run at once, at least one.
+     */
+    CompressionServer(const std::string& socket_path, size_t threads_count);
+
+    /*
+     * Destructor. Waits for the running jobs and removes the socket file.
+     */
+    ~CompressionServer();
+
+    CompressionServer(const CompressionServer&) = delete;
+    CompressionServer& operator=(const CompressionServer&) = delete;
+
+    /*
+     * Accept the connections and dispatch their jobs until Stop is called.
+     */
+    void Run();
+
+    /*
+     * Make Run return. Safe to call from another thread and from a signal handler.
+     */
+    void Stop();
+
+private:
+    /*
+     * Accept a connection if its client runs as the user of the daemon.
+     * @return The socket of the connection, or -1 if none is accepted.
+     */
+    int Accept();
+
+    /*
+     * Run the next job of a connection on a worker, then give the connection back to the polling
+     * thread, or close it if the client is gone.
+     * @param connection The socket of the connection.
+     */
+    void Serve(int connection);
+
+    /*
+     * Close a connection and forget it.
+     * @param connection The socket of the connection.
+     */
+    void Close(int connection);
+
+    std::string socket_path_;
+    int listening_socket_;
+    std::array<int, 2> wake_pipe_ { -1, -1 }; // written to wake up the polling thread
+    std::atomic<bool> is_stopped_ { false };
+
+    std::mutex mutex_;
+    std::unordered_set<int> connections_;
+    std::vector<int> served_connections_; // given back by the workers, waiting to be polled
+    std::unique_ptr<ThreadPool> thread_pool_;
+};
+
+/*
+ * A connection to the daemon. The calls wait for the reply of the job.
+ */
+class CompressionClient
+{
+public:
+    /*
+     * Constructor, connects to the daemon.
+     * @param socket_path The path to the socket of the daemon.
+     */
+    explicit CompressionClient(const std::string& socket_path);
+
+    /*
+     * Destructor, closes the connection.
+     */
+    ~CompressionClient();
+
+    CompressionClient(const CompressionClient&) = delete;
+    CompressionClient& operator=(const CompressionClient&) = delete;
+
+    /*
+     * Compress a buffer to a record of CompressorContext.
+     * @param buffer The buffer to compress.
+     * @param record The record, replaced by the call.
+     */
+    void CompressBuffer(std::span<const unsigned char> buffer, std::vector<unsigned char>& record);
+
+    /*
+     * Decompress a record of CompressorContext.
+     * @param record The record.
+     * @param buffer The content, replaced by the call.
+     */
+    void DecompressBuffer(std::span<const unsigned char> record,
+                          std::vector<unsigned char>& buffer);
+
+    /*
+     * Compress files to an archive.
+     * @param archive_path The path to the archive file, relative ones are made absolute.
+     * @param file_paths The paths to the files to archive, relative ones are made absolute.
+     * @param level The compression level.
+     * @param is_append Whether the files go to the end of an existing archive.
+     */
+    void CompressFiles(const std::string& archive_path,
+                       const std::vector<std::string>& file_paths,
+                       int level,
+                       bool is_append = false);
+
+    /*
+     * Decompress an archive.
+     * @param archive_path The path to the archive file, a relative one is made absolute.
+     * @param output_directory The directory the files are restored under, the current one if
+     * empty, a relative one is made absolute.
+     */
+    void DecompressArchive(const std::string& archive_path,
+                           const std::string& output_directory = {});
+
+private:
+    /*
+     * Send a job and wait for its reply.
+     * @param job_type The type of the job.
+     * @param payload The payload of the job.
+     * @param reply The payload of the reply, replaced by the call.
+     */
+    void Call(JobType job_type,
+              std::span<const unsigned char> payload,
+              std::vector<unsigned char>& reply);
+
+    int socket_;
+    std::vector<unsigned char> reply_;
+};
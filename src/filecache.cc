@@ -0,0 +1,89 @@
+#include "filecache.h"
+
+#include "contenthash.h"
+
+#include <bit>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+
+/*
+ * Version of the entries, changed with the layout of the file records or the choices of the
+ * encoder so that the entries of an older archiver are not found.
+ */
+constexpr uint64_t CACHE_FORMAT_VERSION = 3;
+
+/*
+ * Size of the chunks a file is hashed by.
+ */
+constexpr size_t HASHED_CHUNK_SIZE = 1 << 20;
+
+FileCache::FileCache(const std::string& directory, const EncodingOptions& options)
+    : directory_(directory)
+{
+    std::filesystem::create_directories(directory_);
+
+    // The options that do not change the encoded bytes, e.g. the threads, are left out
+    ContentHasher hasher;
+    for (uint64_t number : { CACHE_FORMAT_VERSION,
+                             static_cast<uint64_t>(options.frequency_mode),
+                             static_cast<uint64_t>(options.sample_chunks_count),
+                             static_cast<uint64_t>(options.sample_chunk_size),
+                             static_cast<uint64_t>(options.table_scope),
+                             static_cast<uint64_t>(options.block_size),
+                             static_cast<uint64_t>(options.max_code_length),
+                             std::bit_cast<uint64_t>(options.stored_threshold),
+                             static_cast<uint64_t>(options.order1_contexts),
+                             static_cast<uint64_t>(options.max_tokens_count),
+                             static_cast<uint64_t>(options.transforms),
+                             static_cast<uint64_t>(options.ans_blocks),
+                             static_cast<uint64_t>(options.static_tables),
+                             static_cast<uint64_t>(options.sync_interval) })
+    {
+        hasher.UpdateNumber(number);
+    }
+    options_hash_ = hasher.GetDigest();
+}
+
+std::string FileCache::GetEntryPath(FileReader& reader, CharacterCounts* character_counts) const
+{
+    ContentHasher hasher(options_hash_);
+    reader.ResetPositionToStart();
+    while (true)
+    {
+        auto characters = reader.ReadCharacters(HASHED_CHUNK_SIZE);
+        if (characters.empty())
+        {
+            break;
+        }
+        hasher.Update(characters);
+        if (character_counts != nullptr)
+        {
+            for (auto character : characters)
+            {
+                ++(*character_counts)[character];
+            }
+        }
+    }
+
+    std::ostringstream entry_name;
+    entry_name << std::hex << std::setw(16) << std::setfill('0') << hasher.GetDigest() << '-'
+               << std::dec << reader.GetFileSize() << ".blob";
+    return (std::filesystem::path(directory_) / entry_name.str()).string();
+}
+
+bool FileCache::Contains(const std::string& entry_path) const
+{
+    return std::filesystem::is_regular_file(entry_path);
+}
+
+void FileCache::Store(const std::string& entry_path,
+                      const std::function<void(FileWriter&)>& write_content) const
+{
+    std::string temporary_path = entry_path + ".tmp";
+    {
+        FileWriter writer(temporary_path);
+        write_content(writer);
+    }
+    std::filesystem::rename(temporary_path, entry_path);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "filereader.h"
+#include "filewriter.h"
+#include "huffman.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+ * A directory of encoded files kept from previous archives. An entry is found by the hash and
+ * the size of the content of a file and by the encoder options that change its encoding, and
+ * holds the encoded file without its name, so that an unchanged file is copied to the next
+ * archive instead of being encoded again. Entries are never removed, delete them at any time to
+ * free the space.
+ */
+class FileCache
+{
+public:
+    /*
+     * Constructor, creates the directory if it is missing.
+     * @param directory The path to the cache directory.
+     * @param options The encoder options the entries are looked up for.
+     */
+    FileCache(const std::string& directory, const EncodingOptions& options);
+
+    /*
+     * Hash a file and get the path of its entry.
+     * @param reader The file reader.
+     * @param character_counts Set to the counts of the characters of the file unless nullptr.
+     * @return The path of the entry, which may be missing.
+     */
+    std::string GetEntryPath(FileReader& reader, CharacterCounts* character_counts) const;
+
+    /*
+     * Check if an entry exists.
+     * @param entry_path The path of the entry.
+     * @return True if the entry exists.
+     */
+    bool Contains(const std::string& entry_path) const;
+
+    /*
+     * Write an entry. The entry is written apart and replaces the old one at once, hence a
+     * concurrent reader never sees a part of it.
+     * @param entry_path The path of the entry.
+     * @param write_content The function writing the content of the entry.
+     */
+    void Store(const std::string& entry_path,
+               const std::function<void(FileWriter&)>& write_content) const;
+
+private:
+    std::string directory_;
+    uint64_t options_hash_; // the seed of the content hashes
+};
@@ -1,9 +1,18 @@
 #include "filereader.h"
 
+#include "trace.h"
+
+#include <algorithm>
 #include <filesystem>
+#include <stdexcept>
+
+/*
+ * Size of the bytes read from the file ahead of the reads.
+ */
+constexpr size_t READ_BUFFER_SIZE = 1 << 16;
 
 FileReader::FileReader(const std::string& file_path)
-    : file_path_(file_path), file_(file_path_, std::ifstream::binary)
+    : file_path_(file_path), file_(file_path_, std::ifstream::binary), buffer_(READ_BUFFER_SIZE)
 {
     if (!file_.is_open())
     {
@@ -31,61 +40,171 @@ std::string FileReader::GetFileName() const
     return std::filesystem::path(file_path_).filename().string();
 }
 
+size_t FileReader::GetFileSize() const
+{
+    return file_size_;
+}
+
 void FileReader::ResetPositionToStart()
 {
+    SetPosition(0);
+}
+
+void FileReader::SetPosition(size_t position)
+{
+    bit_buffer_ = 0;
+    bit_count_ = 0;
+
+    // Move within the buffer if it holds the position, otherwise read from the position on
+    if (position >= buffer_begin_ && position <= buffer_begin_ + buffer_size_)
+    {
+        buffer_position_ = position - buffer_begin_;
+        return;
+    }
+
     file_.clear();
-    file_.seekg(0, std::ios::beg);
+    file_.seekg(static_cast<std::streamoff>(position), std::ios::beg);
+    buffer_begin_ = position;
+    buffer_size_ = 0;
+    buffer_position_ = 0;
+}
 
-    buffer_byte_ = 0;
-    bit_pos_ = 0;
+size_t FileReader::GetPosition()
+{
+    // The whole bytes of the bit buffer are not read yet
+    return buffer_begin_ + buffer_position_ - bit_count_ / 8;
 }
 
-bool FileReader::HasMoreCharacters() const
+bool FileReader::HasMoreCharacters()
 {
-    return !file_.eof();
+    return GetPosition() < file_size_;
 }
 
 std::optional<unsigned char> FileReader::ReadCharacter()
 {
-    char character;
-    if (file_.get(character))
+    SetPosition(GetPosition());
+    if (buffer_position_ == buffer_size_ && !FillBuffer())
     {
-        return static_cast<unsigned char>(character);
+        return std::nullopt;
     }
-    return std::nullopt;
+    return buffer_[buffer_position_++];
+}
+
+std::vector<unsigned char> FileReader::ReadCharacters(size_t count)
+{
+    std::vector<unsigned char> characters;
+    ReadCharacters(count, characters);
+    return characters;
+}
+
+void FileReader::ReadCharacters(size_t count, std::vector<unsigned char>& characters)
+{
+    TraceScope trace_scope(TraceStage::Read);
+    SetPosition(GetPosition());
+    characters.resize(count);
+
+    size_t characters_read = 0;
+    while (characters_read < count)
+    {
+        size_t buffered = std::min(count - characters_read, buffer_size_ - buffer_position_);
+        std::copy_n(buffer_.begin() + static_cast<std::ptrdiff_t>(buffer_position_),
+                    buffered,
+                    characters.begin() + static_cast<std::ptrdiff_t>(characters_read));
+        buffer_position_ += buffered;
+        characters_read += buffered;
+        if (characters_read == count)
+        {
+            break;
+        }
+
+        // Read what is left of a large read at once, past the buffer
+        if (count - characters_read >= READ_BUFFER_SIZE)
+        {
+            file_.read(reinterpret_cast<char*>(characters.data() + characters_read),
+                       static_cast<std::streamsize>(count - characters_read));
+            size_t bytes_read = file_.gcount();
+            characters_read += bytes_read;
+            buffer_begin_ += buffer_size_ + bytes_read;
+            buffer_size_ = 0;
+            buffer_position_ = 0;
+            break;
+        }
+        if (!FillBuffer())
+        {
+            break;
+        }
+    }
+    characters.resize(characters_read);
 }
 
 uint64_t FileReader::ReadHuffmanInt(size_t num_bits)
 {
-    uint64_t number = 0;
-    for (size_t i = 0; i < num_bits; ++i)
+    // The bit buffer holds at least 56 bits after a byte boundary, longer numbers take two reads
+    if (num_bits > 56)
     {
-        bool bit = ReadBit();
-        // Shift the bit to the correct position starting from LSB
-        number |= static_cast<uint64_t>(bit) << i;
+        uint64_t low_bits = ReadHuffmanInt(32);
+        return low_bits | ReadHuffmanInt(num_bits - 32) << 32;
     }
+
+    uint64_t number = PeekBits(num_bits);
+    SkipBits(num_bits);
     return number;
 }
 
+void FileReader::AlignToByte()
+{
+    size_t partial_bits = bit_count_ % 8;
+    bit_buffer_ >>= partial_bits;
+    bit_count_ -= partial_bits;
+}
+
 bool FileReader::ReadBit()
 {
-    // If the buffer is empty, read the next byte
-    if (bit_pos_ == 0)
+    return ReadHuffmanInt(1) != 0;
+}
+
+uint64_t FileReader::PeekBits(size_t num_bits)
+{
+    if (bit_count_ < num_bits)
+    {
+        FillBitBuffer();
+    }
+    return bit_buffer_ & ((uint64_t { 1 } << num_bits) - 1);
+}
+
+void FileReader::SkipBits(size_t num_bits)
+{
+    if (bit_count_ < num_bits)
     {
-        char byte;
-        if (!file_.get(byte))
+        FillBitBuffer();
+        if (bit_count_ < num_bits)
         {
             throw std::runtime_error("Failed to read a byte from the file");
         }
-
-        buffer_byte_ = byte;
     }
+    bit_buffer_ >>= num_bits;
+    bit_count_ -= num_bits;
+}
 
-    // Read the bit starting from LSB
-    bool bit = buffer_byte_ & (1 << bit_pos_);
-
-    ++bit_pos_;
-    bit_pos_ %= 8;
+void FileReader::FillBitBuffer()
+{
+    while (bit_count_ <= 56)
+    {
+        if (buffer_position_ == buffer_size_ && !FillBuffer())
+        {
+            return;
+        }
+        bit_buffer_ |= static_cast<uint64_t>(buffer_[buffer_position_++]) << bit_count_;
+        bit_count_ += 8;
+    }
+}
 
-    return bit;
+bool FileReader::FillBuffer()
+{
+    file_.read(reinterpret_cast<char*>(buffer_.data()),
+               static_cast<std::streamsize>(buffer_.size()));
+    buffer_begin_ += buffer_size_;
+    buffer_size_ = file_.gcount();
+    buffer_position_ = 0;
+    return buffer_size_ > 0;
 }
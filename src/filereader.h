@@ -2,9 +2,10 @@
 
 #include <fstream>
 #include <optional>
+#include <vector>
 
 /*
- * A class for reading from a file byte by byte.
+ * A class for reading from a file bit by bit or byte by byte, through a buffer of the bytes ahead.
  */
 class FileReader
 {
@@ -26,16 +27,34 @@ public:
      */
     std::string GetFileName() const;
 
+    /*
+     * Get the size of the file.
+     * @return The size of the file in bytes.
+     */
+    size_t GetFileSize() const;
+
     /*
      * Reset the file pointer to the beginning of the file.
      */
     void ResetPositionToStart();
 
+    /*
+     * Move the file pointer to the given offset from the beginning of the file.
+     * @param position The offset in bytes.
+     */
+    void SetPosition(size_t position);
+
+    /*
+     * Get the offset of the next whole byte to read, the rest of the current byte is skipped.
+     * @return The offset in bytes.
+     */
+    size_t GetPosition();
+
     /*
      * Check if there are more characters to read from the file.
      * @return True if there are more characters to read, false otherwise.
      */
-    bool HasMoreCharacters() const;
+    bool HasMoreCharacters();
 
     /*
      * Read a character from the file.
@@ -43,6 +62,20 @@ public:
      */
     std::optional<unsigned char> ReadCharacter();
 
+    /*
+     * Read several characters from the file at once.
+     * @param count The number of characters to read.
+     * @return The characters read, fewer than count if the end of the file is reached.
+     */
+    std::vector<unsigned char> ReadCharacters(size_t count);
+
+    /*
+     * Read several characters from the file into a buffer, which keeps its memory between reads.
+     * @param count The number of characters to read.
+     * @param characters The characters read, fewer than count if the end of the file is reached.
+     */
+    void ReadCharacters(size_t count, std::vector<unsigned char>& characters);
+
     /*
      * Read an integer encoded with variable-length bit encoding.
      * @param num_bits The number of bits to read.
@@ -50,18 +83,54 @@ public:
      */
     uint64_t ReadHuffmanInt(size_t num_bits = 9);
 
+    /*
+     * Skip the rest of the current byte, so that the next read starts at a byte boundary.
+     */
+    void AlignToByte();
+
     /*
      * Read a bit from the file.
      * @return The bit read from the file.
      */
     bool ReadBit();
 
+    /*
+     * Get the next bits without reading them, e.g. to look a code up in a decoding table.
+     * @param num_bits The number of bits, up to 56.
+     * @return The bits from the LSB on, zero past the end of the file.
+     */
+    uint64_t PeekBits(size_t num_bits);
+
+    /*
+     * Read the bits got with PeekBits.
+     * @param num_bits The number of bits, up to 56.
+     */
+    void SkipBits(size_t num_bits);
+
 private:
+    /*
+     * Take the next bytes of the buffer into the bit buffer, until it is full or the file ends.
+     */
+    void FillBitBuffer();
+
+    /*
+     * Read the bytes that follow the buffer into it.
+     * @return False if the end of the file is reached.
+     */
+    bool FillBuffer();
+
     std::string file_path_;
     std::ifstream file_;
 
-    unsigned char buffer_byte_ { 0 };
-    uint8_t bit_pos_ { 0 };
+    // The bytes read from the file ahead, the file is read from the end of the buffer on
+    std::vector<unsigned char> buffer_;
+    size_t buffer_begin_ { 0 }; // the offset of the buffer in the file
+    size_t buffer_size_ { 0 };
+    size_t buffer_position_ { 0 }; // the next byte of the buffer to read
+
+    // The bits taken from the buffer and not read yet, the next one in the LSB
+    uint64_t bit_buffer_ { 0 };
+    uint8_t bit_count_ { 0 };
 
     size_t file_size_ { 0 };
 };
@@ -1,77 +1,203 @@
 #include "filewriter.h"
 
-FileWriter::FileWriter(const std::string& file_path)
-    : file_path_(file_path), file_(file_path, std::ofstream::binary)
+#include "trace.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+/*
+ * Size of the bytes gathered in memory before they are written to the file.
+ */
+constexpr size_t WRITE_BUFFER_SIZE = 1 << 16;
+
+FileWriter::FileWriter(const std::string& file_path, bool append)
+    : file_path_(file_path),
+      file_(file_path,
+            std::ofstream::binary | (append ? std::ofstream::in : std::ofstream::trunc))
 {
     if (!file_.is_open())
     {
         throw std::runtime_error("The file writer cannot open " + file_path);
     }
+
+    // Appending opens the file without truncating it and writes from its end
+    file_.seekp(0, std::ios::end);
+    start_position_ = file_.tellp();
+}
+
+FileWriter::FileWriter()
+    : is_in_memory_(true)
+{
 }
 
 FileWriter::~FileWriter()
 {
     if (file_.is_open())
     {
+        TraceScope trace_scope(TraceStage::Flush);
         FlushBuffer();
+        FlushBytes();
         file_.close();
     }
 }
 
 void FileWriter::WriteCharacter(unsigned char character)
 {
-    file_.put(static_cast<char>(character));
+    WriteHuffmanInt(character, 8);
 }
 
-void FileWriter::WriteHuffmanInt(uint64_t number, size_t num_bits)
+void FileWriter::WriteCharacters(const std::vector<unsigned char>& characters)
 {
-    std::vector<bool> bits(num_bits);
-    for (size_t i = 0; i < num_bits; ++i)
+    TraceScope trace_scope(TraceStage::Flush);
+    if (bit_count_ % 8 != 0)
+    {
+        for (auto character : characters)
+        {
+            WriteHuffmanInt(character, 8);
+        }
+        return;
+    }
+
+    // The buffered bits are whole bytes, so the characters follow them as they are
+    FlushBuffer();
+    if (!is_in_memory_ && bytes_.size() + characters.size() > WRITE_BUFFER_SIZE)
     {
-        bits[i] = (number >> i) & 1; // fill from the LSB to the MSB
+        FlushBytes();
+        file_.write(reinterpret_cast<const char*>(characters.data()),
+                    static_cast<std::streamsize>(characters.size()));
     }
-    WriteBits(bits);
+    else
+    {
+        bytes_.insert(bytes_.end(), characters.begin(), characters.end());
+    }
+    file_size_ += characters.size();
 }
 
 void FileWriter::WriteHuffmanCode(const std::string& huffman_code)
 {
-    // Reverse huffman code to write it from the least significant bit to the most significant bit
-    std::string reversed_huffman_code(huffman_code.rbegin(), huffman_code.rend());
-    uint64_t huffman_code_to_number = std::stoll(reversed_huffman_code, nullptr, 2);
-    size_t num_bits = reversed_huffman_code.size();
-    WriteHuffmanInt(huffman_code_to_number, num_bits);
+    // The first character of the huffman code goes to the least significant bit
+    uint64_t huffman_code_to_number = 0;
+    for (size_t i = 0; i < huffman_code.size(); ++i)
+    {
+        huffman_code_to_number |= static_cast<uint64_t>(huffman_code[i] == '1') << i;
+    }
+    WriteHuffmanInt(huffman_code_to_number, huffman_code.size());
 }
 
-void FileWriter::WriteBits(const std::vector<bool>& bits)
+uint64_t FileWriter::GetBitsWritten() const
 {
-    for (bool bit : bits)
+    return static_cast<uint64_t>(file_size_) * 8 + bit_count_;
+}
+
+void FileWriter::AlignToByte()
+{
+    FlushBuffer();
+}
+
+void FileWriter::RewriteBytes(uint64_t position, uint64_t number, size_t bytes_count)
+{
+    if (position + bytes_count > file_size_)
     {
-        // Add bit to buffer
-        if (bit)
+        throw std::logic_error("Only the bytes written before can be rewritten");
+    }
+
+    if (!is_in_memory_)
+    {
+        FlushBytes();
+        file_.seekp(start_position_ + static_cast<std::streamoff>(position));
+    }
+    for (size_t i = 0; i < bytes_count; ++i, number >>= 8)
+    {
+        auto byte = static_cast<unsigned char>(number & UINT8_MAX);
+        if (is_in_memory_)
+        {
+            bytes_[position + i] = byte;
+        }
+        else
         {
-            // Set specific bit in the buffer byte without altering other bits that are already set
-            buffer_byte_ |= (1 << bit_pos_);
+            file_.put(static_cast<char>(byte));
         }
+    }
+    if (!is_in_memory_)
+    {
+        file_.seekp(0, std::ios::end);
+    }
+}
 
-        ++bit_pos_;
+void FileWriter::AppendBits(const FileWriter& other)
+{
+    TraceScope trace_scope(TraceStage::Flush);
+    if (!other.is_in_memory_)
+    {
+        throw std::logic_error("Only the bits of an in-memory writer can be appended");
+    }
 
-        // If buffer is full, write it out to the file
-        if (bit_pos_ == 8)
+    // Copy the whole bytes at once if they fall on the byte boundaries here, otherwise shift
+    // them in by whole words
+    if (bit_count_ % 8 == 0)
+    {
+        WriteCharacters(other.bytes_);
+    }
+    else
+    {
+        const unsigned char* bytes = other.bytes_.data();
+        size_t size = other.bytes_.size();
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8)
+        {
+            uint64_t word = 0;
+            for (size_t j = 0; j < 8; ++j)
+            {
+                word |= static_cast<uint64_t>(bytes[i + j]) << (j * 8);
+            }
+            WriteHuffmanInt(word, 64);
+        }
+        for (; i < size; ++i)
         {
-            FlushBuffer();
+            WriteHuffmanInt(bytes[i], 8);
         }
     }
+    WriteHuffmanInt(other.bit_buffer_, other.bit_count_);
+}
+
+void FileWriter::WriteBits(const std::vector<bool>& bits)
+{
+    for (bool bit : bits)
+    {
+        WriteHuffmanInt(bit, 1);
+    }
 }
 
 void FileWriter::FlushBuffer()
 {
-    if (bit_pos_ > 0)
+    if (bit_count_ > 0)
     {
-        file_.put(static_cast<char>(buffer_byte_));
+        PutBytes(bit_buffer_, (bit_count_ + 7) / 8);
+        bit_buffer_ = 0;
+        bit_count_ = 0;
+    }
+}
 
-        buffer_byte_ = 0;
-        bit_pos_ = 0;
+void FileWriter::PutBytes(uint64_t number, size_t bytes_count)
+{
+    for (size_t i = 0; i < bytes_count; ++i, number >>= 8)
+    {
+        bytes_.push_back(static_cast<unsigned char>(number & UINT8_MAX));
+    }
+    file_size_ += bytes_count;
 
-        ++file_size_;
+    if (!is_in_memory_ && bytes_.size() >= WRITE_BUFFER_SIZE)
+    {
+        FlushBytes();
+    }
+}
+
+void FileWriter::FlushBytes()
+{
+    if (!is_in_memory_ && !bytes_.empty())
+    {
+        file_.write(reinterpret_cast<const char*>(bytes_.data()),
+                    static_cast<std::streamsize>(bytes_.size()));
+        bytes_.clear();
     }
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <fstream>
+#include <string>
 #include <vector>
 
 /*
@@ -12,8 +13,15 @@ public:
     /*
      * Constructor.
      * @param file_path The path to the file to write to.
+     * @param append Write after the end of the file instead of replacing it.
      */
-    explicit FileWriter(const std::string& file_path);
+    explicit FileWriter(const std::string& file_path, bool append = false);
+
+    /*
+     * Constructor of a writer that keeps the bits in memory, e.g. to encode a part of an archive
+     * apart and append it later.
+     */
+    FileWriter();
 
     /*
      * Destructor.
@@ -26,6 +34,12 @@ public:
      */
     void WriteCharacter(unsigned char character);
 
+    /*
+     * Write several characters to the file at once.
+     * @param characters The characters to write.
+     */
+    void WriteCharacters(const std::vector<unsigned char>& characters);
+
     /*
      * Write an integer encoded with variable-length bit encoding.
      * @param number The integer to write.
@@ -39,6 +53,31 @@ public:
      */
     void WriteHuffmanCode(const std::string& huffman_code);
 
+    /*
+     * Get the number of bits written to the file so far, including the buffered ones.
+     * @return The number of bits written.
+     */
+    uint64_t GetBitsWritten() const;
+
+    /*
+     * Pad the last byte with zero bits, so that the next write starts at a byte boundary.
+     */
+    void AlignToByte();
+
+    /*
+     * Overwrite whole bytes written before with a number, from its low byte to its high byte.
+     * @param position The offset of the first byte from the start of the writing.
+     * @param number The number to write.
+     * @param bytes_count The number of bytes to overwrite.
+     */
+    void RewriteBytes(uint64_t position, uint64_t number, size_t bytes_count);
+
+    /*
+     * Append the bits written to an in-memory writer, they go right after the bits written here.
+     * @param other The in-memory writer.
+     */
+    void AppendBits(const FileWriter& other);
+
 protected:
     /*
      * Write a bit to the file.
@@ -47,16 +86,57 @@ protected:
     void WriteBits(const std::vector<bool>& bits);
 
     /*
-     * Flush the byte buffer to the file.
+     * Flush the bit buffer, padding its last byte with zero bits.
      */
     void FlushBuffer();
 
 private:
+    /*
+     * Write the lowest bytes of a number, from its low byte to its high byte.
+     * @param number The number to write.
+     * @param bytes_count The number of bytes to write.
+     */
+    void PutBytes(uint64_t number, size_t bytes_count);
+
+    /*
+     * Write the bytes waiting in memory to the file.
+     */
+    void FlushBytes();
+
     std::string file_path_;
     std::ofstream file_;
+    std::streamoff start_position_ { 0 };
 
-    unsigned char buffer_byte_ { 0 };
-    uint8_t bit_pos_ { 0 };
+    // In memory all the bytes written, otherwise the bytes waiting to be written to the file
+    bool is_in_memory_ { false };
+    std::vector<unsigned char> bytes_;
+
+    // The bits that do not make a whole 64-bit word yet, from the LSB to the MSB
+    uint64_t bit_buffer_ { 0 };
+    uint8_t bit_count_ { 0 };
 
     size_t file_size_ { 0 };
 };
+
+// Defined here so that the per-character calls of the coding loops are inlined
+inline void FileWriter::WriteHuffmanInt(uint64_t number, size_t num_bits)
+{
+    if (num_bits < 64)
+    {
+        number &= (uint64_t { 1 } << num_bits) - 1;
+    }
+
+    // Put the bits above the buffered ones, from the LSB to the MSB, and write the buffer out
+    // once it holds a whole 64-bit word
+    bit_buffer_ |= number << bit_count_;
+    size_t free_bits = 64 - bit_count_;
+    if (num_bits < free_bits)
+    {
+        bit_count_ += num_bits;
+        return;
+    }
+
+    PutBytes(bit_buffer_, 8);
+    bit_buffer_ = free_bits < 64 ? number >> free_bits : 0;
+    bit_count_ = num_bits - free_bits;
+}
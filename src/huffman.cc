@@ -1,276 +1,1624 @@
 #include "huffman.h"
 
+#include "ans.h"
+#include "canonicalcode.h"
+#include "codelengths.h"
 #include "filereader.h"
 #include "filewriter.h"
-#include "trie.h"
+#include "mappedfilewriter.h"
+#include "memorybudget.h"
+#include "statictables.h"
+#include "trace.h"
 
-#include <bitset>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <filesystem>
+#include <numeric>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
 
-std::tuple<HuffmanCodes, HuffmanCodesForLookup>
-HuffmanCoder::MoveCodesToCanonicalForm(HuffmanCodes codes) const
+namespace
 {
-    HuffmanCodes canonical_codes;
-    HuffmanCodesForLookup canonical_codes_for_lookup;
+/*
+ * Work arrays of BuildCodeLengths sized to the alphabet, for the word dictionaries whose symbols
+ * do not fit the stack.
+ */
+struct AlphabetCodeLengthWorkspace
+{
+    explicit AlphabetCodeLengthWorkspace(size_t symbols_count)
+        : symbols(symbols_count),
+          weights(2 * symbols_count),
+          nodes(2 * symbols_count),
+          length_counts(symbols_count)
+    {
+    }
+
+    std::vector<uint16_t> symbols;
+    std::vector<uint64_t> weights;
+    std::vector<uint32_t> nodes;
+    std::vector<uint32_t> length_counts;
+};
+
+/*
+ * Turn the counts of a histogram into the frequencies a table is built from: every table codes
+ * FILENAME_END and BLOCK_END, and a sampled histogram gets an escape count on every byte value,
+ * so that the characters missed by the sample still get a code.
+ * @param symbol_counts The count of each symbol, the characters first.
+ * @param has_escape_counts Whether the counts are sampled.
+ * @return The frequency of each symbol, up to BLOCK_END at least.
+ */
+CharacterFrequencies GetTableFrequencies(std::span<const uint64_t> symbol_counts,
+                                         bool has_escape_counts)
+{
+    CharacterFrequencies frequency_table(symbol_counts.begin(), symbol_counts.end());
+    frequency_table.resize(std::max<size_t>(frequency_table.size(), BLOCK_END + 1));
+    if (has_escape_counts)
+    {
+        for (uint16_t character = 0; character <= UINT8_MAX; ++character)
+        {
+            ++frequency_table[character];
+        }
+    }
+    ++frequency_table[FILENAME_END];
+    ++frequency_table[BLOCK_END];
+    return frequency_table;
+}
+
+/*
+ * Decode the next symbol of a block with its canonical code.
+ * @param code The canonical code.
+ * @param reader The file reader.
+ * @return The symbol.
+ */
+uint16_t DecodeSymbol(const CanonicalCode& code, FileReader& reader)
+{
+    auto symbol = DecodeTableSymbol(code.decoding_table,
+                                    std::span<const uint16_t>(code.symbols),
+                                    std::span<const size_t>(code.length_counts),
+                                    reader);
+    if (!symbol)
+    {
+        throw std::runtime_error("The block has a code missing from its table");
+    }
+    return *symbol;
+}
+} // namespace
 
-    size_t previous_code_bit_length = 0;
-    uint16_t current_code = 0;
-    for (const auto& [key, code] : codes)
+EncodingOptions GetLevelOptions(int level)
+{
+    if (level < MIN_LEVEL || level > MAX_LEVEL)
     {
-        auto [code_bit_length, character] = key;
+        throw std::invalid_argument("The compression level should be from 1 to 9");
+    }
 
-        current_code <<= (code_bit_length - previous_code_bit_length);
-        auto canonical_code
-            = std::bitset<16>(current_code).to_string().substr(16 - code_bit_length);
+    // Lower levels sample the input and build one table per file or archive, higher levels count
+    // everything exactly and adapt the tables to smaller blocks. The code length limit stays at 15
+    // bits up to level 7, shorter codes cost more output bits than they save in the coder
+    static const std::array<EncodingOptions, MAX_LEVEL - MIN_LEVEL + 1> level_options = {
+        EncodingOptions { .frequency_mode = FrequencyMode::Sampled,
+                          .table_scope = TableScope::File,
+                          .block_size = 1 << 20,
+                          .max_code_length = 15,
+                          .stored_threshold = 0.0 },
+        EncodingOptions { .frequency_mode = FrequencyMode::Sampled,
+                          .table_scope = TableScope::Archive,
+                          .block_size = 1 << 20,
+                          .max_code_length = 15,
+                          .stored_threshold = 0.0 },
+        EncodingOptions { .frequency_mode = FrequencyMode::Sampled,
+                          .table_scope = TableScope::File,
+                          .block_size = 1 << 20,
+                          .max_code_length = 15,
+                          .stored_threshold = 0.9 },
+        EncodingOptions { .frequency_mode = FrequencyMode::Sampled,
+                          .table_scope = TableScope::Block,
+                          .block_size = 1 << 20,
+                          .max_code_length = 15,
+                          .stored_threshold = 0.95,
+                          .static_tables = true },
+        EncodingOptions { .frequency_mode = FrequencyMode::Exact,
+                          .table_scope = TableScope::File,
+                          .block_size = 1 << 20,
+                          .max_code_length = 15,
+                          .stored_threshold = 0.98 },
+        EncodingOptions { .frequency_mode = FrequencyMode::Exact,
+                          .table_scope = TableScope::Block,
+                          .block_size = 1 << 20,
+                          .max_code_length = 15,
+                          .stored_threshold = 1.0,
+                          .static_tables = true },
+        EncodingOptions { .frequency_mode = FrequencyMode::Exact,
+                          .table_scope = TableScope::Block,
+                          .block_size = 4 << 20,
+                          .max_code_length = 15,
+                          .stored_threshold = 1.0,
+                          .order1_contexts = true,
+                          .static_tables = true },
+        EncodingOptions { .frequency_mode = FrequencyMode::Exact,
+                          .table_scope = TableScope::Block,
+                          .block_size = 1 << 20,
+                          .max_code_length = 20,
+                          .stored_threshold = 1.0,
+                          .order1_contexts = true,
+                          .max_tokens_count = 4096,
+                          .static_tables = true },
+        EncodingOptions { .frequency_mode = FrequencyMode::Exact,
+                          .table_scope = TableScope::Block,
+                          .block_size = 256 << 10,
+                          .max_code_length = 32,
+                          .stored_threshold = 1.0,
+                          .order1_contexts = true,
+                          .max_tokens_count = 4096,
+                          .transforms = ALL_TRANSFORMS,
+                          .static_tables = true },
+    };
 
-        canonical_codes.emplace(std::make_pair(code_bit_length, character), canonical_code);
-        canonical_codes_for_lookup.emplace(character, canonical_code);
+    return level_options[level - MIN_LEVEL];
+}
+
+HuffmanCoder::HuffmanCoder(const EncodingOptions& options) : options_(options) { }
+
+void HuffmanCoder::CountSharedFrequencies(FileReader& reader)
+{
+    auto character_frequencies = options_.frequency_mode == FrequencyMode::Sampled
+        ? SampleCharacterFrequencies(reader)
+        : GetCharacterFrequencies(reader);
 
-        ++current_code;
-        previous_code_bit_length = code_bit_length;
+    shared_frequencies_.resize(std::max(shared_frequencies_.size(), character_frequencies.size()));
+    for (size_t symbol = 0; symbol < character_frequencies.size(); ++symbol)
+    {
+        shared_frequencies_[symbol] += character_frequencies[symbol];
     }
+}
 
-    return { canonical_codes, canonical_codes_for_lookup };
+void HuffmanCoder::EncodeSharedTable(FileWriter& writer)
+{
+    shared_table_ = BuildCodeTable(shared_frequencies_);
+    WriteTable(shared_table_->code_lengths, writer);
 }
 
-void HuffmanCoder::Encode(FileReader& reader, FileWriter& writer, bool is_last_file) const
+EncodingStats HuffmanCoder::Encode(FileReader& reader, FileWriter& writer) const
 {
-    HuffmanCodes codes = BuildCodes(reader);
-    auto [canonical_codes, canonical_codes_for_lookup] = MoveCodesToCanonicalForm(codes);
+    uint64_t bits_written_before = writer.GetBitsWritten();
 
-    // Write the number of characters in the file
-    writer.WriteHuffmanInt(canonical_codes.size());
+    std::string file_name = reader.GetFileName();
+    SetTraceFile(file_name);
+    EncodeFileHeader(file_name, reader.GetFileSize(), writer);
+
+    // Count the written characters only if the statistics are requested
+    CharacterCounts character_counts {};
+    EncodeRange(reader,
+                0,
+                reader.GetFileSize(),
+                writer,
+                options_.collect_stats ? &character_counts : nullptr);
+
+    if (!options_.collect_stats)
+    {
+        return {};
+    }
+    return GetStats(file_name,
+                    reader.GetFileSize(),
+                    writer.GetBitsWritten() - bits_written_before,
+                    character_counts);
+}
 
-    // Write the characters
-    for (const auto& [key, _] : canonical_codes)
+void HuffmanCoder::EncodeFileHeader(const std::string& file_name,
+                                    uint64_t file_size,
+                                    FileWriter& writer) const
+{
+    writer.WriteHuffmanInt(file_name.size(), 16);
+    for (const auto& character : file_name)
     {
-        auto character = key.second;
-        writer.WriteHuffmanInt(character);
+        writer.WriteHuffmanInt(static_cast<unsigned char>(character), 8);
     }
+    writer.WriteHuffmanInt(file_size, 64);
 
-    // Write a list of sizes of each character group in the canonical codes
-    size_t previous_code_length = 0;
-    size_t count_of_codes_with_same_length = 0;
+    // Only the blocks of block tables try the transforms, the header ends at a byte boundary
+    writer.WriteHuffmanInt(std::min<uint64_t>(options_.block_size, file_size), 32);
+    writer.WriteHuffmanInt(options_.table_scope == TableScope::Block ? options_.transforms : 0, 8);
+}
+
+void HuffmanCoder::EncodeRange(FileReader& reader,
+                               size_t begin,
+                               size_t end,
+                               FileWriter& writer,
+                               CharacterCounts* character_counts) const
+{
+    size_t file_size = reader.GetFileSize();
+    end = std::min(end, file_size);
 
-    /// Write zeros from up to the first code length
-    auto first_code_length = canonical_codes.begin()->first.first;
-    for (size_t missing_length = 1; missing_length < first_code_length; ++missing_length)
+    // Build the table of the whole range before writing its first block
+    std::optional<CodeTable> file_table;
+    if (options_.table_scope == TableScope::File)
     {
-        writer.WriteHuffmanInt(0);
+        auto character_frequencies = options_.frequency_mode == FrequencyMode::Sampled
+            ? SampleCharacterFrequencies(reader, begin, end)
+            : GetCharacterFrequencies(reader, begin, end);
+        file_table = BuildCodeTable(character_frequencies);
     }
 
-    /// Write the count of codes with the same length
-    for (const auto& [key, _] : canonical_codes)
+    // Write the range block by block into the same buffer, an empty file still has one block
+    reader.SetPosition(begin);
+    std::optional<CodeTable> previous_table;
+    std::vector<unsigned char> block;
+    size_t position = begin;
+    bool is_range_end = false;
+    while (!is_range_end)
     {
-        size_t current_code_length = key.first;
-        if (current_code_length != previous_code_length)
+        SetTraceBlock(position / std::max<size_t>(options_.block_size, 1));
+        reader.ReadCharacters(std::min(options_.block_size, end - position), block);
+        position += block.size();
+        is_range_end = block.empty() || position >= end;
+
+        EncodeBlock(block, is_range_end && end == file_size, file_table, previous_table, writer);
+
+        if (character_counts != nullptr)
         {
-            if (previous_code_length != 0)
+            for (auto character : block)
             {
-                // Write the count for the previous code length
-                writer.WriteHuffmanInt(count_of_codes_with_same_length);
-
-                // Write zero for any missing code lengths between the previous and current
-                for (size_t missing_length = previous_code_length + 1;
-                     missing_length < current_code_length;
-                     ++missing_length)
-                {
-                    writer.WriteHuffmanInt(0);
-                }
+                ++(*character_counts)[character];
             }
+        }
+    }
+}
 
-            previous_code_length = current_code_length;
-            count_of_codes_with_same_length = 0;
+EncodingStats HuffmanCoder::GetStats(const std::string& file_name,
+                                     uint64_t original_size,
+                                     uint64_t encoded_bits,
+                                     const CharacterCounts& character_counts) const
+{
+    EncodingStats stats { .file_name = file_name,
+                          .original_size = original_size,
+                          .encoded_bits = encoded_bits };
+
+    // Compare with a single block coded with the table built from the exact frequencies
+    auto exact_frequencies = GetTableFrequencies(character_counts, false);
+
+    // The file ends with FILENAME_END, its single block has no BLOCK_END
+    auto symbol_counts = exact_frequencies;
+    symbol_counts[BLOCK_END] = 0;
+
+    auto exact_table = BuildCodeTable(exact_frequencies);
+    uint64_t file_header_bits = 16 + 8 * file_name.size() + 64 + 32 + 8;
+    uint64_t block_type_bits = 9;
+    uint64_t block_bits = block_type_bits + CountTableBits(exact_table.code_lengths)
+        + *CountContentBits(exact_table.codes, symbol_counts);
+    stats.exact_table_bits = file_header_bits + (block_bits + 7) / 8 * 8;
+
+    return stats;
+}
+
+void HuffmanCoder::DecodeSharedTable(FileReader& reader)
+{
+    shared_code_ = RestoreTable(reader);
+}
+
+void HuffmanCoder::Decode(FileReader& reader, const std::string& output_directory) const
+{
+    auto [file_name, file_size, block_size, transforms] = RestoreFileHeader(reader);
+    SetTraceFile(file_name);
+
+    // The files of a directory are restored under it, but never outside of the output directory
+    std::filesystem::path file_path(file_name);
+    if (file_path.empty() || file_path.is_absolute() || file_path.has_root_name()
+        || std::find(file_path.begin(), file_path.end(), "..") != file_path.end())
+    {
+        throw std::runtime_error("Unsafe file name in the archive: " + file_name);
+    }
+    file_path = std::filesystem::path(output_directory) / file_path;
+    if (file_path.has_parent_path())
+    {
+        std::filesystem::create_directories(file_path.parent_path());
+    }
+    MappedFileWriter writer(
+        file_path.string(), file_size, options_.memory_limit > 0 ? MAPPED_WINDOW_SIZE : 0);
+
+    std::optional<CanonicalCode> previous_code;
+    std::vector<unsigned char> content;
+
+    // Decode the blocks until the size of the file is reached, even an empty file has one block
+    uint16_t block_end = BLOCK_END;
+    size_t block_index = 0;
+    do
+    {
+        SetTraceBlock(block_index++);
+        content.clear();
+        block_end = RestoreNextBlock(reader, content, previous_code, block_size);
+        if (content.size() > block_size)
+        {
+            throw std::runtime_error("The file " + file_name
+                                     + " has a block larger than its header says");
         }
+        writer.WriteCharacters(content);
+    } while (writer.GetBytesWritten() < file_size && block_end == BLOCK_END);
 
-        ++count_of_codes_with_same_length;
+    if (writer.GetBytesWritten() != file_size || block_end != FILENAME_END)
+    {
+        throw std::runtime_error("The file " + file_name
+                                 + " does not match its size in the archive");
     }
+}
 
-    /// Final write for the last group of codes
-    if (count_of_codes_with_same_length != 0)
+std::vector<unsigned char> HuffmanCoder::DecodeRange(FileReader& reader,
+                                                     uint64_t position,
+                                                     uint64_t begin,
+                                                     uint64_t end,
+                                                     size_t max_block_size) const
+{
+    if (begin < position)
     {
-        writer.WriteHuffmanInt(count_of_codes_with_same_length);
+        throw std::invalid_argument("The range starts before the sync point");
     }
 
-    // Reset the reader position to the start of the file
-    reader.ResetPositionToStart();
+    std::optional<CanonicalCode> previous_code;
+    std::vector<unsigned char> content;
+    std::vector<unsigned char> range;
 
-    // Write the file name
-    std::string file_name = reader.GetFileName();
-    for (const auto& character : file_name)
+    // Decode whole blocks and keep the part of each that falls into the range
+    uint16_t block_end = BLOCK_END;
+    while (position < end && block_end == BLOCK_END)
+    {
+        content.clear();
+        block_end = RestoreNextBlock(reader, content, previous_code, max_block_size);
+
+        uint64_t kept_begin = std::clamp<uint64_t>(begin, position, position + content.size());
+        uint64_t kept_end = std::clamp<uint64_t>(end, position, position + content.size());
+        range.insert(range.end(),
+                     content.begin() + static_cast<std::ptrdiff_t>(kept_begin - position),
+                     content.begin() + static_cast<std::ptrdiff_t>(kept_end - position));
+        position += content.size();
+    }
+    return range;
+}
+
+uint16_t HuffmanCoder::RestoreNextBlock(FileReader& reader,
+                                        std::vector<unsigned char>& content,
+                                        std::optional<CanonicalCode>& previous_code,
+                                        size_t max_block_size) const
+{
+    TraceScope trace_scope(TraceStage::Decode);
+    auto block_type = static_cast<BlockType>(reader.ReadHuffmanInt());
+    if (block_type != BlockType::Transformed)
+    {
+        uint16_t block_end
+            = RestoreBlock(block_type, reader, content, previous_code, max_block_size);
+        reader.AlignToByte();
+        return block_end;
+    }
+
+    uint16_t transforms = reader.ReadHuffmanInt();
+    auto inner_block_type = static_cast<BlockType>(reader.ReadHuffmanInt());
+    if (inner_block_type == BlockType::Transformed)
     {
-        auto it = canonical_codes_for_lookup.find(character);
-        if (it != canonical_codes_for_lookup.end())
+        throw std::runtime_error("The transformed block is transformed again");
+    }
+
+    // The transforms may take the block a little over its size
+    uint16_t block_end = RestoreBlock(inner_block_type,
+                                      reader,
+                                      content,
+                                      previous_code,
+                                      GetMaxTransformedSize(max_block_size));
+    reader.AlignToByte();
+    content = InvertTransforms(std::move(content), transforms, max_block_size);
+    return block_end;
+}
+
+CodeTable HuffmanCoder::BuildCodeTable(const CharacterFrequencies& character_frequencies) const
+{
+    std::vector<uint8_t> code_lengths(character_frequencies.size());
+    {
+        TraceScope trace_scope(TraceStage::TreeBuild);
+        size_t max_code_length = options_.max_code_length;
+        if (character_frequencies.size() <= FIRST_TOKEN)
+        {
+            CodeLengthWorkspace<FIRST_TOKEN> workspace;
+            BuildCodeLengths(character_frequencies, max_code_length, code_lengths, workspace);
+        }
+        else
         {
-            std::string canonical_code = it->second;
-            writer.WriteHuffmanCode(canonical_code);
+            AlphabetCodeLengthWorkspace workspace(character_frequencies.size());
+            BuildCodeLengths(character_frequencies, max_code_length, code_lengths, workspace);
         }
+
+        // The header lists the lengths up to the largest symbol with a code
+        auto last_code = std::find_if(
+            code_lengths.rbegin(), code_lengths.rend(), [](uint8_t length) { return length != 0; });
+        code_lengths.erase(last_code.base(), code_lengths.end());
     }
 
-    // Write the file content
-    while (reader.HasMoreCharacters())
+    TraceScope trace_scope(TraceStage::Canonicalize);
+    auto canonical_code = BuildCanonicalCode(code_lengths);
+
+    // Any character indexes the codes, even when the largest symbol with a code is below it
+    canonical_code.codes.resize(std::max(canonical_code.codes.size(), size_t { UINT8_MAX + 1 }));
+    return { .code_lengths = std::move(code_lengths), .codes = std::move(canonical_code.codes) };
+}
+
+CharacterFrequencies
+HuffmanCoder::GetCharacterFrequencies(FileReader& reader, size_t begin, size_t end) const
+{
+    TraceScope trace_scope(TraceStage::Histogram);
+    CharacterCounts counts {};
+
+    // Count the frequency of each character in the file content
+    end = std::min(end, reader.GetFileSize());
+    reader.SetPosition(begin);
+    std::vector<unsigned char> characters;
+    for (size_t position = begin; position < end;)
     {
-        auto character = reader.ReadCharacter();
-        if (character.has_value())
+        reader.ReadCharacters(std::min(options_.block_size, end - position), characters);
+        if (characters.empty())
         {
-            auto it = canonical_codes_for_lookup.find(*character);
-            if (it != canonical_codes_for_lookup.end())
+            break;
+        }
+        for (auto character : characters)
+        {
+            ++counts[character];
+        }
+        position += characters.size();
+    }
+    return GetTableFrequencies(counts, false);
+}
+
+CharacterFrequencies
+HuffmanCoder::SampleCharacterFrequencies(FileReader& reader, size_t begin, size_t end) const
+{
+    TraceScope trace_scope(TraceStage::Histogram);
+    end = std::min(end, reader.GetFileSize());
+    size_t range_size = end - begin;
+    size_t chunks_count = options_.sample_chunks_count;
+    size_t chunk_size = options_.sample_chunk_size;
+
+    // Sampling does not pay off if the chunks cover a large part of the range
+    if (chunks_count < 2 || chunks_count * chunk_size * 2 > range_size)
+    {
+        return GetCharacterFrequencies(reader, begin, end);
+    }
+
+    // Count the frequency of each character in the chunks, the first chunk starts at the
+    // beginning of the range and the last one ends at its end
+    CharacterCounts counts {};
+    size_t stride = (range_size - chunk_size) / (chunks_count - 1);
+    for (size_t i = 0; i < chunks_count; ++i)
+    {
+        reader.SetPosition(begin + i * stride);
+        for (auto character : reader.ReadCharacters(chunk_size))
+        {
+            ++counts[character];
+        }
+    }
+    return GetTableFrequencies(counts, true);
+}
+
+CharacterFrequencies HuffmanCoder::GetBlockFrequencies(const std::vector<unsigned char>& block,
+                                                       bool& is_sampled) const
+{
+    TraceScope trace_scope(TraceStage::Histogram);
+    size_t chunks_count = options_.sample_chunks_count;
+    size_t chunk_size = options_.sample_chunk_size;
+    bool is_sample_allowed = options_.frequency_mode == FrequencyMode::Sampled
+        || options_.table_scope == TableScope::Static;
+    is_sampled = is_sample_allowed && chunks_count >= 2
+        && chunks_count * chunk_size * 2 <= block.size();
+
+    CharacterCounts counts {};
+    if (is_sampled)
+    {
+        // Same chunks as for the whole file
+        size_t stride = (block.size() - chunk_size) / (chunks_count - 1);
+        for (size_t i = 0; i < chunks_count; ++i)
+        {
+            for (size_t j = i * stride; j < i * stride + chunk_size; ++j)
             {
-                std::string canonical_code = it->second;
-                writer.WriteHuffmanCode(canonical_code);
+                ++counts[block[j]];
             }
         }
     }
+    else
+    {
+        for (auto character : block)
+        {
+            ++counts[character];
+        }
+    }
+    return GetTableFrequencies(counts, is_sampled);
+}
 
-    // Write the end of the file
-    std::string end_of_file_code = canonical_codes_for_lookup.at(FILENAME_END);
-    writer.WriteHuffmanCode(end_of_file_code);
+uint64_t HuffmanCoder::CountTableBits(const std::vector<uint8_t>& code_lengths,
+                                      size_t symbol_bits) const
+{
+    std::vector<CodeLengthToken> tokens(code_lengths.size());
+    tokens.resize(TokenizeCodeLengths(code_lengths, tokens));
+    return CountCodeLengthsBits(BuildCodeLengthCode(code_lengths, tokens), tokens, symbol_bits);
+}
 
-    if (!is_last_file)
+std::optional<uint64_t>
+HuffmanCoder::CountContentBits(const SymbolCodes& codes,
+                               std::span<const uint64_t> symbol_counts) const
+{
+    uint64_t bits = 0;
+    for (size_t symbol = 0; symbol < symbol_counts.size(); ++symbol)
     {
-        // Write the start of the next file in the archive
-        std::string one_more_file_code = canonical_codes_for_lookup.at(ONE_MORE_FILE);
-        writer.WriteHuffmanCode(one_more_file_code);
+        if (symbol_counts[symbol] == 0)
+        {
+            continue;
+        }
+        if (symbol >= codes.size() || codes[symbol].second == 0)
+        {
+            return std::nullopt;
+        }
+        bits += codes[symbol].second * symbol_counts[symbol];
     }
-    else
+    return bits;
+}
+
+size_t HuffmanCoder::PickStaticTable(const CharacterFrequencies& symbol_counts,
+                                     uint64_t& coded_bits) const
+{
+    size_t best_table_index = 0;
+    coded_bits = UINT64_MAX;
+    for (size_t table_index = 0; table_index < GetStaticTablesCount(); ++table_index)
     {
-        // Write the end of the archive
-        std::string archive_end_code = canonical_codes_for_lookup.at(ARCHIVE_END);
-        writer.WriteHuffmanCode(archive_end_code);
+        const auto& table = GetStaticTable(table_index);
+        uint64_t bits = 8;
+        for (uint16_t symbol = 0; symbol < symbol_counts.size(); ++symbol)
+        {
+            if (symbol_counts[symbol] > 0)
+            {
+                bits += symbol_counts[symbol] * table.code_lengths[GetStaticSymbolIndex(symbol)];
+            }
+        }
+        if (bits < coded_bits)
+        {
+            best_table_index = table_index;
+            coded_bits = bits;
+        }
     }
+    return best_table_index;
+}
+
+void HuffmanCoder::WriteTable(const std::vector<uint8_t>& code_lengths,
+                              FileWriter& writer,
+                              size_t symbol_bits) const
+{
+    std::vector<CodeLengthToken> tokens(code_lengths.size());
+    tokens.resize(TokenizeCodeLengths(code_lengths, tokens));
+    WriteCodeLengths(BuildCodeLengthCode(code_lengths, tokens),
+                     tokens,
+                     code_lengths.size(),
+                     symbol_bits,
+                     [&writer](uint64_t number, size_t num_bits)
+                     { writer.WriteHuffmanInt(number, num_bits); });
 }
 
-bool HuffmanCoder::Decode(FileReader& reader) const
+std::optional<ContextTables>
+HuffmanCoder::BuildContextTables(const std::vector<unsigned char>& block,
+                                 uint64_t& coded_bits) const
 {
-    auto symbols_count = reader.ReadHuffmanInt();
-    auto symbols = RestoreSymbols(symbols_count, reader);
-    auto symbols_counts_with_same_code_lengths
-        = RestoreSymbolsCountsWithSameCodeLengths(symbols, reader);
-    BinaryTrie trie(symbols, symbols_counts_with_same_code_lengths);
+    using Histogram = std::array<uint64_t, UINT8_MAX + 1>;
+
+    // Count the characters following each character, the block starts in the context of zero
+    std::vector<Histogram> context_histograms(UINT8_MAX + 1);
+    unsigned char previous_character = 0;
+    for (auto character : block)
+    {
+        ++context_histograms[previous_character][character];
+        previous_character = character;
+    }
+
+    std::vector<std::pair<uint64_t, uint16_t>> context_counts; // (count, context)
+    for (uint16_t context = 0; context <= UINT8_MAX; ++context)
+    {
+        uint64_t count = 0;
+        for (auto frequency : context_histograms[context])
+        {
+            count += frequency;
+        }
+        if (count > 0)
+        {
+            context_counts.emplace_back(count, context);
+        }
+    }
+    std::sort(context_counts.rbegin(), context_counts.rend());
+
+    // Estimate the bits of a cluster as its entropy plus the header of its table, with the
+    // terminators and about a dozen code lengths
+    auto count_bits = [](const Histogram& histogram)
+    {
+        double total = 0;
+        double entropy = 0;
+        size_t symbols_count = 2;
+        for (auto frequency : histogram)
+        {
+            if (frequency > 0)
+            {
+                auto count = static_cast<double>(frequency);
+                total += count;
+                entropy -= count * std::log2(count);
+                ++symbols_count;
+            }
+        }
+        entropy += total > 0 ? total * std::log2(total) : 0.0;
+        return entropy + 9.0 * static_cast<double>(1 + symbols_count + 12);
+    };
+
+    // Start with a cluster per frequent context and put the rare ones into the last cluster, the
+    // smaller the block the fewer tables it can pay for
+    struct Cluster
+    {
+        Histogram histogram {};
+        std::vector<uint16_t> contexts;
+        double bits = 0;
+    };
+
+    size_t max_clusters_count = std::clamp<size_t>(block.size() / 1024, 2, 64);
+    std::vector<Cluster> clusters;
+    for (const auto& [_, context] : context_counts)
+    {
+        if (clusters.size() < max_clusters_count)
+        {
+            clusters.emplace_back();
+        }
 
-    std::string file_name = RestoreFileName(reader, trie);
-    FileWriter writer(file_name);
-    RestoreAndWriteContent(reader, writer, trie);
+        auto& cluster = clusters.back();
+        for (size_t character = 0; character <= UINT8_MAX; ++character)
+        {
+            cluster.histogram[character] += context_histograms[context][character];
+        }
+        cluster.contexts.push_back(context);
+    }
+    for (auto& cluster : clusters)
+    {
+        cluster.bits = count_bits(cluster.histogram);
+    }
+
+    // Keep the change of bits for merging each pair of clusters
+    auto merge_histograms = [](const Histogram& lhs, const Histogram& rhs)
+    {
+        Histogram merged;
+        for (size_t character = 0; character <= UINT8_MAX; ++character)
+        {
+            merged[character] = lhs[character] + rhs[character];
+        }
+        return merged;
+    };
+    auto count_merge_delta = [&](size_t i, size_t j)
+    {
+        auto merged = merge_histograms(clusters[i].histogram, clusters[j].histogram);
+        return count_bits(merged) - clusters[i].bits - clusters[j].bits;
+    };
+
+    size_t clusters_count = clusters.size();
+    std::vector<std::vector<double>> merge_deltas(clusters_count,
+                                                  std::vector<double>(clusters_count));
+    for (size_t i = 0; i < clusters_count; ++i)
+    {
+        for (size_t j = i + 1; j < clusters_count; ++j)
+        {
+            merge_deltas[i][j] = count_merge_delta(i, j);
+        }
+    }
 
-    bool need_to_decode_next_file = trie.GetCharacter(reader) == ONE_MORE_FILE;
-    return need_to_decode_next_file;
+    // Merge the pair that saves the most bits until no merge saves any
+    std::vector<bool> is_merged(clusters_count, false);
+    size_t alive_clusters_count = clusters_count;
+    while (alive_clusters_count > 1)
+    {
+        size_t best_i = 0;
+        size_t best_j = 0;
+        double best_delta = 0;
+        for (size_t i = 0; i < clusters_count; ++i)
+        {
+            for (size_t j = i + 1; j < clusters_count; ++j)
+            {
+                if (!is_merged[i] && !is_merged[j] && merge_deltas[i][j] < best_delta)
+                {
+                    best_i = i;
+                    best_j = j;
+                    best_delta = merge_deltas[i][j];
+                }
+            }
+        }
+        if (best_delta >= 0)
+        {
+            break;
+        }
+
+        auto& cluster = clusters[best_i];
+        cluster.histogram = merge_histograms(cluster.histogram, clusters[best_j].histogram);
+        cluster.contexts.insert(cluster.contexts.end(),
+                                clusters[best_j].contexts.begin(),
+                                clusters[best_j].contexts.end());
+        cluster.bits = count_bits(cluster.histogram);
+        is_merged[best_j] = true;
+        --alive_clusters_count;
+
+        for (size_t k = 0; k < clusters_count; ++k)
+        {
+            if (k != best_i && !is_merged[k])
+            {
+                merge_deltas[std::min(k, best_i)][std::max(k, best_i)]
+                    = count_merge_delta(std::min(k, best_i), std::max(k, best_i));
+            }
+        }
+    }
+
+    // A single cluster is the order-0 table
+    if (alive_clusters_count < 2)
+    {
+        return std::nullopt;
+    }
+
+    // Build a table per cluster, every table can end the block
+    ContextTables context_tables {};
+    std::vector<bool> is_context_used(UINT8_MAX + 1, false);
+    uint64_t content_bits = 0;
+    for (size_t i = 0; i < clusters_count; ++i)
+    {
+        if (is_merged[i])
+        {
+            continue;
+        }
+
+        const auto& histogram = clusters[i].histogram;
+        auto table = BuildCodeTable(GetTableFrequencies(histogram, false));
+        content_bits += *CountContentBits(table.codes, histogram);
+
+        for (auto context : clusters[i].contexts)
+        {
+            context_tables.context_map[context] = context_tables.tables.size();
+            is_context_used[context] = true;
+        }
+        context_tables.tables.push_back(std::move(table));
+    }
+
+    // Unused contexts take the table of the previous one to make the runs of the map longer
+    for (size_t context = 1; context <= UINT8_MAX; ++context)
+    {
+        if (!is_context_used[context])
+        {
+            context_tables.context_map[context] = context_tables.context_map[context - 1];
+        }
+    }
+
+    size_t index_bits = std::bit_width(context_tables.tables.size() - 1);
+    coded_bits = 9 + SplitContextMapIntoRuns(context_tables.context_map).size() * (index_bits + 8);
+    for (const auto& table : context_tables.tables)
+    {
+        coded_bits += CountTableBits(table.code_lengths);
+    }
+    coded_bits += content_bits;
+
+    return context_tables;
 }
 
-HuffmanCodes HuffmanCoder::BuildCodes(FileReader& reader) const
+std::vector<std::pair<uint16_t, size_t>>
+HuffmanCoder::SplitContextMapIntoRuns(const std::array<uint16_t, UINT8_MAX + 1>& context_map) const
 {
-    auto character_frequencies = GetCharacterFrequencies(reader);
-    BinaryTrie trie(character_frequencies);
+    std::vector<std::pair<uint16_t, size_t>> runs;
+    for (auto table_index : context_map)
+    {
+        if (runs.empty() || runs.back().first != table_index)
+        {
+            runs.emplace_back(table_index, 0);
+        }
+        ++runs.back().second;
+    }
+    return runs;
+}
 
-    HuffmanCodes codes;
-    auto root = trie.GetRoot();
-    GenerateHuffmanCodes(root, "", codes);
+void HuffmanCoder::WriteContextTables(const ContextTables& context_tables,
+                                      FileWriter& writer) const
+{
+    // Write the number of tables
+    writer.WriteHuffmanInt(context_tables.tables.size());
 
-    return codes;
+    // Write the context map as runs of the table index and the run length minus one
+    size_t index_bits = std::bit_width(context_tables.tables.size() - 1);
+    for (const auto& [table_index, run_length] :
+         SplitContextMapIntoRuns(context_tables.context_map))
+    {
+        writer.WriteHuffmanInt(table_index, index_bits);
+        writer.WriteHuffmanInt(run_length - 1, 8);
+    }
+
+    // Write the tables
+    for (const auto& table : context_tables.tables)
+    {
+        WriteTable(table.code_lengths, writer);
+    }
 }
 
-CharacterFrequencies HuffmanCoder::GetCharacterFrequencies(FileReader& reader) const
+std::optional<WordBlock> HuffmanCoder::BuildWordBlock(const std::vector<unsigned char>& block,
+                                                      uint64_t& coded_bits) const
 {
-    CharacterFrequencies frequency_table;
+    // Split the block into runs of word characters and runs of the other ones, a token is cut to
+    // fit its 8-bit length
+    auto is_word_character = [](char character)
+    {
+        return (character >= '0' && character <= '9') || (character >= 'A' && character <= 'Z')
+            || (character >= 'a' && character <= 'z');
+    };
+    std::string_view content(reinterpret_cast<const char*>(block.data()), block.size());
+    auto get_token = [&](size_t start)
+    {
+        bool is_word = is_word_character(content[start]);
+        size_t end = start + 1;
+        while (end < content.size() && end - start < UINT8_MAX
+               && is_word_character(content[end]) == is_word)
+        {
+            ++end;
+        }
+        return content.substr(start, end - start);
+    };
 
-    // Count the frequency of each character in the file name
-    auto file_name = reader.GetFileName();
-    for (const auto& character : file_name)
+    std::unordered_map<std::string_view, uint64_t> token_counts;
+    for (size_t position = 0; position < content.size();)
     {
-        ++frequency_table[static_cast<unsigned char>(character)];
+        auto token = get_token(position);
+        if (token.size() > 1)
+        {
+            ++token_counts[token];
+        }
+        position += token.size();
     }
 
-    // Count the frequency of each character in the file content
-    while (reader.HasMoreCharacters())
+    // Keep the tokens saving the most characters over spelling them out, minus their own
+    // characters and length in the dictionary
+    std::vector<std::pair<uint64_t, std::string_view>> token_gains; // (gain, token)
+    for (const auto& [token, count] : token_counts)
+    {
+        uint64_t saved_characters = count * (token.size() - 1);
+        if (saved_characters > token.size() + 1)
+        {
+            token_gains.emplace_back(saved_characters - token.size() - 1, token);
+        }
+    }
+    if (token_gains.empty())
+    {
+        return std::nullopt;
+    }
+
+    size_t tokens_count
+        = std::min({ token_gains.size(),
+                     options_.max_tokens_count,
+                     static_cast<size_t>(UINT16_MAX - FIRST_TOKEN + 1) });
+    std::partial_sort(token_gains.begin(),
+                      token_gains.begin() + tokens_count,
+                      token_gains.end(),
+                      [](const auto& lhs, const auto& rhs)
+                      {
+                          return std::tie(rhs.first, lhs.second)
+                              < std::tie(lhs.first, rhs.second);
+                      });
+
+    WordBlock word_block;
+    std::unordered_map<std::string_view, uint16_t> token_symbols;
+    for (size_t i = 0; i < tokens_count; ++i)
     {
-        auto character = reader.ReadCharacter();
-        if (character.has_value())
+        word_block.tokens.emplace_back(token_gains[i].second);
+        token_symbols.emplace(token_gains[i].second, FIRST_TOKEN + i);
+    }
+
+    // Replace the tokens of the dictionary with their symbols, the rest is spelled out
+    std::vector<uint64_t> counts(FIRST_TOKEN + tokens_count);
+    word_block.symbols.reserve(block.size());
+    for (size_t position = 0; position < content.size();)
+    {
+        auto token = get_token(position);
+        if (auto it = token_symbols.find(token); it != token_symbols.end())
         {
-            ++frequency_table[*character];
+            word_block.symbols.push_back(it->second);
+            ++counts[it->second];
         }
+        else
+        {
+            for (auto character : token)
+            {
+                word_block.symbols.push_back(static_cast<unsigned char>(character));
+                ++counts[static_cast<unsigned char>(character)];
+            }
+        }
+        position += token.size();
     }
 
-    // Add special codes to the frequency table
-    std::vector<uint16_t> special_codes = { ARCHIVE_END, FILENAME_END, ONE_MORE_FILE };
-    for (const auto& special_code : special_codes)
+    word_block.table = BuildCodeTable(GetTableFrequencies(counts, false));
+
+    size_t symbol_bits = std::bit_width<size_t>(FIRST_TOKEN + tokens_count - 1);
+    coded_bits = 16 + CountTableBits(word_block.table.code_lengths, symbol_bits)
+        + *CountContentBits(word_block.table.codes, counts);
+    for (const auto& token : word_block.tokens)
     {
-        ++frequency_table[special_code];
+        coded_bits += 8 * (1 + token.size());
     }
 
-    return frequency_table;
+    return word_block;
 }
 
-void HuffmanCoder::GenerateHuffmanCodes(const std::shared_ptr<Node>& node,
-                                        const std::string& code,
-                                        HuffmanCodes& codes) const
+void HuffmanCoder::WriteWordTables(const WordBlock& word_block, FileWriter& writer) const
 {
-    if (node == nullptr)
+    // Write the dictionary
+    writer.WriteHuffmanInt(word_block.tokens.size(), 16);
+    for (const auto& token : word_block.tokens)
+    {
+        writer.WriteHuffmanInt(token.size(), 8);
+        for (auto character : token)
+        {
+            writer.WriteHuffmanInt(static_cast<unsigned char>(character), 8);
+        }
+    }
+
+    // Write the table with symbols wide enough for the last token
+    size_t symbol_bits = std::bit_width<size_t>(FIRST_TOKEN + word_block.tokens.size() - 1);
+    WriteTable(word_block.table.code_lengths, writer, symbol_bits);
+}
+
+void HuffmanCoder::EncodeBlock(const std::vector<unsigned char>& block,
+                               bool is_last_block,
+                               const std::optional<CodeTable>& file_table,
+                               std::optional<CodeTable>& previous_table,
+                               FileWriter& writer) const
+{
+    TraceScope trace_scope(TraceStage::Encode);
+    WriteBlock(block, is_last_block, file_table, previous_table, writer);
+    writer.AlignToByte();
+}
+
+void HuffmanCoder::WriteBlock(const std::vector<unsigned char>& block,
+                              bool is_last_block,
+                              const std::optional<CodeTable>& file_table,
+                              std::optional<CodeTable>& previous_table,
+                              FileWriter& writer) const
+{
+
+    // Count the block only if its table, the pick of a built-in table or the stored block check
+    // needs it
+    bool is_sampled = false;
+    CharacterFrequencies block_frequencies;
+    if (options_.table_scope == TableScope::Block || options_.table_scope == TableScope::Static
+        || options_.stored_threshold > 0)
+    {
+        block_frequencies = GetBlockFrequencies(block, is_sampled);
+    }
+
+    // Scale the sampled counts up to the size of the block
+    uint64_t sampled_characters_count
+        = std::accumulate(block_frequencies.begin(), block_frequencies.end(), uint64_t { 0 });
+    auto scale_bits = [&](uint64_t bits)
+    { return is_sampled ? bits * block.size() / sampled_characters_count : bits; };
+    auto estimate_bits = [&](const CodeTable& table) -> std::optional<uint64_t>
     {
+        auto bits = CountContentBits(table.codes, block_frequencies);
+        if (!bits)
+        {
+            return bits;
+        }
+        return scale_bits(*bits);
+    };
+
+    // Pick the table of the block
+    BlockType block_type = BlockType::Huffman;
+    std::optional<CodeTable> own_table;
+    std::optional<ContextTables> context_tables;
+    std::optional<WordBlock> word_block;
+    std::vector<unsigned char> transformed_block;
+    bool is_transformed_ans = false;
+    size_t static_table_index = 0;
+    uint64_t static_bits = 0;
+    const CodeTable* table = nullptr;
+    std::optional<uint64_t> coded_bits;
+    switch (options_.table_scope)
+    {
+    case TableScope::Archive:
+        if (!shared_table_)
+        {
+            throw std::logic_error("The shared table should be encoded before the files");
+        }
+        block_type = BlockType::Shared;
+        table = &*shared_table_;
+        coded_bits = estimate_bits(*table);
+        break;
+
+    case TableScope::File:
+        block_type = previous_table ? BlockType::Repeat : BlockType::Huffman;
+        table = previous_table ? &*previous_table : &*file_table;
+        coded_bits = estimate_bits(*table);
+        if (block_type == BlockType::Huffman && coded_bits)
+        {
+            *coded_bits += CountTableBits(table->code_lengths);
+        }
+        break;
+
+    case TableScope::Static:
+        block_type = BlockType::Static;
+        static_table_index = PickStaticTable(block_frequencies, static_bits);
+        coded_bits = scale_bits(static_bits);
+        break;
+
+    case TableScope::Block:
+        own_table = BuildCodeTable(block_frequencies);
+        table = &*own_table;
+        coded_bits = *estimate_bits(*table) + CountTableBits(table->code_lengths);
+
+        // A sample cannot tell whether the previous table has codes for the whole block
+        if (previous_table && !is_sampled)
+        {
+            auto repeated_bits = estimate_bits(*previous_table);
+            if (repeated_bits && *repeated_bits <= *coded_bits)
+            {
+                block_type = BlockType::Repeat;
+                table = &*previous_table;
+                coded_bits = repeated_bits;
+            }
+        }
+
+        // A built-in table has no header, which pays off on small blocks
+        if (options_.static_tables)
+        {
+            static_table_index = PickStaticTable(block_frequencies, static_bits);
+            if (scale_bits(static_bits) < *coded_bits)
+            {
+                block_type = BlockType::Static;
+                coded_bits = scale_bits(static_bits);
+            }
+        }
+
+        // Fall back to order 0 if the order-1 tables do not pay for their headers
+        if (options_.order1_contexts && !is_sampled)
+        {
+            uint64_t context_bits = 0;
+            context_tables = BuildContextTables(block, context_bits);
+            if (context_tables && context_bits < *coded_bits)
+            {
+                block_type = BlockType::Context;
+                coded_bits = context_bits;
+            }
+        }
+
+        // Likewise for the words, whose dictionary is written with the block
+        if (options_.max_tokens_count > 0 && !is_sampled)
+        {
+            uint64_t word_bits = 0;
+            word_block = BuildWordBlock(block, word_bits);
+            if (word_block && word_bits < *coded_bits)
+            {
+                block_type = BlockType::Words;
+                coded_bits = word_bits;
+            }
+        }
+
+        // And for a table of the transformed block, with the transforms and the inner block type
+        bool is_transform_tried
+            = options_.transforms != 0 && !is_sampled && block.size() <= MAX_BWT_BLOCK_SIZE;
+        if (is_transform_tried)
+        {
+            transformed_block = ApplyTransforms(block, options_.transforms);
+
+            bool is_transformed_sampled = false;
+            auto transformed_frequencies
+                = GetBlockFrequencies(transformed_block, is_transformed_sampled);
+            auto transformed_table = BuildCodeTable(transformed_frequencies);
+            uint64_t transformed_bits = 9 + 9 + CountTableBits(transformed_table.code_lengths)
+                + *CountContentBits(transformed_table.codes, transformed_frequencies);
+            if (!is_transformed_sampled && transformed_bits < *coded_bits)
+            {
+                block_type = BlockType::Transformed;
+                own_table = std::move(transformed_table);
+                table = &*own_table;
+                coded_bits = transformed_bits;
+            }
+        }
+
+        // And for rANS in place of a table, of the block or of its transformed content
+        if (options_.ans_blocks && !is_sampled)
+        {
+            uint64_t ans_bits = CountAnsBlockBits(block);
+            if (ans_bits < *coded_bits)
+            {
+                block_type = BlockType::Ans;
+                coded_bits = ans_bits;
+            }
+
+            uint64_t transformed_ans_bits
+                = is_transform_tried ? 9 + 9 + CountAnsBlockBits(transformed_block) : UINT64_MAX;
+            if (transformed_ans_bits < *coded_bits)
+            {
+                block_type = BlockType::Transformed;
+                is_transformed_ans = true;
+                coded_bits = transformed_ans_bits;
+            }
+        }
+        break;
+    }
+
+    // Store the block as is if coding does not shrink it enough
+    uint64_t stored_bits = 8 * block.size();
+    if (options_.stored_threshold > 0 && coded_bits
+        && static_cast<double>(*coded_bits)
+            >= options_.stored_threshold * static_cast<double>(stored_bits))
+    {
+        block_type = BlockType::Stored;
+    }
+
+    uint16_t block_end = is_last_block ? FILENAME_END : BLOCK_END;
+    writer.WriteHuffmanInt(static_cast<uint16_t>(block_type));
+
+    if (block_type == BlockType::Stored)
+    {
+        writer.WriteHuffmanInt(block.size(), 32);
+        for (auto character : block)
+        {
+            writer.WriteHuffmanInt(character, 8);
+        }
+        writer.WriteHuffmanInt(block_end);
         return;
     }
 
-    if (node->left == nullptr && node->right == nullptr)
+    if (block_type == BlockType::Ans)
     {
-        codes.emplace(std::make_pair(code.size(), node->character), code);
+        WriteAnsBlock(block, block_end, writer);
+        return;
+    }
+
+    if (block_type == BlockType::Static)
+    {
+        writer.WriteHuffmanInt(static_table_index, 8);
+        const auto& static_table = GetStaticTable(static_table_index);
+        for (auto character : block)
+        {
+            writer.WriteHuffmanInt(static_table.reversed_codes[character],
+                                   static_table.code_lengths[character]);
+        }
+        size_t block_end_index = GetStaticSymbolIndex(block_end);
+        writer.WriteHuffmanInt(static_table.reversed_codes[block_end_index],
+                               static_table.code_lengths[block_end_index]);
         return;
     }
 
-    if (node->left != nullptr)
+    if (block_type == BlockType::Transformed && is_transformed_ans)
+    {
+        writer.WriteHuffmanInt(options_.transforms);
+        writer.WriteHuffmanInt(static_cast<uint16_t>(BlockType::Ans));
+        WriteAnsBlock(transformed_block, block_end, writer);
+        return;
+    }
+
+    if (block_type == BlockType::Context)
+    {
+        WriteContextTables(*context_tables, writer);
+
+        // Point every context to the codes of its table, so that switching tables is one lookup
+        std::array<const SymbolCodes*, UINT8_MAX + 1> codes_by_context {};
+        for (size_t context = 0; context <= UINT8_MAX; ++context)
+        {
+            codes_by_context[context]
+                = &context_tables->tables[context_tables->context_map[context]].codes;
+        }
+
+        // Write the block content
+        unsigned char previous_character = 0;
+        for (auto character : block)
+        {
+            auto [code_to_number, code_length] = (*codes_by_context[previous_character])[character];
+            writer.WriteHuffmanInt(code_to_number, code_length);
+            previous_character = character;
+        }
+
+        // Write the end of the block
+        const auto& last_table
+            = context_tables->tables[context_tables->context_map[previous_character]];
+        auto [end_code, end_code_length] = last_table.codes.at(block_end);
+        writer.WriteHuffmanInt(end_code, end_code_length);
+        return;
+    }
+
+    if (block_type == BlockType::Words)
+    {
+        WriteWordTables(*word_block, writer);
+
+        // Write the block content
+        const auto& word_table = word_block->table;
+        for (auto symbol : word_block->symbols)
+        {
+            auto [code_to_number, code_length] = word_table.codes[symbol];
+            writer.WriteHuffmanInt(code_to_number, code_length);
+        }
+
+        // Write the end of the block
+        auto [end_code, end_code_length] = word_table.codes.at(block_end);
+        writer.WriteHuffmanInt(end_code, end_code_length);
+        return;
+    }
+
+    // A transformed block goes on as a Huffman block of the transformed content
+    const std::vector<unsigned char>* content = &block;
+    if (block_type == BlockType::Transformed)
+    {
+        writer.WriteHuffmanInt(options_.transforms);
+        writer.WriteHuffmanInt(static_cast<uint16_t>(BlockType::Huffman));
+        block_type = BlockType::Huffman;
+        content = &transformed_block;
+    }
+
+    if (block_type == BlockType::Huffman)
+    {
+        WriteTable(table->code_lengths, writer);
+    }
+
+    // Write the block content two codes at a time, no code is longer than 32 bits
+    const auto& codes_by_character = table->codes;
+    auto get_code = [&codes_by_character](unsigned char character)
     {
-        GenerateHuffmanCodes(node->left, code + "0", codes);
+        const auto& code = codes_by_character[character];
+        if (code.second == 0)
+        {
+            throw std::logic_error("The code table misses a character of the block");
+        }
+        return code;
+    };
+    size_t paired_size = content->size() / 2 * 2;
+    for (size_t i = 0; i < paired_size; i += 2)
+    {
+        auto [code_to_number, code_length] = get_code((*content)[i]);
+        auto [next_code_to_number, next_code_length] = get_code((*content)[i + 1]);
+        writer.WriteHuffmanInt(code_to_number | next_code_to_number << code_length,
+                               code_length + next_code_length);
+    }
+    if (paired_size < content->size())
+    {
+        auto [code_to_number, code_length] = get_code(content->back());
+        writer.WriteHuffmanInt(code_to_number, code_length);
+    }
+
+    // Write the end of the block
+    auto [end_code, end_code_length] = table->codes.at(block_end);
+    writer.WriteHuffmanInt(end_code, end_code_length);
+
+    if (block_type == BlockType::Huffman)
+    {
+        if (own_table)
+        {
+            previous_table = std::move(own_table);
+        }
+        else
+        {
+            previous_table = file_table;
+        }
+    }
+}
+
+uint64_t HuffmanCoder::CountAnsBlockBits(const std::vector<unsigned char>& block) const
+{
+    CharacterCounts counts {};
+    for (auto character : block)
+    {
+        ++counts[character];
     }
+    auto frequencies = NormalizeAnsFrequencies(counts);
+
+    size_t characters_count = std::count_if(
+        frequencies.begin(), frequencies.end(), [](auto frequency) { return frequency > 0; });
+    uint64_t header_bits = 32 + 9 + characters_count * (8 + ANS_SCALE_BITS) + 32 + 7;
+    uint64_t code_bits = (CountAnsBits(counts, frequencies) + 7) / 8 * 8 + 2 * 32;
+    return header_bits + code_bits + 9;
+}
 
-    if (node->right != nullptr)
+void HuffmanCoder::WriteAnsBlock(const std::vector<unsigned char>& block,
+                                 uint16_t block_end,
+                                 FileWriter& writer) const
+{
+    CharacterCounts counts {};
+    for (auto character : block)
     {
-        GenerateHuffmanCodes(node->right, code + "1", codes);
+        ++counts[character];
     }
+    auto frequencies = NormalizeAnsFrequencies(counts);
+    auto code = EncodeAns(block, frequencies);
+
+    // The size, the scaled frequencies of the present characters and the code
+    writer.WriteHuffmanInt(block.size(), 32);
+    size_t characters_count = std::count_if(
+        frequencies.begin(), frequencies.end(), [](auto frequency) { return frequency > 0; });
+    writer.WriteHuffmanInt(characters_count);
+    for (uint16_t character = 0; character <= UINT8_MAX; ++character)
+    {
+        if (frequencies[character] > 0)
+        {
+            writer.WriteHuffmanInt(character, 8);
+            writer.WriteHuffmanInt(frequencies[character] - 1, ANS_SCALE_BITS);
+        }
+    }
+    // The code goes at a byte boundary, as a whole, since the block starts at one as well
+    writer.WriteHuffmanInt(code.size(), 32);
+    writer.AlignToByte();
+    writer.WriteCharacters(code);
+    writer.WriteHuffmanInt(block_end);
 }
 
-Symbols HuffmanCoder::RestoreSymbols(uint16_t symbols_count, FileReader& reader) const
+CanonicalCode HuffmanCoder::RestoreTable(FileReader& reader, size_t symbol_bits) const
 {
-    Symbols symbols(symbols_count);
-    for (size_t i = 0; i < symbols_count; ++i)
+    std::vector<uint8_t> code_lengths(size_t { 1 } << symbol_bits);
+    code_lengths.resize(ReadCodeLengths(
+        [&reader](size_t num_bits) { return reader.ReadHuffmanInt(num_bits); },
+        symbol_bits,
+        code_lengths));
+
+    TraceScope trace_scope(TraceStage::Canonicalize);
+    auto canonical_code = BuildCanonicalCode(code_lengths);
+    if (canonical_code.symbols.empty())
     {
-        uint16_t symbol = reader.ReadHuffmanInt();
-        symbols[i] = symbol;
+        throw std::runtime_error("The code table is empty");
     }
-    return symbols;
+    canonical_code.decoding_table
+        = BuildDecodingTable(std::span<const uint16_t>(canonical_code.symbols),
+                             std::span<const size_t>(canonical_code.length_counts));
+    return canonical_code;
 }
 
-std::vector<size_t> HuffmanCoder::RestoreSymbolsCountsWithSameCodeLengths(Symbols symbols,
-                                                                          FileReader& reader) const
+ContextCodes HuffmanCoder::RestoreContextTables(FileReader& reader) const
 {
-    std::vector<size_t> symbols_counts_with_same_code_lengths;
+    size_t tables_count = reader.ReadHuffmanInt();
+    if (tables_count == 0)
+    {
+        throw std::runtime_error("The order-1 block has no tables");
+    }
+
+    // Read the runs of the context map
+    ContextCodes context_codes {};
+    auto& context_map = context_codes.context_map;
+    size_t index_bits = std::bit_width(tables_count - 1);
+    size_t contexts_read = 0;
+    while (contexts_read <= UINT8_MAX)
+    {
+        uint16_t table_index = reader.ReadHuffmanInt(index_bits);
+        size_t run_length = reader.ReadHuffmanInt(8) + 1;
+        if (table_index >= tables_count || contexts_read + run_length > UINT8_MAX + 1)
+        {
+            throw std::runtime_error("The context map of the order-1 block is corrupted");
+        }
+
+        std::fill_n(context_map.begin() + contexts_read, run_length, table_index);
+        contexts_read += run_length;
+    }
 
-    size_t symbols_read = 0;
-    while (symbols_read < symbols.size())
+    for (size_t i = 0; i < tables_count; ++i)
     {
-        uint16_t count_of_symbols_with_specific_code_length = reader.ReadHuffmanInt();
-        symbols_counts_with_same_code_lengths.push_back(count_of_symbols_with_specific_code_length);
-        symbols_read += count_of_symbols_with_specific_code_length;
+        context_codes.codes.push_back(RestoreTable(reader));
     }
+    return context_codes;
+}
 
-    return symbols_counts_with_same_code_lengths;
+FileHeader HuffmanCoder::RestoreFileHeader(FileReader& reader) const
+{
+    FileHeader header;
+    size_t file_name_size = reader.ReadHuffmanInt(16);
+    for (size_t i = 0; i < file_name_size; ++i)
+    {
+        header.file_name += static_cast<char>(reader.ReadHuffmanInt(8));
+    }
+    header.file_size = reader.ReadHuffmanInt(64);
+    header.block_size = reader.ReadHuffmanInt(32);
+    header.transforms = reader.ReadHuffmanInt(8);
+    if ((header.transforms & ~ALL_TRANSFORMS) != 0)
+    {
+        throw std::runtime_error("Unknown block transform in the header of " + header.file_name);
+    }
+    return header;
 }
 
-std::string HuffmanCoder::RestoreFileName(FileReader& reader, BinaryTrie& trie) const
+uint16_t HuffmanCoder::RestoreBlock(BlockType block_type,
+                                    FileReader& reader,
+                                    std::vector<unsigned char>& content,
+                                    std::optional<CanonicalCode>& previous_code,
+                                    size_t max_block_size) const
 {
-    std::string file_name;
-    while (!file_name.ends_with(".txt"))
+    switch (block_type)
     {
-        file_name += trie.GetCharacter(reader);
+    case BlockType::Huffman:
+        previous_code = RestoreTable(reader);
+        return RestoreContent(reader, content, *previous_code);
+
+    case BlockType::Repeat:
+        if (!previous_code)
+        {
+            throw std::runtime_error("The block repeats a missing table");
+        }
+        return RestoreContent(reader, content, *previous_code);
+
+    case BlockType::Shared:
+        if (!shared_code_)
+        {
+            throw std::runtime_error("The block refers to a missing shared table");
+        }
+        return RestoreContent(reader, content, *shared_code_);
+
+    case BlockType::Stored:
+        return RestoreStoredContent(reader, content, max_block_size);
+
+    case BlockType::Context:
+        return RestoreContextContent(reader, content, RestoreContextTables(reader));
+
+    case BlockType::Words:
+        return RestoreWordContent(reader, content);
+
+    case BlockType::Ans:
+        return RestoreAnsContent(reader, content, max_block_size);
+
+    case BlockType::Static:
+        return RestoreStaticContent(reader, content);
+
+    default:
+        throw std::runtime_error("Unknown block type in the archive");
     }
-    return file_name;
 }
 
-void HuffmanCoder::RestoreAndWriteContent(FileReader& reader,
-                                          FileWriter& writer,
-                                          BinaryTrie& trie) const
+uint16_t HuffmanCoder::RestoreContent(FileReader& reader,
+                                      std::vector<unsigned char>& content,
+                                      const CanonicalCode& code) const
 {
-    while (auto symbol = trie.GetCharacter(reader))
+    while (true)
     {
-        if (symbol == FILENAME_END)
+        auto symbol = DecodeSymbol(code, reader);
+        if (symbol == FILENAME_END || symbol == BLOCK_END)
         {
-            break;
+            return symbol;
+        }
+        if (symbol > UINT8_MAX)
+        {
+            throw std::runtime_error("Unexpected control code in the block content");
         }
-        writer.WriteCharacter(static_cast<char>(symbol));
+        content.push_back(symbol);
     }
 }
+
+uint16_t HuffmanCoder::RestoreContextContent(FileReader& reader,
+                                             std::vector<unsigned char>& content,
+                                             const ContextCodes& codes) const
+{
+    unsigned char previous_character = 0;
+    while (true)
+    {
+        const auto& code = codes.codes[codes.context_map[previous_character]];
+        auto symbol = DecodeSymbol(code, reader);
+        if (symbol == FILENAME_END || symbol == BLOCK_END)
+        {
+            return symbol;
+        }
+        if (symbol > UINT8_MAX)
+        {
+            throw std::runtime_error("Unexpected control code in the block content");
+        }
+        content.push_back(symbol);
+        previous_character = symbol;
+    }
+}
+
+uint16_t HuffmanCoder::RestoreWordContent(FileReader& reader,
+                                          std::vector<unsigned char>& content) const
+{
+    size_t tokens_count = reader.ReadHuffmanInt(16);
+    if (tokens_count == 0 || FIRST_TOKEN + tokens_count - 1 > UINT16_MAX)
+    {
+        throw std::runtime_error("The dictionary of the word block is corrupted");
+    }
+
+    std::vector<std::string> tokens(tokens_count);
+    for (auto& token : tokens)
+    {
+        size_t token_size = reader.ReadHuffmanInt(8);
+        for (size_t i = 0; i < token_size; ++i)
+        {
+            token += static_cast<char>(reader.ReadHuffmanInt(8));
+        }
+    }
+
+    size_t symbol_bits = std::bit_width<size_t>(FIRST_TOKEN + tokens_count - 1);
+    auto code = RestoreTable(reader, symbol_bits);
+
+    while (true)
+    {
+        auto symbol = DecodeSymbol(code, reader);
+        if (symbol == FILENAME_END || symbol == BLOCK_END)
+        {
+            return symbol;
+        }
+        if (symbol <= UINT8_MAX)
+        {
+            content.push_back(symbol);
+        }
+        else if (symbol >= FIRST_TOKEN && static_cast<size_t>(symbol - FIRST_TOKEN) < tokens_count)
+        {
+            const auto& token = tokens[symbol - FIRST_TOKEN];
+            content.insert(content.end(), token.begin(), token.end());
+        }
+        else
+        {
+            throw std::runtime_error("Unexpected control code in the block content");
+        }
+    }
+}
+
+uint16_t HuffmanCoder::RestoreStoredContent(FileReader& reader,
+                                            std::vector<unsigned char>& content,
+                                            size_t max_block_size) const
+{
+    size_t block_size = reader.ReadHuffmanInt(32);
+    if (block_size > max_block_size)
+    {
+        throw std::runtime_error("The stored block is larger than its file header says");
+    }
+    for (size_t i = 0; i < block_size; ++i)
+    {
+        content.push_back(reader.ReadHuffmanInt(8));
+    }
+    return reader.ReadHuffmanInt();
+}
+
+uint16_t HuffmanCoder::RestoreStaticContent(FileReader& reader,
+                                            std::vector<unsigned char>& content) const
+{
+    size_t table_index = reader.ReadHuffmanInt(8);
+    const auto& table = GetStaticTable(table_index);
+    const auto& decoding_table = GetStaticDecodingTable(table_index);
+    while (true)
+    {
+        auto symbol = DecodeTableSymbol(decoding_table,
+                                        std::span<const uint16_t>(table.symbols),
+                                        std::span<const uint16_t>(table.length_counts),
+                                        reader);
+        if (!symbol)
+        {
+            throw std::runtime_error("The block has a code missing from its built-in table");
+        }
+        if (*symbol == FILENAME_END || *symbol == BLOCK_END)
+        {
+            return *symbol;
+        }
+        content.push_back(static_cast<unsigned char>(*symbol));
+    }
+}
+
+uint16_t HuffmanCoder::RestoreAnsContent(FileReader& reader,
+                                         std::vector<unsigned char>& content,
+                                         size_t max_block_size) const
+{
+    size_t block_size = reader.ReadHuffmanInt(32);
+    if (block_size > max_block_size)
+    {
+        throw std::runtime_error("The rANS block is larger than its file header says");
+    }
+
+    AnsFrequencies frequencies {};
+    size_t characters_count = reader.ReadHuffmanInt();
+    if (characters_count > UINT8_MAX + 1)
+    {
+        throw std::runtime_error("The rANS block has too many characters");
+    }
+    for (size_t i = 0; i < characters_count; ++i)
+    {
+        auto character = reader.ReadHuffmanInt(8);
+        frequencies[character] = reader.ReadHuffmanInt(ANS_SCALE_BITS) + 1;
+    }
+
+    // A character takes at most ANS_SCALE_BITS bits, two bytes, after the two 32-bit states
+    size_t code_size = reader.ReadHuffmanInt(32);
+    if (code_size > reader.GetFileSize() || code_size > block_size * 2 + 8)
+    {
+        throw std::runtime_error("The rANS code is longer than its block allows");
+    }
+    reader.AlignToByte();
+    auto code = reader.ReadCharacters(code_size);
+    if (code.size() != code_size)
+    {
+        throw std::runtime_error("The rANS code is truncated");
+    }
+
+    auto block = DecodeAns(code, frequencies, block_size);
+    content.insert(content.end(), block.begin(), block.end());
+    return reader.ReadHuffmanInt();
+}
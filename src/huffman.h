@@ -1,13 +1,14 @@
 #pragma once
 
+#include "canonicalcode.h"
 #include "filereader.h"
 #include "filewriter.h"
-#include "trie.h"
+#include "transform.h"
 
-#include <map>
-#include <memory>
+#include <array>
+#include <optional>
+#include <span>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 /*
@@ -16,22 +17,168 @@
 constexpr uint16_t FILENAME_END = 256;
 constexpr uint16_t ONE_MORE_FILE = 257;
 constexpr uint16_t ARCHIVE_END = 258;
+constexpr uint16_t BLOCK_END = 259;
+constexpr uint16_t SHARED_TABLE = 260;
 
 /*
- * Type for the Huffman codes.
+ * First symbol of the word dictionary of a block, the symbols below keep their 9-bit meaning.
  */
-using HuffmanKey = std::pair<size_t, uint16_t>; // (code length, character)
+constexpr uint16_t FIRST_TOKEN = 512;
 
-struct HuffmanKeyCompare
+/*
+ * Compression levels.
+ */
+constexpr int MIN_LEVEL = 1;
+constexpr int MAX_LEVEL = 9;
+constexpr int DEFAULT_LEVEL = 6;
+
+/*
+ * Number of times each symbol occurs, indexed by symbol.
+ */
+using CharacterFrequencies = std::vector<uint64_t>;
+
+/*
+ * Symbols of a block in their order.
+ */
+using Symbols = std::vector<uint16_t>;
+
+/*
+ * Codes of the symbols as numbers with the first bit of the code in the LSB, and their lengths,
+ * indexed by symbol. A zero length means the symbol has no code.
+ */
+using SymbolCodes = std::vector<std::pair<uint64_t, size_t>>;
+
+/*
+ * Canonical Huffman codes indexed by symbol.
+ */
+struct CodeTable
 {
-    bool operator()(const HuffmanKey& lhs, const HuffmanKey& rhs) const
-    {
-        return std::tie(lhs.first, lhs.second) < std::tie(rhs.first, rhs.second);
-    }
+    std::vector<uint8_t> code_lengths; // up to the largest symbol with a code, as in the header
+    SymbolCodes codes; // indexed as the code lengths
 };
 
-using HuffmanCodes = std::map<HuffmanKey, std::string, HuffmanKeyCompare>;
-using HuffmanCodesForLookup = std::unordered_map<uint16_t, std::string>;
+/*
+ * Number of times each character occurs.
+ */
+using CharacterCounts = std::array<uint64_t, UINT8_MAX + 1>;
+
+/*
+ * Code tables of an order-1 block, the previous character selects the table of the next one.
+ */
+struct ContextTables
+{
+    std::array<uint16_t, UINT8_MAX + 1> context_map; // the table index of each previous character
+    std::vector<CodeTable> tables;
+};
+
+/*
+ * Canonical codes of an order-1 block for decoding, the previous character selects the code of
+ * the next one.
+ */
+struct ContextCodes
+{
+    std::array<uint16_t, UINT8_MAX + 1> context_map; // the code index of each previous character
+    std::vector<CanonicalCode> codes;
+};
+
+/*
+ * Block parsed into the words and separators of its dictionary and single characters.
+ */
+struct WordBlock
+{
+    std::vector<std::string> tokens; // the i-th token is the symbol FIRST_TOKEN + i
+    Symbols symbols; // the block content, without the end of the block
+    CodeTable table;
+};
+
+/*
+ * Type of a block, written in front of it.
+ */
+enum class BlockType : uint16_t
+{
+    Huffman = 0, // the block has its own code table
+    Repeat = 1, // the block reuses the table of the previous block of the file
+    Shared = 2, // the block uses the shared table of the archive
+    Stored = 3, // the block is stored as is
+    Context = 4, // the block has its own code tables selected by the previous character
+    Words = 5, // the block has its own word dictionary and a code table of characters and words
+    Transformed = 6, // the block is transformed and written as one of the other blocks
+    Ans = 7, // the block is coded with rANS and its own scaled frequencies
+    Static = 8, // the block uses a built-in table given by its index
+};
+
+/*
+ * Strategy for building the character frequencies of a file.
+ */
+enum class FrequencyMode
+{
+    Exact, // count every character in a separate pass over the file
+    Sampled, // count evenly spaced chunks of the file and smooth the rest
+};
+
+/*
+ * Set of data described by one code table.
+ */
+enum class TableScope
+{
+    Archive, // one table for all files, written once in front of them
+    File, // one table per file, later blocks repeat it
+    Block, // one table per block, unless repeating the previous one is cheaper
+    Static, // a built-in table per block picked from a sample, no table is built
+};
+
+/*
+ * Options of the Huffman encoder.
+ */
+struct EncodingOptions
+{
+    FrequencyMode frequency_mode = FrequencyMode::Exact;
+    size_t sample_chunks_count = 64;
+    size_t sample_chunk_size = 4096;
+    TableScope table_scope = TableScope::Block;
+    size_t block_size = 1 << 20; // in bytes
+    size_t max_code_length = 15; // 9 to 32 bits, so that every symbol fits and two codes fit a word
+    double stored_threshold = 1.0; // store a block if coding does not shrink it below this ratio
+    bool order1_contexts = false; // try tables selected by the previous character, block scope only
+    size_t max_tokens_count = 0; // try a dictionary of words and separators, block scope only
+    uint16_t transforms = 0; // Transform flags tried in front of a block table, block scope only
+    bool ans_blocks = false; // try rANS instead of a code table, block scope only
+    bool static_tables = false; // try the built-in tables, block scope only
+    bool collect_stats = false;
+    size_t threads_count = 1; // threads encoding or decoding the files of an archive
+    size_t sync_interval = 4 << 20; // bytes between the sync points of a file, whole blocks
+    std::string cache_directory {}; // reuse the files encoded by earlier archives, empty to disable
+    size_t memory_limit = 0; // bytes of the process, the blocks and threads fit to it, 0 for none
+};
+
+/*
+ * Get the encoder options of a compression level.
+ * @param level The compression level from MIN_LEVEL (fastest) to MAX_LEVEL (smallest).
+ * @return The encoder options.
+ */
+EncodingOptions GetLevelOptions(int level);
+
+/*
+ * Header of a file in the archive, in front of its blocks.
+ */
+struct FileHeader
+{
+    std::string file_name;
+    uint64_t file_size = 0; // in bytes
+    uint64_t block_size = 0; // the largest block of the file, which bounds its decoding memory
+    uint16_t transforms = 0; // Transform flags the blocks of the file may use
+};
+
+/*
+ * Statistics of an encoded file.
+ */
+struct EncodingStats
+{
+    std::string file_name;
+    uint64_t original_size = 0; // in bytes
+    uint64_t encoded_bits = 0; // file name, headers and content bits written
+    uint64_t exact_table_bits = 0; // bits a single exact frequency table would have taken
+};
 
 /*
  * Class to encode the file using Huffman coding algorithm.
@@ -40,82 +187,373 @@ class HuffmanCoder
 {
 public:
     /*
-     * Move the generated codes to the canonical form.
-     * @param codes The generated codes
-     * @return The canonical Huffman codes and the codes for fast lookup
+     * Constructor.
+     * @param options The encoder options.
      */
-    std::tuple<HuffmanCodes, HuffmanCodesForLookup>
-    MoveCodesToCanonicalForm(HuffmanCodes codes) const;
+    explicit HuffmanCoder(const EncodingOptions& options = {});
+
+    /*
+     * Count the characters of a file towards the shared table of the archive.
+     * @param reader The file reader.
+     */
+    void CountSharedFrequencies(FileReader& reader);
+
+    /*
+     * Build the shared table of the archive from the counted files and write it.
+     * @param writer The file writer.
+     */
+    void EncodeSharedTable(FileWriter& writer);
 
     /*
      * Encode the file using Huffman coding algorithm.
      * @param reader The file reader.
      * @param writer The file writer.
-     * @param is_last_file Is this the last file in the archive.
+     * @return The statistics of the encoded file, filled in only if requested in the options.
+     */
+    EncodingStats Encode(FileReader& reader, FileWriter& writer) const;
+
+    /*
+     * Write the name and the size of a file in front of its blocks, then the largest block and
+     * the transforms the options may give its blocks.
+     * @param file_name The file name.
+     * @param file_size The size of the file in bytes.
+     * @param writer The file writer.
+     */
+    void
+    EncodeFileHeader(const std::string& file_name, uint64_t file_size, FileWriter& writer) const;
+
+    /*
+     * Encode a range of the file block by block. The range has its own file table and its blocks
+     * do not repeat the tables of the blocks in front of it, hence ranges can be encoded
+     * independently and written one after another. The block at the end of the file ends it.
+     * @param reader The file reader.
+     * @param begin The offset of the range in bytes.
+     * @param end The offset past the range in bytes.
+     * @param writer The file writer.
+     * @param character_counts If not null, the counts of the characters of the range are added.
+     */
+    void EncodeRange(FileReader& reader,
+                     size_t begin,
+                     size_t end,
+                     FileWriter& writer,
+                     CharacterCounts* character_counts) const;
+
+    /*
+     * Get the statistics of an encoded file.
+     * @param file_name The file name.
+     * @param original_size The size of the file in bytes.
+     * @param encoded_bits The number of bits written for the file.
+     * @param character_counts The counts of the characters of the file.
+     * @return The statistics.
+     */
+    EncodingStats GetStats(const std::string& file_name,
+                           uint64_t original_size,
+                           uint64_t encoded_bits,
+                           const CharacterCounts& character_counts) const;
+
+    /*
+     * Read the shared table of the archive.
+     * @param reader The file reader.
      */
-    void Encode(FileReader& reader, FileWriter& writer, bool is_last_file = false) const;
+    void DecodeSharedTable(FileReader& reader);
 
     /*
      * Decode the file using Huffman coding algorithm.
      * @param reader The file reader.
-     * @return True if there are more files to decode, false otherwise.
+     * @param output_directory The directory the file is restored under, the current one if empty.
+     * Under a memory limit only the last bytes written stay mapped.
+     */
+    void Decode(FileReader& reader, const std::string& output_directory = {}) const;
+
+    /*
+     * Restore the header of a file from the encoded file.
+     * @param reader The file reader, at the header.
+     * @return The file header.
      */
-    bool Decode(FileReader& reader) const;
+    FileHeader RestoreFileHeader(FileReader& reader) const;
+
+    /*
+     * Decode a range of a file starting from one of its sync points, where the blocks do not
+     * depend on the blocks in front of them.
+     * @param reader The file reader, set to the first block after the sync point.
+     * @param position The offset of the sync point in the file in bytes.
+     * @param begin The offset of the range in bytes, not before the sync point.
+     * @param end The offset past the range in bytes.
+     * @param max_block_size The size of the largest block of the file, from its header.
+     * @return The content of the range, shorter if the file ends before the range does.
+     */
+    std::vector<unsigned char> DecodeRange(FileReader& reader,
+                                           uint64_t position,
+                                           uint64_t begin,
+                                           uint64_t end,
+                                           size_t max_block_size) const;
 
 protected:
     /*
-     * Build the canonical Huffman codes.
-     * @param reader The file reader.
+     * Build the canonical Huffman codes limited to the maximum code length.
+     * @param character_frequencies The character frequencies.
+     * @return The canonical Huffman codes.
      */
-    HuffmanCodes BuildCodes(FileReader& reader) const;
+    CodeTable BuildCodeTable(const CharacterFrequencies& character_frequencies) const;
 
     /*
      * Get the character frequencies from the file.
      * @param reader The file reader.
+     * @param begin The offset to count from in bytes.
+     * @param end The offset to count up to in bytes, the end of the file by default.
+     * @return The character frequencies.
+     */
+    CharacterFrequencies GetCharacterFrequencies(FileReader& reader,
+                                                 size_t begin = 0,
+                                                 size_t end = SIZE_MAX) const;
+
+    /*
+     * Estimate the character frequencies from evenly spaced chunks of the file.
+     * Every byte value gets an escape count so that characters missed by the sample still
+     * have a code. Small files are counted exactly.
+     * @param reader The file reader.
+     * @param begin The offset to sample from in bytes.
+     * @param end The offset to sample up to in bytes, the end of the file by default.
+     * @return The estimated character frequencies.
+     */
+    CharacterFrequencies SampleCharacterFrequencies(FileReader& reader,
+                                                    size_t begin = 0,
+                                                    size_t end = SIZE_MAX) const;
+
+    /*
+     * Get the character frequencies of a block, exact or sampled depending on the options.
+     * @param block The block content.
+     * @param is_sampled Set to true if the frequencies are estimated from a sample.
      * @return The character frequencies.
      */
-    CharacterFrequencies GetCharacterFrequencies(FileReader& reader) const;
+    CharacterFrequencies GetBlockFrequencies(const std::vector<unsigned char>& block,
+                                             bool& is_sampled) const;
 
     /*
-     * Generate the Huffman codes using recursive traversal of the Huffman binary trie.
-     * @param node The current node in the Huffman binary trie
-     * @param code The current code
-     * @param codes The generated codes
+     * Count the number of bits the table header takes.
+     * @param code_lengths The code length of each symbol, zero for the symbols without a code.
+     * @param symbol_bits The width of the symbols in the header.
+     * @return The number of bits.
      */
-    void GenerateHuffmanCodes(const std::shared_ptr<Node>& node,
-                              const std::string& code,
-                              HuffmanCodes& codes) const;
+    uint64_t CountTableBits(const std::vector<uint8_t>& code_lengths, size_t symbol_bits = 9) const;
 
     /*
-     * Get the symbols from the encoded file.
-     * @param symbols_count The number of symbols to read.
-     * @param reader The file reader to read the symbols from the encoded file.
-     * @return The symbols read from the file.
+     * Count the number of bits the given symbols take with the codes.
+     * @param codes The codes of the symbols.
+     * @param symbol_counts How many times each symbol is written.
+     * @return The number of bits, or std::nullopt if some symbol has no code.
      */
-    Symbols RestoreSymbols(uint16_t symbols_count, FileReader& reader) const;
+    std::optional<uint64_t> CountContentBits(const SymbolCodes& codes,
+                                             std::span<const uint64_t> symbol_counts) const;
 
     /*
-     * Get the symbol counts with the same code lengths from the encoded file.
-     * @param symbols The symbols to get the codes for.
-     * @param reader The file reader to read the counts from the encoded file.
-     * @return The counts of symbols with the same code lengths.
+     * Pick the built-in table that codes the symbols into the fewest bits.
+     * @param symbol_counts How many times each character, FILENAME_END and BLOCK_END is written.
+     * @param coded_bits Set to the number of bits the table index and the symbols take.
+     * @return The index of the table.
+     */
+    size_t PickStaticTable(const CharacterFrequencies& symbol_counts, uint64_t& coded_bits) const;
+
+    /*
+     * Write the code table header.
+     * @param code_lengths The code length of each symbol, zero for the symbols without a code.
+     * @param writer The file writer.
+     * @param symbol_bits The width of the symbols in the header.
      */
-    std::vector<size_t> RestoreSymbolsCountsWithSameCodeLengths(Symbols symbols,
-                                                                FileReader& reader) const;
+    void WriteTable(const std::vector<uint8_t>& code_lengths,
+                    FileWriter& writer,
+                    size_t symbol_bits = 9) const;
 
     /*
-     * Restore the file name from the encoded file.
-     * @param reader The file reader to read the file name from the encoded file.
-     * @param trie The trie to use for decoding the file name.
-     * @return The file name.
+     * Build order-1 code tables: contexts with similar statistics are clustered until merging
+     * two clusters stops saving more than a table header costs.
+     * @param block The block content.
+     * @param coded_bits Set to the number of bits the tables and the content take.
+     * @return The tables, or std::nullopt if a single table is as good.
+     */
+    std::optional<ContextTables> BuildContextTables(const std::vector<unsigned char>& block,
+                                                    uint64_t& coded_bits) const;
+
+    /*
+     * Split the context map into runs of contexts sharing a table.
+     * @param context_map The table index of each previous character.
+     * @return The table index and the length of each run.
+     */
+    std::vector<std::pair<uint16_t, size_t>>
+    SplitContextMapIntoRuns(const std::array<uint16_t, UINT8_MAX + 1>& context_map) const;
+
+    /*
+     * Write the header of an order-1 block: the tables count, the context map and the tables.
+     * @param context_tables The code tables of the block.
+     * @param writer The file writer.
+     */
+    void WriteContextTables(const ContextTables& context_tables, FileWriter& writer) const;
+
+    /*
+     * Parse the block into its most profitable words and separators and build their code table.
+     * Words are runs of ASCII letters and digits, separators are runs of the other characters.
+     * @param block The block content.
+     * @param coded_bits Set to the number of bits the dictionary, the table and the content take.
+     * @return The parsed block, or std::nullopt if no token repeats.
+     */
+    std::optional<WordBlock> BuildWordBlock(const std::vector<unsigned char>& block,
+                                            uint64_t& coded_bits) const;
+
+    /*
+     * Write the header of a word block: the dictionary and the table.
+     * @param word_block The parsed block.
+     * @param writer The file writer.
+     */
+    void WriteWordTables(const WordBlock& word_block, FileWriter& writer) const;
+
+    /*
+     * Count the bits of the block coded with rANS, the header included.
+     * @param block The block content.
+     * @return The number of bits.
+     */
+    uint64_t CountAnsBlockBits(const std::vector<unsigned char>& block) const;
+
+    /*
+     * Write an rANS-coded block after its type.
+     * @param block The block content.
+     * @param block_end The symbol that ends the block.
+     * @param writer The file writer.
      */
-    std::string RestoreFileName(FileReader& reader, BinaryTrie& trie) const;
+    void WriteAnsBlock(const std::vector<unsigned char>& block,
+                       uint16_t block_end,
+                       FileWriter& writer) const;
 
     /*
-     * Restore the content of the file from the encoded file and write it to the output file.
+     * Write one block of the file, padded to a byte boundary: the segments encoded apart then
+     * append whole bytes, and the rANS code of a block is aligned in the archive as well.
+     * @param block The block content.
+     * @param is_last_block Is this the last block of the file.
+     * @param file_table The table of the file, built for the file scope only.
+     * @param previous_table The table of the previous block of the file, updated by the call.
+     * @param writer The file writer.
+     */
+    void EncodeBlock(const std::vector<unsigned char>& block,
+                     bool is_last_block,
+                     const std::optional<CodeTable>& file_table,
+                     std::optional<CodeTable>& previous_table,
+                     FileWriter& writer) const;
+
+    /*
+     * Write one block of the file up to the symbol that ends it, see EncodeBlock.
+     */
+    void WriteBlock(const std::vector<unsigned char>& block,
+                    bool is_last_block,
+                    const std::optional<CodeTable>& file_table,
+                    std::optional<CodeTable>& previous_table,
+                    FileWriter& writer) const;
+
+    /*
+     * Read the code table header and build its canonical code for decoding.
+     * @param reader The file reader.
+     * @param symbol_bits The width of the symbols in the header.
+     * @return The canonical code.
+     */
+    CanonicalCode RestoreTable(FileReader& reader, size_t symbol_bits = 9) const;
+
+    /*
+     * Read the header of an order-1 block and build its canonical codes for decoding.
+     * @param reader The file reader.
+     * @return The canonical codes.
+     */
+    ContextCodes RestoreContextTables(FileReader& reader) const;
+
+    /*
+     * Restore the next block, a transformed one included, and skip the padding after it.
+     * @param reader The file reader to read the block from the encoded file.
+     * @param content The empty buffer to put the content to.
+     * @param previous_code The code of the last Huffman block of the file, updated by the call.
+     * @param max_block_size The size of the largest block of the file, from its header.
+     * @return The symbol that ended the block, either BLOCK_END or FILENAME_END.
+     */
+    uint16_t RestoreNextBlock(FileReader& reader,
+                              std::vector<unsigned char>& content,
+                              std::optional<CanonicalCode>& previous_code,
+                              size_t max_block_size) const;
+
+    /*
+     * Restore a block of the given type, its type is already read.
+     * @param block_type The type of the block, not a transformed one.
+     * @param reader The file reader to read the block from the encoded file.
+     * @param content The buffer to append the content to.
+     * @param previous_code The code of the last Huffman block of the file, updated by the call.
+     * @param max_block_size The size the lengths the block declares may not exceed.
+     * @return The symbol that ended the block, either BLOCK_END or FILENAME_END.
+     */
+    uint16_t RestoreBlock(BlockType block_type,
+                          FileReader& reader,
+                          std::vector<unsigned char>& content,
+                          std::optional<CanonicalCode>& previous_code,
+                          size_t max_block_size) const;
+
+    /*
+     * Restore the content of a block from the encoded file.
      * @param reader The file reader to read the content from the encoded file.
-     * @param writer The file writer to write the content to the output file.
-     * @param trie The trie to use for decoding the content.
+     * @param content The buffer to append the content to.
+     * @param code The canonical code to use for decoding the content.
+     * @return The symbol that ended the block, either BLOCK_END or FILENAME_END.
      */
-    void RestoreAndWriteContent(FileReader& reader, FileWriter& writer, BinaryTrie& trie) const;
+    uint16_t RestoreContent(FileReader& reader,
+                            std::vector<unsigned char>& content,
+                            const CanonicalCode& code) const;
+
+    /*
+     * Restore the content of an order-1 block.
+     * @param reader The file reader to read the content from the encoded file.
+     * @param content The buffer to append the content to.
+     * @param codes The canonical codes to use for decoding the content.
+     * @return The symbol that ended the block, either BLOCK_END or FILENAME_END.
+     */
+    uint16_t RestoreContextContent(FileReader& reader,
+                                   std::vector<unsigned char>& content,
+                                   const ContextCodes& codes) const;
+
+    /*
+     * Read the header of a word block and restore its content.
+     * @param reader The file reader to read the block from the encoded file.
+     * @param content The buffer to append the content to.
+     * @return The symbol that ended the block, either BLOCK_END or FILENAME_END.
+     */
+    uint16_t RestoreWordContent(FileReader& reader, std::vector<unsigned char>& content) const;
+
+    /*
+     * Copy the content of a stored block from the encoded file.
+     * @param reader The file reader to read the content from the encoded file.
+     * @param content The buffer to append the content to.
+     * @param max_block_size The size the length of the block may not exceed.
+     * @return The symbol that ended the block, either BLOCK_END or FILENAME_END.
+     */
+    uint16_t RestoreStoredContent(FileReader& reader,
+                                  std::vector<unsigned char>& content,
+                                  size_t max_block_size) const;
+
+    /*
+     * Restore the content of a block coded with a built-in table.
+     * @param reader The file reader to read the content from the encoded file.
+     * @param content The buffer to append the content to.
+     * @return The symbol that ended the block, either BLOCK_END or FILENAME_END.
+     */
+    uint16_t RestoreStaticContent(FileReader& reader, std::vector<unsigned char>& content) const;
+
+    /*
+     * Restore the content of an rANS-coded block from the encoded file.
+     * @param reader The file reader to read the content from the encoded file.
+     * @param content The buffer to append the content to.
+     * @param max_block_size The size the length of the block may not exceed.
+     * @return The symbol that ended the block, either BLOCK_END or FILENAME_END.
+     */
+    uint16_t RestoreAnsContent(FileReader& reader,
+                               std::vector<unsigned char>& content,
+                               size_t max_block_size) const;
+
+private:
+    EncodingOptions options_;
+
+    CharacterFrequencies shared_frequencies_;
+    std::optional<CodeTable> shared_table_;
+    std::optional<CanonicalCode> shared_code_;
 };
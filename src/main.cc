@@ -1,13 +1,78 @@
 #include "archiver.h"
+#include "daemon.h"
+#include "trace.h"
 
 #include <boost/program_options.hpp>
+#include <csignal>
+#include <cstdint>
+#include <filesystem>
+#include <iomanip>
 #include <iostream>
 #include <string>
 #include <vector>
 
 namespace po = boost::program_options;
 
-int main(int argc, char* argv[])
+/*
+ * The running daemon, stopped by SIGINT and SIGTERM.
+ */
+CompressionServer* running_server = nullptr;
+
+/*
+ * Stop the running daemon.
+ * @param signal The signal number.
+ */
+extern "C" void StopServer(int /*signal*/)
+{
+    if (running_server != nullptr)
+    {
+        running_server->Stop();
+    }
+}
+
+/*
+ * Print the compression statistics of each file and of the whole archive.
+ * @param stats The statistics of the compressed files.
+ */
+void PrintStats(const std::vector<EncodingStats>& stats)
+{
+    auto print_line = [](const std::string& name, uint64_t original_size, uint64_t encoded_bits,
+                         uint64_t exact_table_bits)
+    {
+        double overhead = exact_table_bits == 0
+            ? 0.0
+            : 100.0 * (static_cast<double>(encoded_bits) - static_cast<double>(exact_table_bits))
+                / static_cast<double>(exact_table_bits);
+        std::cout << name << ": " << original_size << " -> " << (encoded_bits + 7) / 8
+                  << " bytes, exact table: " << (exact_table_bits + 7) / 8 << " bytes ("
+                  << std::showpos << std::fixed << std::setprecision(2) << overhead << "%)"
+                  << std::noshowpos << std::endl;
+    };
+
+    uint64_t total_original_size = 0;
+    uint64_t total_encoded_bits = 0;
+    uint64_t total_exact_table_bits = 0;
+    for (const auto& file_stats : stats)
+    {
+        print_line(file_stats.file_name,
+                   file_stats.original_size,
+                   file_stats.encoded_bits,
+                   file_stats.exact_table_bits);
+
+        total_original_size += file_stats.original_size;
+        total_encoded_bits += file_stats.encoded_bits;
+        total_exact_table_bits += file_stats.exact_table_bits;
+    }
+    print_line("total", total_original_size, total_encoded_bits, total_exact_table_bits);
+}
+
+/*
+ * Run the command of the arguments.
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ * @return The exit code.
+ */
+int Run(int argc, char* argv[])
 {
     using Arguments = std::vector<std::string>;
 
@@ -15,20 +80,132 @@ int main(int argc, char* argv[])
     desc.add_options() //
         ("help,h", "Print usage message") //
         ("compress,c", po::value<Arguments>()->multitoken(), "Compress files to archive") //
-        ("decompress,d", po::value<std::string>(), "Decompress archive");
+        ("append,a",
+         po::value<Arguments>()->multitoken(),
+         "Compress files to the end of an existing archive") //
+        ("decompress,d", po::value<std::string>(), "Decompress archive") //
+        ("extract,x",
+         po::value<Arguments>()->multitoken(),
+         "Print bytes [offset, offset + length) of a file: archive file_name offset length") //
+        ("merge",
+         po::value<Arguments>()->multitoken(),
+         "Copy the files of archives to one archive without decoding them: archive archive1 ...") //
+        ("extract-raw",
+         po::value<Arguments>()->multitoken(),
+         "Copy files to a new archive without decoding them: archive new_archive file_name ...") //
+        ("level,l",
+         po::value<int>()->default_value(DEFAULT_LEVEL),
+         "Compression level from 1 (fastest) to 9 (smallest)") //
+        ("fast,1", "Fastest compression, same as --level 1") //
+        (",2", "Compression level 2") //
+        (",3", "Compression level 3") //
+        (",4", "Compression level 4") //
+        (",5", "Compression level 5") //
+        (",6", "Compression level 6, the default") //
+        (",7", "Compression level 7") //
+        (",8", "Compression level 8") //
+        ("best,9", "Best compression, same as --level 9") //
+        ("threads,t",
+         po::value<size_t>()->default_value(1),
+         "Number of threads encoding or decoding the files") //
+        ("memory-limit",
+         po::value<size_t>(),
+         "MiB of memory the process keeps to, the blocks and the threads are fitted to it") //
+        ("sync-interval",
+         po::value<size_t>()->default_value(EncodingOptions {}.sync_interval >> 10),
+         "KiB between the sync points a file range is decompressed from") //
+        ("ans", "Also try rANS in place of the code table of each block") //
+        ("static-tables",
+         "Code each block with the best built-in table instead of building a table") //
+        ("cache",
+         po::value<std::string>(),
+         "Directory of encoded files reused for unchanged files by later archives") //
+        ("stats", "Print compressed sizes versus the exact frequency tables") //
+        ("trace",
+         po::value<std::string>(),
+         "Write a Chrome trace of the stages of each file, block and thread to a JSON file") //
+        ("daemon",
+         po::value<std::string>(),
+         "Serve compression jobs on a Unix socket, --threads jobs at once") //
+        ("connect",
+         po::value<std::string>(),
+         "Send the compression or decompression job to the daemon on a Unix socket, with the "
+         "level as its only option");
 
     po::variables_map vm;
     po::parsed_options parsed = po::command_line_parser(argc, argv).options(desc).run();
     po::store(parsed, vm);
     po::notify(vm);
 
+    // The sizes are given in KiB and MiB, check that they fit in bytes
+    size_t memory_limit = 0;
+    if (vm.count("memory-limit"))
+    {
+        size_t memory_limit_mib = vm["memory-limit"].as<size_t>();
+        if (memory_limit_mib > SIZE_MAX >> 20)
+        {
+            std::cout << "Memory limit should be at most " << (SIZE_MAX >> 20) << " MiB."
+                      << std::endl;
+            return 1;
+        }
+        memory_limit = memory_limit_mib << 20;
+    }
+    size_t sync_interval_kib = vm["sync-interval"].as<size_t>();
+    if (sync_interval_kib > SIZE_MAX >> 10)
+    {
+        std::cout << "Sync interval should be at most " << (SIZE_MAX >> 10) << " KiB." << std::endl;
+        return 1;
+    }
+
+    // A job sent to the daemon carries its level only, the daemon runs it with its own threads
+    // and memory, hence the options it would drop are refused rather than ignored
+    if (vm.count("connect"))
+    {
+        for (const char* option : { "static-tables",
+                                    "ans",
+                                    "cache",
+                                    "stats",
+                                    "threads",
+                                    "sync-interval",
+                                    "memory-limit",
+                                    "trace" })
+        {
+            if (vm.count(option) && !vm[option].defaulted())
+            {
+                std::cout << "--" << option << " is not sent to the daemon, run the job without "
+                          << "--connect to use it." << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    if (vm.count("trace"))
+    {
+        if (!TRACING_BUILT)
+        {
+            std::cout << "Tracing is compiled out of this build." << std::endl;
+            return 1;
+        }
+        StartTracing();
+    }
+
     if (vm.count("help"))
     {
         std::cout << desc << std::endl;
     }
-    else if (vm.count("compress"))
+    else if (vm.count("daemon"))
     {
-        Arguments input = vm["compress"].as<Arguments>();
+        CompressionServer server(vm["daemon"].as<std::string>(), vm["threads"].as<size_t>());
+        running_server = &server;
+        std::signal(SIGINT, StopServer);
+        std::signal(SIGTERM, StopServer);
+        server.Run();
+        running_server = nullptr;
+    }
+    else if (vm.count("compress") || vm.count("append"))
+    {
+        bool is_append = vm.count("append") > 0;
+        Arguments input = vm[is_append ? "append" : "compress"].as<Arguments>();
 
         std::string archive_path = input.at(0);
         if (!archive_path.ends_with(".huff"))
@@ -40,15 +217,67 @@ int main(int argc, char* argv[])
         Arguments file_paths = Arguments(input.begin() + 1, input.end());
         for (const auto& file_path : file_paths)
         {
-            if (!file_path.ends_with(".txt"))
+            if (!file_path.ends_with(".txt") && !std::filesystem::is_directory(file_path))
             {
-                std::cout << "Only .txt files are supported." << std::endl;
+                std::cout << "Only .txt files and directories are supported." << std::endl;
                 return 1;
             }
         }
 
-        Archiver archiver(archive_path, file_paths);
-        archiver.Compress();
+        // The short level options take precedence over --level
+        int level = vm["level"].as<int>();
+        for (int short_level = MIN_LEVEL; short_level <= MAX_LEVEL; ++short_level)
+        {
+            std::string short_option = "-";
+            short_option += std::to_string(short_level);
+            if (vm.count(short_option))
+            {
+                level = short_level;
+            }
+        }
+        if (vm.count("fast"))
+        {
+            level = MIN_LEVEL;
+        }
+        if (vm.count("best"))
+        {
+            level = MAX_LEVEL;
+        }
+        if (level < MIN_LEVEL || level > MAX_LEVEL)
+        {
+            std::cout << "Compression level should be from 1 to 9." << std::endl;
+            return 1;
+        }
+
+        // The daemon encodes with the options of the level
+        if (vm.count("connect"))
+        {
+            CompressionClient client(vm["connect"].as<std::string>());
+            client.CompressFiles(archive_path, file_paths, level, is_append);
+            return 0;
+        }
+
+        EncodingOptions options = GetLevelOptions(level);
+        options.collect_stats = vm.count("stats") > 0;
+        options.threads_count = vm["threads"].as<size_t>();
+        options.ans_blocks = options.ans_blocks || vm.count("ans") > 0;
+        if (vm.count("static-tables"))
+        {
+            options.table_scope = TableScope::Static;
+        }
+        options.sync_interval = sync_interval_kib << 10;
+        if (vm.count("cache"))
+        {
+            options.cache_directory = vm["cache"].as<std::string>();
+        }
+        options.memory_limit = memory_limit;
+
+        Archiver archiver(archive_path, file_paths, options);
+        auto stats = is_append ? archiver.Append() : archiver.Compress();
+        if (options.collect_stats)
+        {
+            PrintStats(stats);
+        }
     }
     else if (vm.count("decompress"))
     {
@@ -59,13 +288,90 @@ int main(int argc, char* argv[])
             return 1;
         }
 
-        Archiver archiver(archive_path);
+        if (vm.count("connect"))
+        {
+            CompressionClient client(vm["connect"].as<std::string>());
+            client.DecompressArchive(archive_path);
+            return 0;
+        }
+
+        Archiver archiver(archive_path, vm["threads"].as<size_t>(), memory_limit);
         archiver.Decompress();
     }
+    else if (vm.count("extract"))
+    {
+        Arguments input = vm["extract"].as<Arguments>();
+        if (input.size() != 4)
+        {
+            std::cout << "Extraction takes the archive, the file name, the offset and the length."
+                      << std::endl;
+            return 1;
+        }
+        if (!input[0].ends_with(".huff"))
+        {
+            std::cout << "Archive file should have .huff extension." << std::endl;
+            return 1;
+        }
+
+        Archiver archiver(input[0]);
+        auto range = archiver.ExtractRange(input[1], std::stoull(input[2]), std::stoull(input[3]));
+        std::cout.write(reinterpret_cast<const char*>(range.data()),
+                        static_cast<std::streamsize>(range.size()));
+    }
+    else if (vm.count("merge") || vm.count("extract-raw"))
+    {
+        bool is_merge = vm.count("merge") > 0;
+        Arguments input = vm[is_merge ? "merge" : "extract-raw"].as<Arguments>();
+        size_t archives_count = is_merge ? input.size() : 2;
+        if (input.size() < 2 || (!is_merge && input.size() < 3))
+        {
+            std::cout << (is_merge ? "Merging takes the archive and the archives to merge."
+                                   : "Raw extraction takes the archive, the new archive and the "
+                                     "file names.")
+                      << std::endl;
+            return 1;
+        }
+        for (size_t i = 0; i < archives_count; ++i)
+        {
+            if (!input[i].ends_with(".huff"))
+            {
+                std::cout << "Archive file should have .huff extension." << std::endl;
+                return 1;
+            }
+        }
+
+        if (is_merge)
+        {
+            Archiver(input[0]).Merge(Arguments(input.begin() + 1, input.end()));
+        }
+        else
+        {
+            Archiver(input[0]).ExtractRaw(input[1], Arguments(input.begin() + 2, input.end()));
+        }
+    }
     else
     {
         std::cout << "Please, specify valid argument. For more information, type `./archiver -h`."
                   << std::endl;
     }
+
+    if (vm.count("trace"))
+    {
+        WriteTrace(vm["trace"].as<std::string>());
+    }
     return 0;
 }
+
+int main(int argc, char* argv[])
+{
+    // Bad arguments and unreadable or corrupted files end the process with their message
+    try
+    {
+        return Run(argc, argv);
+    }
+    catch (const std::exception& error)
+    {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,82 @@
+#include "mappedfilewriter.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+MappedFileWriter::MappedFileWriter(const std::string& file_path,
+                                   size_t file_size,
+                                   size_t resident_size)
+    : file_path_(file_path), file_size_(file_size), resident_size_(resident_size)
+{
+    file_descriptor_ = open(file_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (file_descriptor_ == -1)
+    {
+        throw std::runtime_error("The mapped file writer cannot open " + file_path);
+    }
+    if (file_size == 0)
+    {
+        return;
+    }
+
+    // Allocate the blocks at once, file systems without fallocate only get the size set
+    auto length = static_cast<off_t>(file_size);
+    if (posix_fallocate(file_descriptor_, 0, length) != 0
+        && ftruncate(file_descriptor_, length) != 0)
+    {
+        close(file_descriptor_);
+        throw std::runtime_error("The mapped file writer cannot allocate " + file_path);
+    }
+
+    void* data = mmap(nullptr, file_size, PROT_WRITE, MAP_SHARED, file_descriptor_, 0);
+    if (data == MAP_FAILED)
+    {
+        close(file_descriptor_);
+        throw std::runtime_error("The mapped file writer cannot map " + file_path);
+    }
+    data_ = static_cast<unsigned char*>(data);
+}
+
+MappedFileWriter::~MappedFileWriter()
+{
+    if (data_ != nullptr)
+    {
+        munmap(data_, file_size_);
+    }
+    if (bytes_written_ < file_size_)
+    {
+        static_cast<void>(ftruncate(file_descriptor_, static_cast<off_t>(bytes_written_)));
+    }
+    close(file_descriptor_);
+}
+
+void MappedFileWriter::WriteCharacters(const std::vector<unsigned char>& characters)
+{
+    if (characters.size() > file_size_ - bytes_written_)
+    {
+        throw std::runtime_error("The mapped file writer cannot write past the end of "
+                                 + file_path_);
+    }
+
+    if (!characters.empty())
+    {
+        std::memcpy(data_ + bytes_written_, characters.data(), characters.size());
+        bytes_written_ += characters.size();
+    }
+
+    // The dropped pages stay in the page cache until the kernel writes them back
+    if (resident_size_ > 0 && bytes_written_ - dropped_bytes_ > 2 * resident_size_)
+    {
+        static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t dropped_end = (bytes_written_ - resident_size_) / page_size * page_size;
+        madvise(data_ + dropped_bytes_, dropped_end - dropped_bytes_, MADV_DONTNEED);
+        dropped_bytes_ = dropped_end;
+    }
+}
+
+size_t MappedFileWriter::GetBytesWritten() const
+{
+    return bytes_written_;
+}
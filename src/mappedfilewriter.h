@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*
+ * A class for writing a file of a known size through a memory mapping. The file is allocated
+ * in full before the first write, so that large files are written in one piece.
+ */
+class MappedFileWriter
+{
+public:
+    /*
+     * Constructor.
+     * @param file_path The path to the file to write to, an existing file is replaced.
+     * @param file_size The size of the file in bytes.
+     * @param resident_size The written bytes kept in the memory of the process, the pages in front
+     * of them are dropped once twice as many are written, 0 to keep all of them.
+     */
+    MappedFileWriter(const std::string& file_path, size_t file_size, size_t resident_size = 0);
+
+    /*
+     * Destructor. A file written only in part is cut to the written bytes.
+     */
+    ~MappedFileWriter();
+
+    MappedFileWriter(const MappedFileWriter&) = delete;
+    MappedFileWriter& operator=(const MappedFileWriter&) = delete;
+
+    /*
+     * Write several characters after the ones written before.
+     * @param characters The characters to write.
+     */
+    void WriteCharacters(const std::vector<unsigned char>& characters);
+
+    /*
+     * Get the number of bytes written so far.
+     * @return The number of bytes written.
+     */
+    size_t GetBytesWritten() const;
+
+private:
+    std::string file_path_;
+    int file_descriptor_ { -1 };
+
+    unsigned char* data_ { nullptr };
+    size_t file_size_ { 0 };
+    size_t bytes_written_ { 0 };
+    size_t resident_size_ { 0 };
+    size_t dropped_bytes_ { 0 }; // the written bytes no longer in the memory, whole pages
+};
@@ -0,0 +1,179 @@
+#include "memorybudget.h"
+
+#include "transform.h"
+
+#include <algorithm>
+#include <malloc.h>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+/*
+ * Memory of the frequencies, the tree and the code tables of a block.
+ */
+constexpr size_t ENCODING_TABLES_MEMORY = 512 << 10;
+
+/*
+ * Memory of the order-1 tables of a block, one table per previous character.
+ */
+constexpr size_t CONTEXT_TABLES_MEMORY = 1280 << 10;
+
+/*
+ * Memory of the dictionary of the words of a block.
+ */
+constexpr size_t WORD_TABLES_MEMORY = 512 << 10;
+
+/*
+ * Memory of the decoding tables of a block.
+ */
+constexpr size_t DECODING_TABLES_MEMORY = 1 << 20;
+
+MemoryBudget::MemoryBudget(size_t limit) : limit_(limit) { }
+
+bool MemoryBudget::TryAcquire(size_t bytes)
+{
+    bytes = std::min(bytes, limit_);
+    std::lock_guard lock(mutex_);
+    if (used_bytes_ + bytes > limit_)
+    {
+        return false;
+    }
+    used_bytes_ += bytes;
+    return true;
+}
+
+void MemoryBudget::Acquire(size_t bytes)
+{
+    bytes = std::min(bytes, limit_);
+    std::unique_lock lock(mutex_);
+    released_.wait(lock, [&] { return used_bytes_ + bytes <= limit_; });
+    used_bytes_ += bytes;
+}
+
+void MemoryBudget::Release(size_t bytes)
+{
+    bytes = std::min(bytes, limit_);
+    {
+        std::lock_guard lock(mutex_);
+        used_bytes_ -= bytes;
+    }
+    released_.notify_all();
+}
+
+MemoryReservation::MemoryReservation(MemoryBudget& budget, size_t bytes)
+    : budget_(budget), bytes_(bytes)
+{
+    budget_.Acquire(bytes_);
+}
+
+MemoryReservation::~MemoryReservation()
+{
+    budget_.Release(bytes_);
+}
+
+void ReturnFreedMemory()
+{
+#if defined(__GLIBC__)
+    // glibc raises its mmap threshold to the largest buffer freed, after which the buffers of the
+    // blocks stay in the heap of each thread once freed. A fixed threshold maps every buffer of
+    // 128 KiB or more on its own and unmaps it when freed.
+    static std::once_flag once_flag;
+    std::call_once(once_flag,
+                   []
+                   {
+                       mallopt(M_MMAP_THRESHOLD, 128 << 10);
+                       mallopt(M_TRIM_THRESHOLD, 1 << 20);
+                   });
+#endif
+}
+
+size_t GetBudgetedMemory(size_t memory_limit)
+{
+    if (memory_limit <= PROCESS_MEMORY + MIN_BUDGETED_BLOCK_SIZE)
+    {
+        throw std::invalid_argument("The memory limit should be more than "
+                                    + std::to_string((PROCESS_MEMORY >> 20) + 1) + " MiB");
+    }
+    return memory_limit - PROCESS_MEMORY;
+}
+
+size_t EstimateEncodingMemory(const EncodingOptions& options, uint64_t range_size)
+{
+    // The block read and the block coded by each block type tried, in quarters of the block
+    size_t block_size = std::min<uint64_t>(options.block_size, range_size);
+    size_t block_quarters = 4;
+    size_t memory = ENCODING_TABLES_MEMORY;
+    if (options.ans_blocks)
+    {
+        block_quarters += 5;
+    }
+    if (options.order1_contexts)
+    {
+        memory += CONTEXT_TABLES_MEMORY;
+    }
+    if (options.max_tokens_count > 0)
+    {
+        block_quarters += 2;
+        memory += WORD_TABLES_MEMORY;
+    }
+    if (options.transforms != 0 && block_size <= MAX_BWT_BLOCK_SIZE)
+    {
+        // The suffix array and the buffers of the Burrows-Wheeler transform
+        block_quarters += 104;
+    }
+    return memory + block_size / 4 * block_quarters;
+}
+
+size_t EstimateEncodedRangeMemory(const EncodingOptions& options, uint64_t range_size)
+{
+    // The in-memory writer grows by doubling, so it may hold twice the bytes it has written
+    return EstimateEncodingMemory(options, range_size) + 2 * range_size;
+}
+
+size_t EstimateDecodingMemory(uint64_t file_size, uint64_t block_size, uint16_t transforms)
+{
+    // The decoded block grows by doubling. Inverting the transforms keeps the decoded block, which
+    // the run-length encoding may make a quarter larger, and the inverse BWT adds its 32-bit row
+    // links and the restored block, in quarters of the block
+    size_t block_quarters = transforms != 0 ? 24 : 8;
+    return DECODING_TABLES_MEMORY + std::min(file_size, block_size) / 4 * block_quarters
+        + std::min<uint64_t>(file_size, 2 * MAPPED_WINDOW_SIZE);
+}
+
+EncodingOptions FitToMemoryLimit(const EncodingOptions& options)
+{
+    if (options.memory_limit == 0)
+    {
+        return options;
+    }
+
+    // The archive is decoded under the same limit, from the block size its file headers give
+    size_t budget = GetBudgetedMemory(options.memory_limit);
+    auto fits = [budget](const EncodingOptions& fitted_options)
+    {
+        uint16_t transforms
+            = fitted_options.table_scope == TableScope::Block ? fitted_options.transforms : 0;
+        return EstimateEncodingMemory(fitted_options, fitted_options.block_size) <= budget
+            && EstimateDecodingMemory(UINT64_MAX, fitted_options.block_size, transforms)
+            <= budget;
+    };
+    EncodingOptions fitted_options = options;
+    while (fitted_options.block_size > MIN_BUDGETED_BLOCK_SIZE && !fits(fitted_options))
+    {
+        fitted_options.block_size
+            = std::max(fitted_options.block_size / 2, MIN_BUDGETED_BLOCK_SIZE);
+    }
+    if (!fits(fitted_options))
+    {
+        throw std::invalid_argument("The memory limit is too small for the encoder options");
+    }
+
+    // Encoding ahead pays off only if the encoded ranges of two threads fit, a single thread
+    // writes each block to the archive as it is encoded
+    size_t range_size = std::max(fitted_options.block_size, fitted_options.sync_interval);
+    if (2 * EstimateEncodedRangeMemory(fitted_options, range_size) > budget)
+    {
+        fitted_options.threads_count = 1;
+    }
+    return fitted_options;
+}
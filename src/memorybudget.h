@@ -0,0 +1,144 @@
+#pragma once
+
+#include "huffman.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+/*
+ * Memory of the process outside of the budget: the code, the libraries, the thread stacks and the
+ * buffers of the streams, taken off the limit first.
+ */
+constexpr size_t PROCESS_MEMORY = 4 << 20;
+
+/*
+ * The smallest block the encoder shrinks its blocks to under a memory limit.
+ */
+constexpr size_t MIN_BUDGETED_BLOCK_SIZE = 64 << 10;
+
+/*
+ * The written bytes of a decoded file kept mapped under a memory limit, see MappedFileWriter.
+ */
+constexpr size_t MAPPED_WINDOW_SIZE = 1 << 20;
+
+/*
+ * Bytes shared by the threads of a job, taken before a task allocates its buffers and given back
+ * after it frees them. A task larger than the whole budget takes all of it, so that it runs alone
+ * instead of never.
+ */
+class MemoryBudget
+{
+public:
+    /*
+     * Constructor.
+     * @param limit The bytes of the budget.
+     */
+    explicit MemoryBudget(size_t limit);
+
+    MemoryBudget(const MemoryBudget&) = delete;
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+    /*
+     * Take bytes if they are free.
+     * @param bytes The bytes to take.
+     * @return True if the bytes are taken.
+     */
+    bool TryAcquire(size_t bytes);
+
+    /*
+     * Take bytes, waiting until the other tasks give back enough of them.
+     * @param bytes The bytes to take.
+     */
+    void Acquire(size_t bytes);
+
+    /*
+     * Give back bytes taken before.
+     * @param bytes The bytes to give back.
+     */
+    void Release(size_t bytes);
+
+private:
+    std::mutex mutex_;
+    std::condition_variable released_;
+    size_t limit_;
+    size_t used_bytes_ { 0 };
+};
+
+/*
+ * Bytes of a budget taken for the lifetime of the object.
+ */
+class MemoryReservation
+{
+public:
+    /*
+     * Constructor. Takes the bytes, waiting until they are free.
+     * @param budget The budget.
+     * @param bytes The bytes to take.
+     */
+    MemoryReservation(MemoryBudget& budget, size_t bytes);
+
+    /*
+     * Destructor. Gives the bytes back.
+     */
+    ~MemoryReservation();
+
+    MemoryReservation(const MemoryReservation&) = delete;
+    MemoryReservation& operator=(const MemoryReservation&) = delete;
+
+private:
+    MemoryBudget& budget_;
+    size_t bytes_;
+};
+
+/*
+ * Make the allocator give the freed buffers back to the system at once, so that the memory of the
+ * process follows the budget. Called once a memory limit is set, later calls do nothing.
+ */
+void ReturnFreedMemory();
+
+/*
+ * Get the bytes of a memory limit left for the buffers of the job.
+ * @param memory_limit The memory limit of the process in bytes.
+ * @return The bytes of the budget.
+ */
+size_t GetBudgetedMemory(size_t memory_limit);
+
+/*
+ * Estimate the memory of a thread encoding a range of a file: the block read, the tables and the
+ * buffers of the block types tried.
+ * @param options The encoder options.
+ * @param range_size The size of the range in bytes.
+ * @return The bytes.
+ */
+size_t EstimateEncodingMemory(const EncodingOptions& options, uint64_t range_size);
+
+/*
+ * Estimate the memory of a range encoded to memory ahead of the archive: its encoding and the
+ * encoded bytes until they are written, which are at most the range with its block headers.
+ * @param options The encoder options.
+ * @param range_size The size of the range in bytes.
+ * @return The bytes.
+ */
+size_t EstimateEncodedRangeMemory(const EncodingOptions& options, uint64_t range_size);
+
+/*
+ * Estimate the memory of a thread decoding a file: its largest block with the buffers of the
+ * inverse transforms, the decoding tables and the mapped window of the written file.
+ * @param file_size The size of the file in bytes.
+ * @param block_size The largest block of the file in bytes, from its header.
+ * @param transforms The Transform flags its blocks may use, from its header.
+ * @return The bytes.
+ */
+size_t EstimateDecodingMemory(uint64_t file_size, uint64_t block_size, uint16_t transforms);
+
+/*
+ * Fit the encoder options to their memory limit: the blocks are halved until a thread encoding a
+ * block and a thread decoding a file of such blocks fit, and the files are encoded on one thread
+ * if two ranges do not fit ahead of the archive.
+ * @param options The encoder options.
+ * @return The options with the block size and the number of threads fitted, the same options
+ * without a memory limit.
+ */
+EncodingOptions FitToMemoryLimit(const EncodingOptions& options);
@@ -0,0 +1,161 @@
+#include "statictables.h"
+
+#include <algorithm>
+
+namespace
+{
+
+/*
+ * Build a built-in table at compile time with the code lengths and the canonical codes of the
+ * other tables.
+ * @param character_counts The reference counts of the characters, each one at least one.
+ * @return The table.
+ */
+constexpr StaticTable BuildStaticTable(const CharacterCounts& character_counts)
+{
+    std::array<uint64_t, STATIC_SYMBOLS_COUNT> counts {};
+    for (size_t character = 0; character <= UINT8_MAX; ++character)
+    {
+        counts[character] = character_counts[character];
+    }
+    counts[GetStaticSymbolIndex(FILENAME_END)] = 1;
+    counts[GetStaticSymbolIndex(BLOCK_END)] = 1;
+
+    StaticTable table;
+    CodeLengthWorkspace<STATIC_SYMBOLS_COUNT> workspace;
+    BuildCodeLengths(counts, MAX_STATIC_CODE_LENGTH, table.code_lengths, workspace);
+    AssignCanonicalCodes(std::span<const uint8_t>(table.code_lengths),
+                         std::span<uint16_t>(table.reversed_codes),
+                         std::span<uint16_t>(table.symbols),
+                         std::span<uint16_t>(table.length_counts));
+
+    // The symbols are indices of the arrays, the last one is BLOCK_END
+    for (auto& symbol : table.symbols)
+    {
+        if (symbol == GetStaticSymbolIndex(BLOCK_END))
+        {
+            symbol = BLOCK_END;
+        }
+    }
+    return table;
+}
+
+/*
+ * Reference counts of the characters scaled to about 2^16 in all: English prose, JSON log lines
+ * with timestamps, levels, request ids and durations, and CSV of dates, names and amounts. They
+ * are the output of tools/gen_static_counts.cc, which counts fixed-seed corpora described there;
+ * run it again and paste its output here to change them.
+ */
+constexpr CharacterCounts ENGLISH_COUNTS = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1231, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    12811, 57, 391, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1094, 1, 1039, 1,
+    33, 103, 42, 42, 40, 40, 40, 41, 39, 40, 1, 162, 1, 1, 1, 59,
+    1, 204, 60, 50, 13, 73, 36, 12, 110, 227, 60, 2, 44, 133, 25, 111,
+    66, 3, 2, 58, 226, 12, 6, 104, 1, 13, 1, 1, 1, 1, 1, 1,
+    1, 4031, 827, 1059, 1430, 5331, 1228, 563, 3953, 3069, 42, 186, 1416, 1275, 3171, 4413,
+    690, 28, 2383, 2566, 4706, 1249, 389, 1458, 29, 1062, 29, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+};
+
+constexpr CharacterCounts JSON_LOG_COUNTS = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 333, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    333, 1, 10659, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2665, 666, 666, 886,
+    2920, 1985, 1852, 933, 1392, 864, 732, 728, 743, 735, 3664, 1, 1, 1, 1, 1,
+    1, 47, 49, 1, 104, 430, 188, 216, 1, 188, 1, 1, 55, 1, 235, 293,
+    111, 1, 194, 55, 666, 105, 1, 47, 1, 1, 333, 1, 1, 1, 1, 666,
+    1, 1966, 391, 1131, 1595, 4035, 368, 485, 1033, 1502, 1, 56, 878, 1123, 750, 1011,
+    514, 458, 1813, 3287, 2917, 1406, 1082, 150, 1, 179, 1, 333, 1, 333, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+};
+
+constexpr CharacterCounts CSV_COUNTS = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1407, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    467, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 7036, 2814, 1407, 1,
+    3697, 2077, 4508, 1132, 2529, 1138, 1131, 1127, 1119, 1081, 1, 1, 1, 1, 1, 1,
+    1, 434, 571, 120, 1253, 377, 1, 366, 206, 1, 626, 1, 409, 435, 124, 1,
+    598, 1, 548, 1242, 85, 1131, 1, 262, 1, 124, 1, 1, 1, 1, 1, 1,
+    1, 2753, 267, 561, 768, 2319, 86, 442, 1093, 2677, 1, 124, 1567, 345, 2600, 2542,
+    296, 1, 1648, 1555, 779, 408, 175, 214, 118, 173, 445, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+};
+
+constexpr std::array<StaticTable, 3> STATIC_TABLES = {
+    BuildStaticTable(ENGLISH_COUNTS),
+    BuildStaticTable(JSON_LOG_COUNTS),
+    BuildStaticTable(CSV_COUNTS),
+};
+
+/*
+ * Check that the codes of a table use up the code space, so that every code decodes.
+ * @param table The table.
+ * @return True if the Kraft sum is one.
+ */
+constexpr bool IsComplete(const StaticTable& table)
+{
+    uint64_t kraft_sum = 0;
+    for (size_t length = 1; length <= MAX_STATIC_CODE_LENGTH; ++length)
+    {
+        kraft_sum += uint64_t { table.length_counts[length] } << (MAX_STATIC_CODE_LENGTH - length);
+    }
+    return kraft_sum == uint64_t { 1 } << MAX_STATIC_CODE_LENGTH;
+}
+
+static_assert(std::all_of(STATIC_TABLES.begin(), STATIC_TABLES.end(), IsComplete));
+
+} // namespace
+
+size_t GetStaticTablesCount()
+{
+    return STATIC_TABLES.size();
+}
+
+const StaticTable& GetStaticTable(size_t table_index)
+{
+    if (table_index >= STATIC_TABLES.size())
+    {
+        throw std::runtime_error("Unknown built-in table " + std::to_string(table_index));
+    }
+    return STATIC_TABLES[table_index];
+}
+
+const DecodingTable& GetStaticDecodingTable(size_t table_index)
+{
+    // Built once for the process, on the first block that needs them
+    static const auto decoding_tables = []
+    {
+        std::array<DecodingTable, STATIC_TABLES.size()> tables;
+        for (size_t i = 0; i < STATIC_TABLES.size(); ++i)
+        {
+            const auto& table = STATIC_TABLES[i];
+            tables[i] = BuildDecodingTable(std::span<const uint16_t>(table.symbols),
+                                           std::span<const uint16_t>(table.length_counts));
+        }
+        return tables;
+    }();
+    GetStaticTable(table_index);
+    return decoding_tables[table_index];
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "canonicalcode.h"
+#include "huffman.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+/*
+ * Built-in code tables. A block coded with one of them writes the 8-bit index of the table instead
+ * of a table header, and neither the encoder nor the decoder builds anything for it but the
+ * decoding tables, once per process. The tables are part of the format and never change, new
+ * ones only get new indices.
+ */
+
+/*
+ * Symbols of a built-in table: the characters, FILENAME_END and BLOCK_END.
+ */
+constexpr size_t STATIC_SYMBOLS_COUNT = UINT8_MAX + 3;
+
+/*
+ * Longest code of a built-in table.
+ */
+constexpr size_t MAX_STATIC_CODE_LENGTH = 15;
+
+/*
+ * A canonical code table, the codes of a length follow each other in the order of the symbols.
+ */
+struct StaticTable
+{
+    std::array<uint8_t, STATIC_SYMBOLS_COUNT> code_lengths {}; // indexed by GetStaticSymbolIndex
+    std::array<uint16_t, STATIC_SYMBOLS_COUNT> reversed_codes {}; // the first bit in the LSB
+    std::array<uint16_t, STATIC_SYMBOLS_COUNT> symbols {}; // the symbols in the canonical order
+    std::array<uint16_t, MAX_STATIC_CODE_LENGTH + 1> length_counts {};
+};
+
+/*
+ * Get the index of a symbol in the arrays of a built-in table.
+ * @param symbol A character, FILENAME_END or BLOCK_END.
+ * @return The index.
+ */
+constexpr size_t GetStaticSymbolIndex(uint16_t symbol)
+{
+    return symbol == BLOCK_END ? UINT8_MAX + 2 : symbol;
+}
+
+/*
+ * Get the number of built-in tables.
+ * @return The number of tables.
+ */
+size_t GetStaticTablesCount();
+
+/*
+ * Get a built-in table.
+ * @param table_index The index of the table: English prose, JSON logs, CSV.
+ * @return The table.
+ */
+const StaticTable& GetStaticTable(size_t table_index);
+
+/*
+ * Get the decoding table of a built-in table, see BuildDecodingTable.
+ * @param table_index The index of the table.
+ * @return The decoding table.
+ */
+const DecodingTable& GetStaticDecodingTable(size_t table_index);
+
+/*
+ * Decode a symbol with a built-in table.
+ * @param table The table.
+ * @param read_bit The function reading the next bit.
+ * @return The symbol.
+ */
+template <typename ReadBit>
+uint16_t DecodeStaticSymbol(const StaticTable& table, ReadBit&& read_bit)
+{
+    auto symbol = DecodeCanonicalSymbol(std::span<const uint16_t>(table.symbols),
+                                        std::span<const uint16_t>(table.length_counts),
+                                        read_bit);
+    if (!symbol)
+    {
+        throw std::runtime_error("The block has a code missing from its built-in table");
+    }
+    return *symbol;
+}
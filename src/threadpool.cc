@@ -0,0 +1,113 @@
+#include "threadpool.h"
+
+#include <algorithm>
+
+namespace
+{
+/*
+ * The pool and the index of the worker running on the current thread, if it is a worker.
+ */
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker_index = 0;
+}
+
+ThreadPool::ThreadPool(size_t threads_count)
+{
+    threads_count = std::max<size_t>(threads_count, 1);
+    for (size_t i = 0; i < threads_count; ++i)
+    {
+        queues_.push_back(std::make_unique<TaskQueue>());
+    }
+    for (size_t i = 0; i < threads_count; ++i)
+    {
+        workers_.emplace_back([this, i] { RunWorker(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock(mutex_);
+        is_stopped_ = true;
+    }
+    has_tasks_.notify_all();
+    for (auto& worker : workers_)
+    {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::GetThreadsCount() const
+{
+    return workers_.size();
+}
+
+void ThreadPool::Push(std::function<void()> task)
+{
+    std::unique_lock lock(mutex_);
+
+    // A worker keeps the tasks it spawns, the others are dealt in turn
+    size_t queue_index = 0;
+    if (current_pool == this)
+    {
+        queue_index = current_worker_index;
+    }
+    else
+    {
+        queue_index = next_queue_index_;
+        next_queue_index_ = (next_queue_index_ + 1) % queues_.size();
+    }
+    {
+        std::lock_guard queue_lock(queues_[queue_index]->mutex);
+        queues_[queue_index]->tasks.push_back(std::move(task));
+    }
+    ++pending_tasks_count_;
+
+    lock.unlock();
+    has_tasks_.notify_one();
+}
+
+std::function<void()> ThreadPool::Pop(size_t worker_index)
+{
+    // Start from the own queue and go round the others, the oldest task of a queue goes first
+    for (size_t i = 0; i < queues_.size(); ++i)
+    {
+        auto& queue = *queues_[(worker_index + i) % queues_.size()];
+        std::lock_guard lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            auto task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return task;
+        }
+    }
+    return {};
+}
+
+void ThreadPool::RunWorker(size_t worker_index)
+{
+    current_pool = this;
+    current_worker_index = worker_index;
+
+    while (true)
+    {
+        // Claim one of the pending tasks, so that it is surely left in one of the queues
+        {
+            std::unique_lock lock(mutex_);
+            has_tasks_.wait(lock, [this] { return is_stopped_ || pending_tasks_count_ > 0; });
+            if (is_stopped_)
+            {
+                return;
+            }
+            --pending_tasks_count_;
+        }
+
+        // The claimed task is queued, but the queues may change while they are looked through
+        auto task = Pop(worker_index);
+        while (!task)
+        {
+            task = Pop(worker_index);
+        }
+        task();
+    }
+}
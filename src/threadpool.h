@@ -0,0 +1,92 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/*
+ * A pool of threads with a task queue per thread. A task submitted from a worker goes to its own
+ * queue, other tasks are spread over the queues in turn. An idle worker takes the oldest task of
+ * its own queue and steals the oldest task of another queue when its own queue is empty.
+ */
+class ThreadPool
+{
+public:
+    /*
+     * Constructor.
+     * @param threads_count The number of worker threads, at least one.
+     */
+    explicit ThreadPool(size_t threads_count);
+
+    /*
+     * Destructor. Waits for the running tasks, the tasks not yet started are dropped.
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /*
+     * Get the number of worker threads.
+     * @return The number of worker threads.
+     */
+    size_t GetThreadsCount() const;
+
+    /*
+     * Schedule a task.
+     * @param task The task to run.
+     * @return The future of the task result, it holds the exception thrown by the task if any.
+     */
+    template <typename Task>
+    std::future<std::invoke_result_t<Task>> Submit(Task task)
+    {
+        using Result = std::invoke_result_t<Task>;
+
+        auto packaged_task = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+        auto future = packaged_task->get_future();
+        Push([packaged_task] { (*packaged_task)(); });
+        return future;
+    }
+
+private:
+    struct TaskQueue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    /*
+     * Put a task to one of the queues and wake up a worker.
+     * @param task The task to run.
+     */
+    void Push(std::function<void()> task);
+
+    /*
+     * Take the oldest task from the own queue of the worker or steal one from another queue.
+     * @param worker_index The index of the worker.
+     * @return The task, empty if another worker has taken it first.
+     */
+    std::function<void()> Pop(size_t worker_index);
+
+    /*
+     * Run the tasks until the pool is destroyed.
+     * @param worker_index The index of the worker.
+     */
+    void RunWorker(size_t worker_index);
+
+    std::vector<std::unique_ptr<TaskQueue>> queues_;
+    std::vector<std::thread> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable has_tasks_;
+    size_t pending_tasks_count_ { 0 };
+    size_t next_queue_index_ { 0 };
+    bool is_stopped_ { false };
+};
@@ -0,0 +1,314 @@
+#include "trace.h"
+
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+/*
+ * A begin or an end of a stage.
+ */
+struct TraceEvent
+{
+    uint64_t timestamp; // nanoseconds from the start of the tracing
+    uint32_t file_index; // the index in the trace file names
+    uint32_t block_index;
+    TraceStage stage;
+    bool is_begin;
+};
+
+/*
+ * The events of one thread. Only its thread writes them, the count is published after each event
+ * so that the events below it are complete when the timeline is written.
+ */
+struct TraceBuffer
+{
+    std::array<TraceEvent, TRACE_BUFFER_EVENTS> events;
+    std::atomic<uint64_t> events_count { 0 };
+    size_t thread_index;
+};
+
+/*
+ * The buffers of all the threads that ever recorded and the names of the traced files. The
+ * buffers live until the program exits, so that a thread keeps its buffer across jobs.
+ */
+struct TraceRegistry
+{
+    std::mutex mutex;
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+    std::vector<std::string> file_names { "" };
+    std::unordered_map<std::string, uint32_t> file_indices { { "", 0 } };
+    std::chrono::steady_clock::time_point start_time;
+};
+
+TraceRegistry& GetTraceRegistry()
+{
+    static TraceRegistry registry;
+    return registry;
+}
+
+/*
+ * What the calling thread works on.
+ */
+struct ThreadTraceState
+{
+    TraceBuffer* buffer = nullptr;
+    uint32_t file_index = 0;
+    uint32_t block_index = 0;
+};
+
+thread_local ThreadTraceState thread_trace_state;
+
+/*
+ * Get the name of a stage shown on the timeline.
+ * @param stage The stage.
+ * @return The name.
+ */
+const char* GetStageName(TraceStage stage)
+{
+    switch (stage)
+    {
+    case TraceStage::Histogram:
+        return "histogram";
+    case TraceStage::TreeBuild:
+        return "tree build";
+    case TraceStage::Canonicalize:
+        return "canonicalize";
+    case TraceStage::Encode:
+        return "encode";
+    case TraceStage::Decode:
+        return "decode";
+    case TraceStage::Read:
+        return "read";
+    case TraceStage::Flush:
+        return "flush";
+    }
+    return "unknown";
+}
+
+/*
+ * Get the length of the UTF-8 sequence at a position of a string.
+ * @param text The string.
+ * @param position The position of the first byte of the sequence.
+ * @return The length of the sequence, 0 if it is not valid UTF-8.
+ */
+size_t GetUtf8SequenceLength(const std::string& text, size_t position)
+{
+    auto byte_at = [&](size_t i) { return static_cast<unsigned char>(text[i]); };
+    unsigned char first = byte_at(position);
+    if (first < 0x80)
+    {
+        return 1;
+    }
+
+    // A lead byte below 0xC2 is a continuation byte or starts an overlong form
+    size_t length = 0;
+    if (first >= 0xC2 && first < 0xE0)
+    {
+        length = 2;
+    }
+    else if (first >= 0xE0 && first < 0xF0)
+    {
+        length = 3;
+    }
+    else if (first >= 0xF0 && first < 0xF5)
+    {
+        length = 4;
+    }
+    if (length == 0 || position + length > text.size())
+    {
+        return 0;
+    }
+
+    // The second byte also excludes the overlong forms, the surrogates and the code points past
+    // U+10FFFF
+    unsigned char second_min = first == 0xE0 ? 0xA0 : first == 0xF0 ? 0x90 : 0x80;
+    unsigned char second_max = first == 0xED ? 0x9F : first == 0xF4 ? 0x8F : 0xBF;
+    for (size_t i = 1; i < length; ++i)
+    {
+        unsigned char byte = byte_at(position + i);
+        if (byte < (i == 1 ? second_min : 0x80) || byte > (i == 1 ? second_max : 0xBF))
+        {
+            return 0;
+        }
+    }
+    return length;
+}
+
+/*
+ * Quote a string for JSON. The bytes that are not valid UTF-8, as a file name may have, are
+ * escaped as the code points of the same value.
+ * @param text The string.
+ * @return The quoted string.
+ */
+std::string QuoteJson(const std::string& text)
+{
+    constexpr char HEX_DIGITS[] = "0123456789abcdef";
+    std::string quoted = "\"";
+    for (size_t i = 0; i < text.size();)
+    {
+        auto character = static_cast<unsigned char>(text[i]);
+        size_t length = GetUtf8SequenceLength(text, i);
+        if (character == '"' || character == '\\')
+        {
+            quoted += '\\';
+            quoted += static_cast<char>(character);
+        }
+        else if (character < 0x20 || length == 0)
+        {
+            quoted += "\\u00";
+            quoted += HEX_DIGITS[character >> 4];
+            quoted += HEX_DIGITS[character & 0xF];
+        }
+        else
+        {
+            quoted.append(text, i, length);
+            i += length;
+            continue;
+        }
+        ++i;
+    }
+    return quoted + "\"";
+}
+}
+
+void StartTracing()
+{
+    if constexpr (!TRACING_BUILT)
+    {
+        throw std::logic_error("Tracing is compiled out of this build");
+    }
+
+    auto& registry = GetTraceRegistry();
+    std::lock_guard lock(registry.mutex);
+    for (auto& buffer : registry.buffers)
+    {
+        buffer->events_count.store(0, std::memory_order_relaxed);
+    }
+    registry.start_time = std::chrono::steady_clock::now();
+    is_tracing.store(true, std::memory_order_release);
+}
+
+void WriteTrace(const std::string& trace_path)
+{
+    is_tracing.store(false, std::memory_order_relaxed);
+
+    std::ofstream file(trace_path);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("The trace cannot be written to " + trace_path);
+    }
+
+    auto& registry = GetTraceRegistry();
+    std::lock_guard lock(registry.mutex);
+    file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool is_first_event = true;
+    auto start_event = [&]
+    {
+        file << (is_first_event ? "\n" : ",\n");
+        is_first_event = false;
+    };
+
+    for (const auto& buffer : registry.buffers)
+    {
+        uint64_t events_count = buffer->events_count.load(std::memory_order_acquire);
+        if (events_count == 0)
+        {
+            continue;
+        }
+
+        start_event();
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->thread_index
+             << ",\"args\":{\"name\":\"thread " << buffer->thread_index << "\"}}";
+
+        // Skip the ends whose begins were overwritten
+        size_t depth = 0;
+        uint64_t first_event = events_count > TRACE_BUFFER_EVENTS
+            ? events_count - TRACE_BUFFER_EVENTS
+            : 0;
+        for (uint64_t i = first_event; i < events_count; ++i)
+        {
+            const auto& event = buffer->events[i % TRACE_BUFFER_EVENTS];
+            if (!event.is_begin && depth == 0)
+            {
+                continue;
+            }
+            depth = event.is_begin ? depth + 1 : depth - 1;
+
+            start_event();
+            file << "{\"name\":\"" << GetStageName(event.stage) << "\",\"ph\":\""
+                 << (event.is_begin ? 'B' : 'E') << "\",\"pid\":1,\"tid\":" << buffer->thread_index
+                 << ",\"ts\":" << event.timestamp / 1000 << '.' << event.timestamp / 100 % 10
+                 << event.timestamp / 10 % 10 << event.timestamp % 10;
+            if (event.is_begin)
+            {
+                file << ",\"args\":{\"file\":" << QuoteJson(registry.file_names[event.file_index])
+                     << ",\"block\":" << event.block_index << '}';
+            }
+            file << '}';
+        }
+    }
+    file << "\n]}\n";
+
+    if (!file)
+    {
+        throw std::runtime_error("The trace cannot be written to " + trace_path);
+    }
+}
+
+void SetTraceFile(const std::string& file_name)
+{
+    if (!TRACING_BUILT || !is_tracing.load(std::memory_order_acquire))
+    {
+        return;
+    }
+
+    auto& registry = GetTraceRegistry();
+    std::lock_guard lock(registry.mutex);
+    auto [it, is_new] = registry.file_indices.emplace(file_name, registry.file_names.size());
+    if (is_new)
+    {
+        registry.file_names.push_back(file_name);
+    }
+    thread_trace_state.file_index = it->second;
+    thread_trace_state.block_index = 0;
+}
+
+void SetTraceBlock(size_t block_index)
+{
+    thread_trace_state.block_index = static_cast<uint32_t>(block_index);
+}
+
+void RecordTraceEvent(TraceStage stage, bool is_begin)
+{
+    auto& state = thread_trace_state;
+    auto& registry = GetTraceRegistry();
+    if (state.buffer == nullptr)
+    {
+        // The first event of the thread, the only one that takes the lock
+        auto buffer = std::make_unique<TraceBuffer>();
+        std::lock_guard lock(registry.mutex);
+        buffer->thread_index = registry.buffers.size() + 1;
+        state.buffer = buffer.get();
+        registry.buffers.push_back(std::move(buffer));
+    }
+
+    auto& buffer = *state.buffer;
+    uint64_t events_count = buffer.events_count.load(std::memory_order_relaxed);
+    auto elapsed = std::chrono::steady_clock::now() - registry.start_time;
+    buffer.events[events_count % TRACE_BUFFER_EVENTS] = {
+        .timestamp = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()),
+        .file_index = state.file_index,
+        .block_index = state.block_index,
+        .stage = stage,
+        .is_begin = is_begin,
+    };
+    buffer.events_count.store(events_count + 1, std::memory_order_release);
+}
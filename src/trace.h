@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Timeline of the stages of the encoder and the decoder in the Chrome trace format, which
+ * chrome://tracing and Perfetto open. Each thread records the begin and the end of its stages with
+ * the file and the block they work on into a ring buffer of its own, without locks, and the
+ * timeline is written once the job is done. Configuring with -DARCHIVER_TRACING=OFF compiles the
+ * recording out, otherwise a stage costs one atomic load while tracing is off.
+ */
+
+#ifdef ARCHIVER_TRACING
+constexpr bool TRACING_BUILT = true;
+#else
+constexpr bool TRACING_BUILT = false;
+#endif
+
+/*
+ * Number of events a thread keeps, the oldest events are overwritten past it.
+ */
+constexpr size_t TRACE_BUFFER_EVENTS = 1 << 16;
+
+/*
+ * Stages of the timeline.
+ */
+enum class TraceStage : uint8_t
+{
+    Histogram, // counting the characters of a range or a block
+    TreeBuild, // building the Huffman tree and limiting the code lengths
+    Canonicalize, // turning the code lengths into canonical codes and decoding tables
+    Encode, // coding a block, with its histogram and table when it builds one
+    Decode, // restoring a block, with its table
+    Read, // reading characters from a file
+    Flush, // writing bytes to a file
+};
+
+/*
+ * Whether the events are being recorded.
+ */
+inline std::atomic<bool> is_tracing { false };
+
+/*
+ * Drop the recorded events and start recording. The threads should not be recording meanwhile.
+ */
+void StartTracing();
+
+/*
+ * Stop recording and write the events recorded since the start in the Chrome trace format.
+ * @param trace_path The path to the JSON file.
+ */
+void WriteTrace(const std::string& trace_path);
+
+/*
+ * Set the file the stages of the calling thread work on, the block goes back to the first one.
+ * @param file_name The name of the file.
+ */
+void SetTraceFile(const std::string& file_name);
+
+/*
+ * Set the block the stages of the calling thread work on.
+ * @param block_index The index of the block in its file.
+ */
+void SetTraceBlock(size_t block_index);
+
+/*
+ * Record the begin or the end of a stage on the calling thread.
+ * @param stage The stage.
+ * @param is_begin Whether the stage begins.
+ */
+void RecordTraceEvent(TraceStage stage, bool is_begin);
+
+/*
+ * A stage recorded from the construction to the destruction of the scope.
+ */
+class TraceScope
+{
+public:
+    /*
+     * Constructor.
+     * @param stage The stage.
+     */
+    explicit TraceScope(TraceStage stage)
+    {
+        if constexpr (TRACING_BUILT)
+        {
+            if (is_tracing.load(std::memory_order_acquire))
+            {
+                stage_ = stage;
+                is_recording_ = true;
+                RecordTraceEvent(stage, true);
+            }
+        }
+    }
+
+    /*
+     * Destructor.
+     */
+    ~TraceScope()
+    {
+        if constexpr (TRACING_BUILT)
+        {
+            if (is_recording_)
+            {
+                RecordTraceEvent(stage_, false);
+            }
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    TraceStage stage_ {};
+    bool is_recording_ { false };
+};
@@ -0,0 +1,418 @@
+#include "transform.h"
+
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <stdexcept>
+
+std::vector<int32_t> BuildSuffixArray(const std::vector<int32_t>& text, int32_t alphabet_size)
+{
+    auto text_size = static_cast<int32_t>(text.size());
+    std::vector<int32_t> suffix_array(text_size, -1);
+    if (text_size < 2)
+    {
+        std::iota(suffix_array.begin(), suffix_array.end(), 0);
+        return suffix_array;
+    }
+
+    // A suffix is of S-type if it is smaller than the next one and of L-type otherwise, the
+    // leftmost S-type suffixes (LMS) of each run are the ones sorted first
+    std::vector<unsigned char> is_s_type(text_size, false);
+    is_s_type[text_size - 1] = true;
+    for (int32_t i = text_size - 2; i >= 0; --i)
+    {
+        is_s_type[i] = text[i] < text[i + 1] || (text[i] == text[i + 1] && is_s_type[i + 1]);
+    }
+    auto is_lms = [&](int32_t i) { return i > 0 && is_s_type[i] && !is_s_type[i - 1]; };
+
+    // Every value owns a bucket of the suffix array, L-type suffixes fill it from the start and
+    // S-type ones from the end
+    std::vector<int32_t> bucket_sizes(alphabet_size, 0);
+    for (auto value : text)
+    {
+        ++bucket_sizes[value];
+    }
+    std::vector<int32_t> bucket_pointers(alphabet_size);
+    auto set_bucket_starts = [&]
+    {
+        int32_t sum = 0;
+        for (int32_t value = 0; value < alphabet_size; ++value)
+        {
+            bucket_pointers[value] = sum;
+            sum += bucket_sizes[value];
+        }
+    };
+    auto set_bucket_ends = [&]
+    {
+        int32_t sum = 0;
+        for (int32_t value = 0; value < alphabet_size; ++value)
+        {
+            sum += bucket_sizes[value];
+            bucket_pointers[value] = sum;
+        }
+    };
+
+    // Sort the L-type suffixes from the placed LMS ones, then the S-type ones from the L-type ones
+    auto induce_sort = [&]
+    {
+        set_bucket_starts();
+        for (int32_t i = 0; i < text_size; ++i)
+        {
+            int32_t previous = suffix_array[i] - 1;
+            if (suffix_array[i] > 0 && !is_s_type[previous])
+            {
+                suffix_array[bucket_pointers[text[previous]]++] = previous;
+            }
+        }
+
+        set_bucket_ends();
+        for (int32_t i = text_size - 1; i >= 0; --i)
+        {
+            int32_t previous = suffix_array[i] - 1;
+            if (suffix_array[i] > 0 && is_s_type[previous])
+            {
+                suffix_array[--bucket_pointers[text[previous]]] = previous;
+            }
+        }
+    };
+
+    // Sort the LMS substrings, the ones from an LMS position up to the next one
+    set_bucket_ends();
+    for (int32_t i = 1; i < text_size; ++i)
+    {
+        if (is_lms(i))
+        {
+            suffix_array[--bucket_pointers[text[i]]] = i;
+        }
+    }
+    induce_sort();
+
+    // Name the LMS substrings in their sorted order, equal substrings get the same name
+    auto are_lms_substrings_equal = [&](int32_t lhs, int32_t rhs)
+    {
+        for (int32_t i = 0;; ++i)
+        {
+            if (text[lhs + i] != text[rhs + i] || is_s_type[lhs + i] != is_s_type[rhs + i])
+            {
+                return false;
+            }
+            if (i > 0 && (is_lms(lhs + i) || is_lms(rhs + i)))
+            {
+                return is_lms(lhs + i) && is_lms(rhs + i);
+            }
+        }
+    };
+
+    std::vector<int32_t> names(text_size, -1);
+    int32_t names_count = 0;
+    int32_t previous_lms = -1;
+    for (auto position : suffix_array)
+    {
+        if (!is_lms(position))
+        {
+            continue;
+        }
+        if (previous_lms < 0 || !are_lms_substrings_equal(previous_lms, position))
+        {
+            ++names_count;
+        }
+        names[position] = names_count - 1;
+        previous_lms = position;
+    }
+
+    // Sort the LMS suffixes by the text of their names, recursively if some names repeat
+    std::vector<int32_t> lms_positions;
+    std::vector<int32_t> reduced_text;
+    for (int32_t i = 1; i < text_size; ++i)
+    {
+        if (is_lms(i))
+        {
+            lms_positions.push_back(i);
+            reduced_text.push_back(names[i]);
+        }
+    }
+
+    auto lms_count = static_cast<int32_t>(lms_positions.size());
+    std::vector<int32_t> reduced_suffix_array(lms_count);
+    if (names_count < lms_count)
+    {
+        reduced_suffix_array = BuildSuffixArray(reduced_text, names_count);
+    }
+    else
+    {
+        for (int32_t i = 0; i < lms_count; ++i)
+        {
+            reduced_suffix_array[reduced_text[i]] = i;
+        }
+    }
+
+    // Place the sorted LMS suffixes at the ends of their buckets and induce the others
+    std::fill(suffix_array.begin(), suffix_array.end(), -1);
+    set_bucket_ends();
+    for (int32_t i = lms_count - 1; i >= 0; --i)
+    {
+        int32_t position = lms_positions[reduced_suffix_array[i]];
+        suffix_array[--bucket_pointers[text[position]]] = position;
+    }
+    induce_sort();
+
+    return suffix_array;
+}
+
+std::vector<unsigned char> ApplyBwt(const std::vector<unsigned char>& block)
+{
+    if (block.size() > MAX_BWT_BLOCK_SIZE)
+    {
+        throw std::invalid_argument("The block is too large for the Burrows-Wheeler transform");
+    }
+
+    // Sort the suffixes of the block ended with a marker smaller than any character
+    std::vector<int32_t> text(block.size() + 1, 0);
+    for (size_t i = 0; i < block.size(); ++i)
+    {
+        text[i] = block[i] + 1;
+    }
+    auto suffix_array = BuildSuffixArray(text, UINT8_MAX + 2);
+
+    // Take the character in front of each suffix, the marker is left out and its row is written
+    // in front instead
+    std::vector<unsigned char> transformed(4);
+    transformed.reserve(block.size() + 4);
+    uint32_t original_index = 0;
+    for (size_t row = 0; row < suffix_array.size(); ++row)
+    {
+        if (suffix_array[row] == 0)
+        {
+            original_index = row;
+            continue;
+        }
+        transformed.push_back(block[suffix_array[row] - 1]);
+    }
+
+    for (size_t i = 0; i < 4; ++i)
+    {
+        transformed[i] = static_cast<unsigned char>(original_index >> (8 * i));
+    }
+    return transformed;
+}
+
+std::vector<unsigned char> InvertBwt(const std::vector<unsigned char>& block)
+{
+    if (block.size() < 4)
+    {
+        throw std::runtime_error("The Burrows-Wheeler transformed block is too short");
+    }
+
+    size_t block_size = block.size() - 4;
+    size_t original_index = 0;
+    for (size_t i = 0; i < 4; ++i)
+    {
+        original_index |= static_cast<size_t>(block[i]) << (8 * i);
+    }
+    if (block_size > MAX_BWT_BLOCK_SIZE || original_index > block_size
+        || (block_size > 0 && original_index == 0))
+    {
+        throw std::runtime_error("The Burrows-Wheeler transformed block is corrupted");
+    }
+
+    // The last character of each row, the row of the original rotation ends with the marker
+    auto get_last_character = [&](size_t row)
+    { return block[4 + row - (row > original_index ? 1 : 0)]; };
+
+    // Map each row to the row starting with its last character, the marker row comes first
+    std::array<size_t, UINT8_MAX + 1> first_rows {};
+    for (size_t i = 4; i < block.size(); ++i)
+    {
+        ++first_rows[block[i]];
+    }
+    size_t rows_count = 1;
+    for (auto& first_row : first_rows)
+    {
+        rows_count += first_row;
+        first_row = rows_count - first_row;
+    }
+
+    // Keep the next row and the last character in one value, so that each step of the walk below
+    // touches memory once
+    std::vector<uint32_t> next_rows(block_size + 1);
+    for (size_t row = 0; row <= block_size; ++row)
+    {
+        if (row != original_index)
+        {
+            auto character = get_last_character(row);
+            next_rows[row] = static_cast<uint32_t>(first_rows[character]++ << 8 | character);
+        }
+    }
+
+    // Walk the rows from the one starting with the marker, which ends with the last character
+    std::vector<unsigned char> original(block_size);
+    size_t row = 0;
+    for (size_t i = block_size; i-- > 0;)
+    {
+        if (row == original_index)
+        {
+            throw std::runtime_error("The Burrows-Wheeler transformed block is corrupted");
+        }
+        original[i] = static_cast<unsigned char>(next_rows[row]);
+        row = next_rows[row] >> 8;
+    }
+    return original;
+}
+
+std::vector<unsigned char> ApplyMtf(const std::vector<unsigned char>& block)
+{
+    std::array<unsigned char, UINT8_MAX + 1> recent_characters;
+    std::iota(recent_characters.begin(), recent_characters.end(), 0);
+
+    std::vector<unsigned char> positions(block.size());
+    for (size_t i = 0; i < block.size(); ++i)
+    {
+        unsigned char character = block[i];
+        size_t position = 0;
+        while (recent_characters[position] != character)
+        {
+            ++position;
+        }
+        positions[i] = static_cast<unsigned char>(position);
+
+        std::copy_backward(recent_characters.begin(),
+                           recent_characters.begin() + position,
+                           recent_characters.begin() + position + 1);
+        recent_characters[0] = character;
+    }
+    return positions;
+}
+
+std::vector<unsigned char> InvertMtf(const std::vector<unsigned char>& block)
+{
+    std::array<unsigned char, UINT8_MAX + 1> recent_characters;
+    std::iota(recent_characters.begin(), recent_characters.end(), 0);
+
+    std::vector<unsigned char> original(block.size());
+    for (size_t i = 0; i < block.size(); ++i)
+    {
+        size_t position = block[i];
+        unsigned char character = recent_characters[position];
+        original[i] = character;
+
+        std::copy_backward(recent_characters.begin(),
+                           recent_characters.begin() + position,
+                           recent_characters.begin() + position + 1);
+        recent_characters[0] = character;
+    }
+    return original;
+}
+
+std::vector<unsigned char> ApplyRle(const std::vector<unsigned char>& block)
+{
+    constexpr size_t max_run_length = 4 + UINT8_MAX;
+
+    std::vector<unsigned char> shortened;
+    shortened.reserve(block.size());
+    for (size_t i = 0; i < block.size();)
+    {
+        unsigned char character = block[i];
+        size_t run_length = 1;
+        while (i + run_length < block.size() && block[i + run_length] == character
+               && run_length < max_run_length)
+        {
+            ++run_length;
+        }
+
+        shortened.insert(shortened.end(), std::min<size_t>(run_length, 4), character);
+        if (run_length >= 4)
+        {
+            shortened.push_back(static_cast<unsigned char>(run_length - 4));
+        }
+        i += run_length;
+    }
+    return shortened;
+}
+
+std::vector<unsigned char> InvertRle(const std::vector<unsigned char>& block, size_t max_size)
+{
+    std::vector<unsigned char> original;
+    original.reserve(block.size());
+
+    size_t run_length = 0;
+    for (size_t i = 0; i < block.size(); ++i)
+    {
+        unsigned char character = block[i];
+        run_length = run_length > 0 && original.back() == character ? run_length + 1 : 1;
+        original.push_back(character);
+
+        // The count of the further repeats follows four equal characters, a new run starts after
+        if (run_length == 4)
+        {
+            if (++i == block.size())
+            {
+                throw std::runtime_error("The run-length encoded block misses a run count");
+            }
+            if (block[i] > max_size - std::min(original.size(), max_size))
+            {
+                throw std::runtime_error("The run-length encoded block is larger than its size");
+            }
+            original.insert(original.end(), block[i], character);
+            run_length = 0;
+        }
+    }
+    if (original.size() > max_size)
+    {
+        throw std::runtime_error("The run-length encoded block is larger than its size");
+    }
+    return original;
+}
+
+std::vector<unsigned char> ApplyTransforms(std::vector<unsigned char> block, uint16_t transforms)
+{
+    if ((transforms & ~ALL_TRANSFORMS) != 0)
+    {
+        throw std::invalid_argument("Unknown block transform");
+    }
+
+    if ((transforms & static_cast<uint16_t>(Transform::Bwt)) != 0)
+    {
+        block = ApplyBwt(block);
+    }
+    if ((transforms & static_cast<uint16_t>(Transform::Mtf)) != 0)
+    {
+        block = ApplyMtf(block);
+    }
+    if ((transforms & static_cast<uint16_t>(Transform::Rle)) != 0)
+    {
+        block = ApplyRle(block);
+    }
+    return block;
+}
+
+size_t GetMaxTransformedSize(size_t block_size)
+{
+    // The 32-bit index of the original rotation, then a count after every four characters
+    size_t bwt_size = block_size + 4;
+    return bwt_size + bwt_size / 4;
+}
+
+std::vector<unsigned char>
+InvertTransforms(std::vector<unsigned char> block, uint16_t transforms, size_t max_size)
+{
+    if ((transforms & ~ALL_TRANSFORMS) != 0)
+    {
+        throw std::runtime_error("Unknown block transform in the archive");
+    }
+
+    // The runs expand to the block of the inverse BWT, which still has its 32-bit index
+    if ((transforms & static_cast<uint16_t>(Transform::Rle)) != 0)
+    {
+        bool is_bwt = (transforms & static_cast<uint16_t>(Transform::Bwt)) != 0;
+        block = InvertRle(block, is_bwt && max_size <= SIZE_MAX - 4 ? max_size + 4 : max_size);
+    }
+    if ((transforms & static_cast<uint16_t>(Transform::Mtf)) != 0)
+    {
+        block = InvertMtf(block);
+    }
+    if ((transforms & static_cast<uint16_t>(Transform::Bwt)) != 0)
+    {
+        block = InvertBwt(block);
+    }
+    return block;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Reversible transforms of a block applied before the entropy coding. A set of transforms is
+ * written as a combination of the flags and they are applied in the order of the flags.
+ */
+enum class Transform : uint16_t
+{
+    Bwt = 1, // Burrows-Wheeler transform, the index of the original rotation goes first
+    Mtf = 2, // move-to-front coding of the characters
+    Rle = 4, // four equal characters are followed by the count of their further repeats
+};
+
+/*
+ * All transform flags combined.
+ */
+constexpr uint16_t ALL_TRANSFORMS = 7;
+
+/*
+ * Largest block the Burrows-Wheeler transform takes, its inverse packs a row index into 24 bits.
+ */
+constexpr size_t MAX_BWT_BLOCK_SIZE = (1 << 24) - 1;
+
+/*
+ * Build the suffix array in linear time with the induced sorting algorithm (SA-IS).
+ * @param text The text, its last value should be zero and appear nowhere else.
+ * @param alphabet_size The number of distinct values the text may hold.
+ * @return The start positions of the suffixes of the text in sorted order.
+ */
+std::vector<int32_t> BuildSuffixArray(const std::vector<int32_t>& text, int32_t alphabet_size);
+
+/*
+ * Apply the Burrows-Wheeler transform.
+ * @param block The block content.
+ * @return The 32-bit index of the original rotation, followed by the last column of the sorted
+ * rotations without the end-of-block marker.
+ */
+std::vector<unsigned char> ApplyBwt(const std::vector<unsigned char>& block);
+
+/*
+ * Invert the Burrows-Wheeler transform.
+ * @param block The transformed block.
+ * @return The original block.
+ */
+std::vector<unsigned char> InvertBwt(const std::vector<unsigned char>& block);
+
+/*
+ * Replace every character with its position in the list of recently used characters.
+ * @param block The block content.
+ * @return The positions.
+ */
+std::vector<unsigned char> ApplyMtf(const std::vector<unsigned char>& block);
+
+/*
+ * Invert the move-to-front coding.
+ * @param block The positions.
+ * @return The original block.
+ */
+std::vector<unsigned char> InvertMtf(const std::vector<unsigned char>& block);
+
+/*
+ * Shorten the runs of equal characters: after four equal characters goes the count of their
+ * further repeats, up to 255.
+ * @param block The block content.
+ * @return The shortened block.
+ */
+std::vector<unsigned char> ApplyRle(const std::vector<unsigned char>& block);
+
+/*
+ * Expand the runs shortened by ApplyRle.
+ * @param block The shortened block.
+ * @param max_size The size the original block may not exceed.
+ * @return The original block.
+ */
+std::vector<unsigned char> InvertRle(const std::vector<unsigned char>& block,
+                                     size_t max_size = SIZE_MAX);
+
+/*
+ * Apply a set of transforms in the order of their flags.
+ * @param block The block content.
+ * @param transforms The combination of the Transform flags.
+ * @return The transformed block.
+ */
+std::vector<unsigned char> ApplyTransforms(std::vector<unsigned char> block, uint16_t transforms);
+
+/*
+ * Get the largest size the transforms may take a block to: BWT adds the index of the original
+ * rotation, and RLE a count after every four equal characters.
+ * @param block_size The size of the block.
+ * @return The largest size of the transformed block.
+ */
+size_t GetMaxTransformedSize(size_t block_size);
+
+/*
+ * Invert a set of transforms in the reverse order of their flags.
+ * @param block The transformed block.
+ * @param transforms The combination of the Transform flags.
+ * @param max_size The size the original block may not exceed.
+ * @return The original block.
+ */
+std::vector<unsigned char> InvertTransforms(std::vector<unsigned char> block,
+                                            uint16_t transforms,
+                                            size_t max_size = SIZE_MAX);
@@ -0,0 +1,173 @@
+#include "ans.h"
+#include "archiver.h"
+#include "huffman.h"
+
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+std::array<uint64_t, UINT8_MAX + 1> CountCharacters(const std::vector<unsigned char>& block)
+{
+    std::array<uint64_t, UINT8_MAX + 1> counts {};
+    for (auto character : block)
+    {
+        ++counts[character];
+    }
+    return counts;
+}
+
+TEST(AnsTest, FrequenciesAddUpToTotal)
+{
+    std::array<uint64_t, UINT8_MAX + 1> counts {};
+    counts.fill(1);
+    counts['e'] = 1'000'000;
+    auto frequencies = NormalizeAnsFrequencies(counts);
+
+    uint64_t total = 0;
+    for (auto frequency : frequencies)
+    {
+        EXPECT_GT(frequency, 0);
+        total += frequency;
+    }
+    EXPECT_EQ(total, 1 << ANS_SCALE_BITS);
+}
+
+TEST(AnsTest, BlocksRoundTrip)
+{
+    std::mt19937 generator(11);
+    std::geometric_distribution<int> skewed_distribution(0.3);
+
+    std::vector<std::vector<unsigned char>> blocks
+        = { {}, { 'a' }, std::vector<unsigned char>(1000, 'z') };
+    std::vector<unsigned char> random_block(10000);
+    for (auto& character : random_block)
+    {
+        character = static_cast<unsigned char>(generator());
+    }
+    blocks.push_back(random_block);
+    std::vector<unsigned char> skewed_block(10000);
+    for (auto& character : skewed_block)
+    {
+        character = static_cast<unsigned char>(std::min(skewed_distribution(generator), 255));
+    }
+    blocks.push_back(skewed_block);
+
+    for (const auto& block : blocks)
+    {
+        auto counts = CountCharacters(block);
+        auto frequencies = NormalizeAnsFrequencies(counts);
+        auto code = EncodeAns(block, frequencies);
+        EXPECT_EQ(DecodeAns(code, frequencies, block.size()), block);
+
+        // The estimate leaves out the final states only
+        EXPECT_LE(code.size(), (CountAnsBits(counts, frequencies) + 7) / 8 + 8 + 1);
+    }
+}
+
+TEST(AnsTest, CorruptedCodeThrows)
+{
+    std::vector<unsigned char> block = { 'a', 'b', 'a', 'c' };
+    auto frequencies = NormalizeAnsFrequencies(CountCharacters(block));
+    auto code = EncodeAns(block, frequencies);
+
+    code.resize(3);
+    EXPECT_THROW(DecodeAns(code, frequencies, block.size()), std::runtime_error);
+
+    auto excessive_frequencies = frequencies;
+    excessive_frequencies['z'] = 1;
+    EXPECT_THROW(DecodeAns(code, excessive_frequencies, block.size()), std::runtime_error);
+}
+
+TEST(AnsTest, AnsBlocksShrinkSkewedFile)
+{
+    std::mt19937 generator(3);
+    {
+        // Huffman spends a whole bit on the dominant character, rANS about a tenth of it
+        FileWriter writer("test_ans.txt");
+        for (size_t i = 0; i < 50000; ++i)
+        {
+            writer.WriteCharacter(generator() % 20 == 0 ? 'b' + generator() % 4 : 'a');
+        }
+    }
+
+    EncodingOptions huffman_options { .collect_stats = true };
+    EncodingOptions ans_options { .ans_blocks = true, .collect_stats = true };
+
+    EncodingStats huffman_stats;
+    EncodingStats ans_stats;
+    {
+        HuffmanCoder huffman_coder(huffman_options);
+        FileReader reader("test_ans.txt");
+        FileWriter writer("test_huffman.huff");
+        huffman_stats = huffman_coder.Encode(reader, writer);
+    }
+    {
+        HuffmanCoder huffman_coder(ans_options);
+        FileReader reader("test_ans.txt");
+        FileWriter writer("test_ans.huff");
+        ans_stats = huffman_coder.Encode(reader, writer);
+    }
+    EXPECT_LT(ans_stats.encoded_bits, huffman_stats.encoded_bits * 9 / 10);
+
+    std::string original_file_text;
+    {
+        FileReader reader("test_ans.txt");
+        auto characters = reader.ReadCharacters(reader.GetFileSize());
+        original_file_text.assign(characters.begin(), characters.end());
+    }
+
+    std::filesystem::remove("test_ans.txt");
+    {
+        HuffmanCoder huffman_coder;
+        FileReader reader("test_ans.huff");
+        huffman_coder.Decode(reader);
+    }
+
+    FileReader reader("test_ans.txt");
+    auto characters = reader.ReadCharacters(original_file_text.size() + 1);
+    EXPECT_EQ(std::string(characters.begin(), characters.end()), original_file_text);
+}
+
+TEST(AnsTest, SegmentsEncodedApartKeepTheCodeAligned)
+{
+    std::mt19937 generator(5);
+    std::string original_file_text;
+    for (size_t i = 0; i < 200000; ++i)
+    {
+        bool is_rare = generator() % 20 == 0;
+        original_file_text += is_rare ? static_cast<char>('b' + generator() % 4) : 'a';
+    }
+    {
+        FileWriter writer("test_ans.txt");
+        for (auto character : original_file_text)
+        {
+            writer.WriteCharacter(character);
+        }
+    }
+
+    // Every block is a segment, the pool encodes them apart and the archive appends their bits
+    std::vector<std::string> archives;
+    for (size_t threads_count : { 1, 4 })
+    {
+        EncodingOptions options = GetLevelOptions(6);
+        options.ans_blocks = true;
+        options.block_size = 16 << 10;
+        options.sync_interval = 16 << 10;
+        options.threads_count = threads_count;
+        Archiver("test_ans.huff", { "test_1.txt", "test_ans.txt" }, options).Compress();
+
+        FileReader reader("test_ans.huff");
+        auto characters = reader.ReadCharacters(reader.GetFileSize());
+        archives.emplace_back(characters.begin(), characters.end());
+    }
+    EXPECT_EQ(archives[0], archives[1]);
+
+    std::filesystem::remove("test_ans.txt");
+    Archiver("test_ans.huff").Decompress();
+
+    FileReader reader("test_ans.txt");
+    auto characters = reader.ReadCharacters(original_file_text.size() + 1);
+    EXPECT_EQ(std::string(characters.begin(), characters.end()), original_file_text);
+}
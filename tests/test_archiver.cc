@@ -1,7 +1,10 @@
 #include "archiver.h"
 #include "filereader.h"
+#include "filewriter.h"
 
+#include <filesystem>
 #include <gtest/gtest.h>
+#include <stdexcept>
 
 TEST(ArchiverTest, CompressionAndDecompressionOfOneFile)
 {
@@ -106,3 +109,504 @@ TEST(ArchiverTest, CompressionAndDecompressionOfSeveralFiles)
 
     EXPECT_EQ(original_file_text_2, decompressed_file_text_2);
 }
+
+TEST(ArchiverTest, CompressionAndDecompressionAtEveryLevel)
+{
+    // Repeat the texts, so that the file spans several blocks at the higher levels
+    std::string original_file_text;
+    for (const auto& file_path : { "test_1.txt", "test_2.txt" })
+    {
+        FileReader reader(file_path);
+        auto characters = reader.ReadCharacters(reader.GetFileSize());
+        original_file_text.append(characters.begin(), characters.end());
+    }
+    original_file_text.push_back('\0');
+    for (size_t i = 0; i < 7; ++i)
+    {
+        original_file_text += original_file_text;
+    }
+
+    for (int level = MIN_LEVEL; level <= MAX_LEVEL; ++level)
+    {
+        {
+            FileWriter writer("test_levels.txt");
+            for (auto character : original_file_text)
+            {
+                writer.WriteCharacter(character);
+            }
+        }
+
+        Archiver archiver("test_archive.huff",
+                          { "test_levels.txt", "test_2.txt" },
+                          GetLevelOptions(level));
+        archiver.Compress();
+        std::filesystem::remove("test_levels.txt");
+        archiver.Decompress();
+
+        FileReader reader("test_levels.txt");
+        auto characters = reader.ReadCharacters(original_file_text.size() + 1);
+        EXPECT_EQ(std::string(characters.begin(), characters.end()), original_file_text)
+            << "level " << level;
+    }
+}
+
+TEST(ArchiverTest, AppendToArchive)
+{
+    std::string original_file_text_1;
+    std::string original_file_text_2;
+    {
+        FileReader reader_1("test_1.txt");
+        auto characters_1 = reader_1.ReadCharacters(reader_1.GetFileSize());
+        original_file_text_1.assign(characters_1.begin(), characters_1.end());
+
+        FileReader reader_2("test_2.txt");
+        auto characters_2 = reader_2.ReadCharacters(reader_2.GetFileSize());
+        original_file_text_2.assign(characters_2.begin(), characters_2.end());
+    }
+
+    // Append with a shared table to an archive without one and the other way around
+    for (auto [first_level, second_level] : { std::pair { 6, 2 }, std::pair { 2, 9 } })
+    {
+        Archiver("test_append.huff", { "test_1.txt" }, GetLevelOptions(first_level)).Compress();
+        size_t archive_size = std::filesystem::file_size("test_append.huff");
+
+        Archiver("test_append.huff", { "test_2.txt" }, GetLevelOptions(second_level)).Append();
+        EXPECT_GT(std::filesystem::file_size("test_append.huff"), archive_size);
+
+        Archiver("test_append.huff").Decompress();
+
+        FileReader reader_1("test_1.txt");
+        auto characters_1 = reader_1.ReadCharacters(original_file_text_1.size() + 1);
+        EXPECT_EQ(std::string(characters_1.begin(), characters_1.end()), original_file_text_1);
+
+        FileReader reader_2("test_2.txt");
+        auto characters_2 = reader_2.ReadCharacters(original_file_text_2.size() + 1);
+        EXPECT_EQ(std::string(characters_2.begin(), characters_2.end()), original_file_text_2);
+    }
+}
+
+TEST(ArchiverTest, AppendKeepsArchiveOnError)
+{
+    Archiver("test_append.huff", { "test_1.txt" }).Compress();
+    auto archive_size = std::filesystem::file_size("test_append.huff");
+
+    EXPECT_THROW(Archiver("test_append.huff", { "missing.txt" }).Append(), std::runtime_error);
+    EXPECT_EQ(std::filesystem::file_size("test_append.huff"), archive_size);
+    EXPECT_NO_THROW(Archiver("test_append.huff").Decompress());
+
+    EXPECT_THROW(Archiver("test_2.txt", { "test_1.txt" }).Append(), std::runtime_error);
+}
+
+TEST(ArchiverTest, CompressionAndDecompressionOfDirectory)
+{
+    std::filesystem::remove_all("test_directory");
+    std::filesystem::create_directories("test_directory/nested");
+    std::filesystem::copy_file("test_1.txt", "test_directory/test_1.txt");
+    std::filesystem::copy_file("test_2.txt", "test_directory/nested/test_2.txt");
+
+    std::string original_file_text_1;
+    std::string original_file_text_2;
+    {
+        FileReader reader_1("test_1.txt");
+        auto characters_1 = reader_1.ReadCharacters(reader_1.GetFileSize());
+        original_file_text_1.assign(characters_1.begin(), characters_1.end());
+
+        FileReader reader_2("test_2.txt");
+        auto characters_2 = reader_2.ReadCharacters(reader_2.GetFileSize());
+        original_file_text_2.assign(characters_2.begin(), characters_2.end());
+    }
+
+    EncodingOptions options = GetLevelOptions(DEFAULT_LEVEL);
+    options.threads_count = 4;
+    Archiver archiver("test_archive.huff", { "test_directory/" }, options);
+    archiver.Compress();
+    std::filesystem::remove_all("test_directory");
+    archiver.Decompress();
+
+    FileReader reader_1("test_directory/test_1.txt");
+    auto characters_1 = reader_1.ReadCharacters(original_file_text_1.size() + 1);
+    EXPECT_EQ(std::string(characters_1.begin(), characters_1.end()), original_file_text_1);
+
+    FileReader reader_2("test_directory/nested/test_2.txt");
+    auto characters_2 = reader_2.ReadCharacters(original_file_text_2.size() + 1);
+    EXPECT_EQ(std::string(characters_2.begin(), characters_2.end()), original_file_text_2);
+}
+
+TEST(ArchiverTest, ArchiveDoesNotDependOnThreadsCount)
+{
+    // Repeat the texts, so that the file spans several segments
+    std::string original_file_text;
+    for (const auto& file_path : { "test_1.txt", "test_2.txt" })
+    {
+        FileReader reader(file_path);
+        auto characters = reader.ReadCharacters(reader.GetFileSize());
+        original_file_text.append(characters.begin(), characters.end());
+    }
+    for (size_t i = 0; i < 12; ++i)
+    {
+        original_file_text += original_file_text;
+    }
+    {
+        FileWriter writer("test_threads.txt");
+        for (auto character : original_file_text)
+        {
+            writer.WriteCharacter(character);
+        }
+    }
+
+    for (int level : { 1, 4 })
+    {
+        std::vector<std::string> archives;
+        for (size_t threads_count : { 1, 4 })
+        {
+            EncodingOptions options = GetLevelOptions(level);
+            options.threads_count = threads_count;
+            Archiver archiver("test_archive.huff", { "test_1.txt", "test_threads.txt" }, options);
+            archiver.Compress();
+
+            FileReader reader("test_archive.huff");
+            auto characters = reader.ReadCharacters(reader.GetFileSize());
+            archives.emplace_back(characters.begin(), characters.end());
+        }
+        EXPECT_EQ(archives[0], archives[1]) << "level " << level;
+
+        std::filesystem::remove("test_threads.txt");
+        Archiver("test_archive.huff").Decompress();
+
+        FileReader reader("test_threads.txt");
+        auto characters = reader.ReadCharacters(original_file_text.size() + 1);
+        EXPECT_EQ(std::string(characters.begin(), characters.end()), original_file_text)
+            << "level " << level;
+    }
+}
+
+TEST(ArchiverTest, DecompressionOnSeveralThreads)
+{
+    std::string original_file_text_1;
+    std::string original_file_text_2;
+    {
+        FileReader reader_1("test_1.txt");
+        auto characters_1 = reader_1.ReadCharacters(reader_1.GetFileSize());
+        original_file_text_1.assign(characters_1.begin(), characters_1.end());
+
+        FileReader reader_2("test_2.txt");
+        auto characters_2 = reader_2.ReadCharacters(reader_2.GetFileSize());
+        original_file_text_2.assign(characters_2.begin(), characters_2.end());
+    }
+
+    // Each part of the archive has its own shared table at level 2
+    for (int level : { 2, 6 })
+    {
+        Archiver("test_archive.huff", { "test_1.txt", "test_2.txt" }, GetLevelOptions(level))
+            .Compress();
+        Archiver("test_archive.huff", { "test_2.txt" }, GetLevelOptions(level)).Append();
+
+        std::filesystem::remove("test_1.txt");
+        std::filesystem::remove("test_2.txt");
+        Archiver("test_archive.huff", 4).Decompress();
+
+        FileReader reader_1("test_1.txt");
+        auto characters_1 = reader_1.ReadCharacters(original_file_text_1.size() + 1);
+        EXPECT_EQ(std::string(characters_1.begin(), characters_1.end()), original_file_text_1)
+            << "level " << level;
+
+        FileReader reader_2("test_2.txt");
+        auto characters_2 = reader_2.ReadCharacters(original_file_text_2.size() + 1);
+        EXPECT_EQ(std::string(characters_2.begin(), characters_2.end()), original_file_text_2)
+            << "level " << level;
+    }
+}
+
+TEST(ArchiverTest, CompressionAndDecompressionUnderMemoryLimit)
+{
+    // Repeat the texts, so that the file spans several segments
+    std::string original_file_text;
+    for (const auto& file_path : { "test_1.txt", "test_2.txt" })
+    {
+        FileReader reader(file_path);
+        auto characters = reader.ReadCharacters(reader.GetFileSize());
+        original_file_text.append(characters.begin(), characters.end());
+    }
+    for (size_t i = 0; i < 11; ++i)
+    {
+        original_file_text += original_file_text;
+    }
+    {
+        FileWriter writer("test_memory.txt");
+        writer.WriteCharacters({ original_file_text.begin(), original_file_text.end() });
+    }
+
+    // The archive depends on the fitted blocks but not on the threads admitted
+    for (size_t memory_limit : { 8 << 20, 64 << 20 })
+    {
+        std::vector<std::string> archives;
+        for (size_t threads_count : { 1, 4 })
+        {
+            EncodingOptions options = GetLevelOptions(1);
+            options.threads_count = threads_count;
+            options.sync_interval = 1 << 20;
+            options.memory_limit = memory_limit;
+            Archiver archiver("test_archive.huff", { "test_1.txt", "test_memory.txt" }, options);
+            archiver.Compress();
+
+            FileReader reader("test_archive.huff");
+            auto characters = reader.ReadCharacters(reader.GetFileSize());
+            archives.emplace_back(characters.begin(), characters.end());
+        }
+        EXPECT_EQ(archives[0], archives[1]) << memory_limit;
+
+        std::filesystem::remove("test_memory.txt");
+        Archiver("test_archive.huff", 4, 16 << 20).Decompress();
+
+        FileReader reader("test_memory.txt");
+        auto characters = reader.ReadCharacters(original_file_text.size() + 1);
+        EXPECT_EQ(std::string(characters.begin(), characters.end()), original_file_text)
+            << memory_limit;
+    }
+
+    // A file whose blocks may not fit is refused before it is written
+    EXPECT_THROW(Archiver("test_archive.huff", 1, 6 << 20).Decompress(), std::runtime_error);
+    EXPECT_THROW(Archiver("test_archive.huff", 1, 1 << 20), std::invalid_argument);
+    std::filesystem::remove("test_memory.txt");
+}
+
+TEST(ArchiverTest, DecompressionUnderTheLimitOfCompression)
+{
+    std::string original_file_text;
+    for (const auto& file_path : { "test_1.txt", "test_2.txt" })
+    {
+        FileReader reader(file_path);
+        auto characters = reader.ReadCharacters(reader.GetFileSize());
+        original_file_text.append(characters.begin(), characters.end());
+    }
+    for (size_t i = 0; i < 10; ++i)
+    {
+        original_file_text += original_file_text;
+    }
+
+    // The blocks fitted to the limit are decoded under it, with the transforms of level 9
+    for (int level : { 1, 6, 9 })
+    {
+        {
+            FileWriter writer("test_limit.txt");
+            writer.WriteCharacters({ original_file_text.begin(), original_file_text.end() });
+        }
+        EncodingOptions options = GetLevelOptions(level);
+        options.memory_limit = 8 << 20;
+        Archiver("test_limit.huff", { "test_limit.txt" }, options).Compress();
+
+        std::filesystem::remove("test_limit.txt");
+        Archiver("test_limit.huff", 2, 8 << 20).Decompress();
+        FileReader reader("test_limit.txt");
+        auto characters = reader.ReadCharacters(original_file_text.size() + 1);
+        EXPECT_EQ(std::string(characters.begin(), characters.end()), original_file_text)
+            << "level " << level;
+    }
+    std::filesystem::remove("test_limit.txt");
+}
+
+TEST(ArchiverTest, ExtractRangeFromSyncPoints)
+{
+    std::string original_file_text;
+    for (const auto& file_path : { "test_1.txt", "test_2.txt" })
+    {
+        FileReader reader(file_path);
+        auto characters = reader.ReadCharacters(reader.GetFileSize());
+        original_file_text.append(characters.begin(), characters.end());
+    }
+    for (size_t i = 0; i < 6; ++i)
+    {
+        original_file_text += original_file_text;
+    }
+    {
+        FileWriter writer("test_range.txt");
+        for (auto character : original_file_text)
+        {
+            writer.WriteCharacter(character);
+        }
+    }
+
+    for (int level : { 1, 9 })
+    {
+        EncodingOptions options = GetLevelOptions(level);
+        options.block_size = 4096;
+        options.sync_interval = 10000;
+        Archiver("test_archive.huff", { "test_1.txt", "test_range.txt" }, options).Compress();
+
+        Archiver archiver("test_archive.huff");
+        for (auto [offset, length] : { std::pair<size_t, size_t> { 0, 10 },
+                                       { 4000, 200 },
+                                       { 8191, 2 },
+                                       { 12345, 30000 },
+                                       { original_file_text.size() - 5, 100 },
+                                       { original_file_text.size() + 5, 100 } })
+        {
+            auto range = archiver.ExtractRange("test_range.txt", offset, length);
+            size_t text_offset = std::min(offset, original_file_text.size());
+            EXPECT_EQ(std::string(range.begin(), range.end()),
+                      original_file_text.substr(text_offset, length))
+                << "level " << level << ", offset " << offset;
+        }
+        EXPECT_THROW(archiver.ExtractRange("missing.txt", 0, 1), std::runtime_error);
+    }
+}
+
+TEST(ArchiverTest, CacheReusesUnchangedFiles)
+{
+    std::string range_text;
+    for (const auto& file_path : { "test_1.txt", "test_2.txt" })
+    {
+        FileReader reader(file_path);
+        auto characters = reader.ReadCharacters(reader.GetFileSize());
+        range_text.append(characters.begin(), characters.end());
+    }
+    for (size_t i = 0; i < 4; ++i)
+    {
+        range_text += range_text;
+    }
+
+    std::filesystem::remove_all("test_cached");
+    std::filesystem::remove_all("test_cache");
+    std::filesystem::create_directories("test_cached/nested");
+    std::filesystem::copy_file("test_1.txt", "test_cached/test_1.txt");
+    std::filesystem::copy_file("test_2.txt", "test_cached/nested/test_2.txt");
+    {
+        FileWriter writer("test_cached/test_range.txt");
+        for (auto character : range_text)
+        {
+            writer.WriteCharacter(character);
+        }
+    }
+
+    auto read_archive = [](const std::string& archive_path)
+    {
+        FileReader reader(archive_path);
+        return reader.ReadCharacters(reader.GetFileSize());
+    };
+    auto count_entries = []
+    {
+        auto entries = std::filesystem::directory_iterator("test_cache");
+        return std::distance(std::filesystem::begin(entries), std::filesystem::end(entries));
+    };
+
+    // Several sync points per file, so that their bit offsets are moved with the file name
+    EncodingOptions options = GetLevelOptions(DEFAULT_LEVEL);
+    options.block_size = 4096;
+    options.sync_interval = 10000;
+    options.cache_directory = "test_cache";
+    Archiver("test_cache_1.huff", { "test_cached" }, options).Compress();
+    EXPECT_EQ(count_entries(), 3);
+
+    // The copied files give the same archive as encoding them again
+    {
+        FileWriter writer("test_cached/test_1.txt", true);
+        writer.WriteCharacter('!');
+    }
+    std::filesystem::rename("test_cached/nested/test_2.txt", "test_cached/nested/renamed.txt");
+    options.threads_count = 2;
+    Archiver("test_cache_2.huff", { "test_cached" }, options).Compress();
+    EXPECT_EQ(count_entries(), 4);
+
+    options.cache_directory.clear();
+    Archiver("test_cache_3.huff", { "test_cached" }, options).Compress();
+    EXPECT_EQ(read_archive("test_cache_2.huff"), read_archive("test_cache_3.huff"));
+
+    Archiver archiver("test_cache_2.huff");
+    auto range = archiver.ExtractRange("test_cached/test_range.txt", 20000, 100);
+    EXPECT_EQ(std::string(range.begin(), range.end()), range_text.substr(20000, 100));
+
+    // The entries found are read, not encoded again
+    for (const auto& entry : std::filesystem::directory_iterator("test_cache"))
+    {
+        std::filesystem::resize_file(entry.path(), 2);
+    }
+    options.cache_directory = "test_cache";
+    EXPECT_THROW(Archiver("test_cache_2.huff", { "test_cached" }, options).Compress(),
+                 std::runtime_error);
+}
+
+TEST(ArchiverTest, MergeArchivesWithoutDecoding)
+{
+    auto read_file = [](const std::string& file_path)
+    {
+        FileReader reader(file_path);
+        auto characters = reader.ReadCharacters(reader.GetFileSize());
+        return std::string(characters.begin(), characters.end());
+    };
+    std::string original_file_text_1 = read_file("test_1.txt");
+    std::string original_file_text_2 = read_file("test_2.txt");
+
+    // The archive of level 2 starts with a shared table, which the files of level 6 do not use
+    std::filesystem::remove_all("test_merged");
+    std::filesystem::create_directories("test_merged");
+    std::filesystem::copy_file("test_1.txt", "test_merged/test_3.txt");
+    Archiver("test_hour_1.huff", { "test_1.txt", "test_2.txt" }, GetLevelOptions(2)).Compress();
+    Archiver("test_hour_2.huff", { "test_merged" }, GetLevelOptions(6)).Compress();
+    Archiver("test_hour_3.huff", { "test_2.txt" }, GetLevelOptions(2)).Compress();
+    Archiver("test_day.huff").Merge({ "test_hour_2.huff", "test_hour_1.huff", "test_hour_3.huff" });
+
+    // The records are copied as they are, only the terminator is written anew
+    std::string merged_archive;
+    for (const auto& archive_path : { "test_hour_2.huff", "test_hour_1.huff", "test_hour_3.huff" })
+    {
+        auto archive = read_file(archive_path);
+        merged_archive += archive.substr(0, archive.size() - 2);
+    }
+    merged_archive += "\x02\x01";
+    EXPECT_EQ(read_file("test_day.huff"), merged_archive);
+
+    std::filesystem::remove_all("test_merged");
+    std::filesystem::remove("test_1.txt");
+    std::filesystem::remove("test_2.txt");
+    Archiver("test_day.huff").Decompress();
+    EXPECT_EQ(read_file("test_1.txt"), original_file_text_1);
+    EXPECT_EQ(read_file("test_2.txt"), original_file_text_2);
+    EXPECT_EQ(read_file("test_merged/test_3.txt"), original_file_text_1);
+
+    // A file that is not an archive leaves the merged archive as it was
+    EXPECT_THROW(Archiver("test_day.huff").Merge({ "test_hour_1.huff", "test_1.txt" }),
+                 std::runtime_error);
+    EXPECT_EQ(read_file("test_day.huff"), merged_archive);
+    EXPECT_FALSE(std::filesystem::exists("test_day.huff.tmp"));
+}
+
+TEST(ArchiverTest, ExtractRawFilesWithoutDecoding)
+{
+    auto read_file = [](const std::string& file_path)
+    {
+        FileReader reader(file_path);
+        auto characters = reader.ReadCharacters(reader.GetFileSize());
+        return std::string(characters.begin(), characters.end());
+    };
+    std::string original_file_text_1 = read_file("test_1.txt");
+    std::string original_file_text_2 = read_file("test_2.txt");
+
+    // The second file of level 2 needs the shared table in front of the first one
+    std::filesystem::remove("test_split_3.huff");
+    Archiver("test_split.huff", { "test_1.txt", "test_2.txt" }, GetLevelOptions(2)).Compress();
+    Archiver("test_split.huff", { "test_1.txt" }, GetLevelOptions(6)).Append();
+    Archiver archiver("test_split.huff");
+    archiver.ExtractRaw("test_split_1.huff", { "test_2.txt" });
+    archiver.ExtractRaw("test_split_2.huff", { "test_1.txt", "test_2.txt", "test_2.txt" });
+    EXPECT_THROW(archiver.ExtractRaw("test_split_3.huff", { "test_3.txt" }), std::runtime_error);
+    EXPECT_FALSE(std::filesystem::exists("test_split_3.huff"));
+
+    // Merging the split archives back gives the files of the archive
+    Archiver("test_split_3.huff").Merge({ "test_split_1.huff", "test_split_2.huff" });
+    std::filesystem::remove("test_1.txt");
+    std::filesystem::remove("test_2.txt");
+    Archiver("test_split_1.huff").Decompress();
+    EXPECT_FALSE(std::filesystem::exists("test_1.txt"));
+    EXPECT_EQ(read_file("test_2.txt"), original_file_text_2);
+
+    // The appended test_1.txt is the one extracted, after the record of test_2.txt
+    std::filesystem::remove("test_2.txt");
+    Archiver("test_split_3.huff").Decompress();
+    EXPECT_EQ(read_file("test_1.txt"), original_file_text_1);
+    EXPECT_EQ(read_file("test_2.txt"), original_file_text_2);
+
+    auto split_archive = read_file("test_split_2.huff");
+    auto archive = read_file("test_split.huff");
+    EXPECT_LT(split_archive.size(), archive.size());
+    EXPECT_EQ(split_archive.substr(split_archive.size() - 2), "\x02\x01");
+}
@@ -0,0 +1,149 @@
+#include "canonicalcode.h"
+
+#include <gtest/gtest.h>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+/*
+ * Reader of the bits of a vector for the decoding table, zero past the end as FileReader.
+ */
+struct VectorBitReader
+{
+    const std::vector<bool>& bits;
+    size_t position = 0;
+
+    uint64_t PeekBits(size_t num_bits) const
+    {
+        uint64_t number = 0;
+        for (size_t i = 0; i < num_bits && position + i < bits.size(); ++i)
+        {
+            number |= static_cast<uint64_t>(bits[position + i]) << i;
+        }
+        return number;
+    }
+
+    void SkipBits(size_t num_bits)
+    {
+        position += num_bits;
+    }
+
+    bool ReadBit()
+    {
+        return position < bits.size() && bits[position++];
+    }
+};
+} // namespace
+
+TEST(CanonicalCodeTest, DeflateExample)
+{
+    // The example of RFC 1951: symbols A to H with lengths 3, 3, 3, 3, 3, 2, 4, 4
+    std::vector<uint8_t> code_lengths = { 3, 3, 3, 3, 3, 2, 4, 4 };
+    auto code = BuildCanonicalCode(code_lengths);
+
+    std::vector<uint64_t> msb_first_codes
+        = { 0b010, 0b011, 0b100, 0b101, 0b110, 0b00, 0b1110, 0b1111 };
+    ASSERT_EQ(code.codes.size(), code_lengths.size());
+    for (size_t symbol = 0; symbol < code_lengths.size(); ++symbol)
+    {
+        auto [reversed_code, length] = code.codes[symbol];
+        ASSERT_EQ(length, code_lengths[symbol]);
+        uint64_t msb_first_code = 0;
+        for (size_t i = 0; i < length; ++i)
+        {
+            msb_first_code = (msb_first_code << 1) | ((reversed_code >> i) & 1);
+        }
+        EXPECT_EQ(msb_first_code, msb_first_codes[symbol]);
+    }
+    EXPECT_EQ(code.symbols, (std::vector<uint16_t> { 5, 0, 1, 2, 3, 4, 6, 7 }));
+    EXPECT_EQ(code.length_counts, (std::vector<size_t> { 0, 0, 1, 5, 2 }));
+}
+
+TEST(CanonicalCodeTest, SkipsSymbolsWithoutCode)
+{
+    std::vector<uint8_t> code_lengths(300);
+    code_lengths['a'] = 1;
+    code_lengths['b'] = 2;
+    code_lengths[259] = 2;
+    auto code = BuildCanonicalCode(code_lengths);
+
+    EXPECT_EQ(code.symbols, (std::vector<uint16_t> { 'a', 'b', 259 }));
+    EXPECT_EQ(code.codes['a'], std::make_pair(uint64_t { 0b0 }, size_t { 1 }));
+    EXPECT_EQ(code.codes['b'], std::make_pair(uint64_t { 0b01 }, size_t { 2 }));
+    EXPECT_EQ(code.codes[259], std::make_pair(uint64_t { 0b11 }, size_t { 2 }));
+    EXPECT_EQ(code.codes['c'].second, 0);
+
+    EXPECT_TRUE(BuildCanonicalCode({}).symbols.empty());
+    std::vector<uint8_t> too_long = { 65 };
+    EXPECT_THROW(BuildCanonicalCode(too_long), std::invalid_argument);
+}
+
+TEST(CanonicalCodeTest, DecodingTableFallsBackOnLongCodes)
+{
+    // Lengths 1 to 15 and a second 15, so that codes both fit the table and run past it
+    std::vector<uint8_t> code_lengths;
+    for (uint8_t length = 1; length <= 15; ++length)
+    {
+        code_lengths.push_back(length);
+    }
+    code_lengths.push_back(15);
+    auto code = BuildCanonicalCode(code_lengths);
+    auto table = BuildDecodingTable(std::span<const uint16_t>(code.symbols),
+                                    std::span<const size_t>(code.length_counts));
+    ASSERT_EQ(table.bits, DECODING_TABLE_BITS);
+    ASSERT_EQ(table.entries.size(), size_t { 1 } << DECODING_TABLE_BITS);
+
+    // Every symbol, then the shortest code again
+    std::vector<bool> bits;
+    std::vector<uint16_t> message;
+    for (uint16_t symbol = 0; symbol < code_lengths.size(); ++symbol)
+    {
+        message.push_back(symbol);
+    }
+    message.push_back(0);
+    for (auto symbol : message)
+    {
+        auto [reversed_code, length] = code.codes[symbol];
+        for (size_t i = 0; i < length; ++i)
+        {
+            bits.push_back((reversed_code >> i) & 1);
+        }
+    }
+
+    VectorBitReader reader { .bits = bits };
+    for (auto symbol : message)
+    {
+        EXPECT_EQ(DecodeTableSymbol(table,
+                                    std::span<const uint16_t>(code.symbols),
+                                    std::span<const size_t>(code.length_counts),
+                                    reader),
+                  symbol);
+    }
+    EXPECT_EQ(reader.position, bits.size());
+}
+
+TEST(CanonicalCodeTest, DecodingTableAgreesOnOversubscribedLengths)
+{
+    // Three codes of one bit: the table keeps the complete codes only, as the bit-by-bit decoder
+    std::vector<uint8_t> code_lengths = { 1, 1, 1, 2 };
+    auto code = BuildCanonicalCode(code_lengths);
+    auto table = BuildDecodingTable(std::span<const uint16_t>(code.symbols),
+                                    std::span<const size_t>(code.length_counts));
+    for (uint64_t next_bits = 0; next_bits < 4; ++next_bits)
+    {
+        std::vector<bool> bits = { (next_bits & 1) != 0, (next_bits & 2) != 0 };
+        VectorBitReader table_reader { .bits = bits };
+        VectorBitReader bit_reader { .bits = bits };
+        auto table_symbol = DecodeTableSymbol(table,
+                                              std::span<const uint16_t>(code.symbols),
+                                              std::span<const size_t>(code.length_counts),
+                                              table_reader);
+        auto bit_symbol = DecodeCanonicalSymbol(std::span<const uint16_t>(code.symbols),
+                                                std::span<const size_t>(code.length_counts),
+                                                [&bit_reader] { return bit_reader.ReadBit(); });
+        EXPECT_EQ(table_symbol, bit_symbol);
+        EXPECT_EQ(table_reader.position, bit_reader.position);
+    }
+}
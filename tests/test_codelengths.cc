@@ -0,0 +1,139 @@
+#include "codelengths.h"
+
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+/*
+ * Bits written and read back from the lowest one, as FileWriter and FileReader do.
+ */
+struct BitBuffer
+{
+    std::vector<bool> bits;
+    size_t read_position = 0;
+
+    void Write(uint64_t number, size_t num_bits)
+    {
+        for (size_t i = 0; i < num_bits; ++i)
+        {
+            bits.push_back((number >> i) & 1);
+        }
+    }
+
+    uint64_t Read(size_t num_bits)
+    {
+        uint64_t number = 0;
+        for (size_t i = 0; i < num_bits; ++i)
+        {
+            if (read_position >= bits.size())
+            {
+                throw std::runtime_error("The buffer is exhausted");
+            }
+            number |= static_cast<uint64_t>(bits[read_position++]) << i;
+        }
+        return number;
+    }
+};
+
+BitBuffer WriteHeader(const std::vector<uint8_t>& code_lengths, size_t symbol_bits)
+{
+    std::vector<CodeLengthToken> tokens(code_lengths.size());
+    tokens.resize(TokenizeCodeLengths(code_lengths, tokens));
+    auto code = BuildCodeLengthCode(code_lengths, tokens);
+
+    BitBuffer buffer;
+    WriteCodeLengths(code,
+                     tokens,
+                     code_lengths.size(),
+                     symbol_bits,
+                     [&buffer](uint64_t number, size_t num_bits)
+                     { buffer.Write(number, num_bits); });
+    EXPECT_EQ(buffer.bits.size(), CountCodeLengthsBits(code, tokens, symbol_bits));
+    return buffer;
+}
+
+std::vector<uint8_t> ReadHeader(BitBuffer& buffer, size_t symbol_bits, size_t buffer_size)
+{
+    std::vector<uint8_t> code_lengths(buffer_size);
+    code_lengths.resize(ReadCodeLengths([&buffer](size_t num_bits)
+                                        { return buffer.Read(num_bits); },
+                                        symbol_bits,
+                                        code_lengths));
+    return code_lengths;
+}
+
+TEST(CodeLengthsTest, HeadersRoundTrip)
+{
+    std::mt19937 generator(7);
+
+    std::vector<std::vector<uint8_t>> tables = { { 1 }, { 1, 1 }, { 0, 0, 0, 0, 2, 2, 1 } };
+    std::vector<uint8_t> sparse_table(4000);
+    sparse_table[3] = sparse_table[300] = 1;
+    sparse_table[3999] = MAX_HEADER_CODE_LENGTH;
+    tables.push_back(sparse_table);
+    for (size_t zeros_probability : { 0, 30, 90 })
+    {
+        std::vector<uint8_t> table(260);
+        for (auto& length : table)
+        {
+            length = generator() % 100 < zeros_probability ? 0 : 4 + generator() % 3;
+        }
+        table.back() = 12;
+        tables.push_back(table);
+    }
+
+    for (const auto& table : tables)
+    {
+        auto buffer = WriteHeader(table, 12);
+        EXPECT_EQ(ReadHeader(buffer, 12, 1 << 12), table);
+        EXPECT_EQ(buffer.read_position, buffer.bits.size());
+    }
+}
+
+TEST(CodeLengthsTest, FullAlphabetHeaderIsSmall)
+{
+    // The 9-bit header listing every symbol and the count of each length took 266 values
+    std::vector<uint8_t> table(260, 8);
+    table[UINT8_MAX + 1] = table[UINT8_MAX + 4] = 9;
+    table[UINT8_MAX + 2] = table[UINT8_MAX + 3] = 0;
+
+    auto buffer = WriteHeader(table, 9);
+    EXPECT_LT(buffer.bits.size(), 200);
+}
+
+TEST(CodeLengthsTest, CorruptedHeadersThrow)
+{
+    std::vector<uint8_t> table(300, 9);
+
+    auto too_long_buffer = WriteHeader(table, 9);
+    EXPECT_THROW(ReadHeader(too_long_buffer, 9, 256), std::runtime_error);
+
+    // A repeat of the previous length first: the lengths 9 and the repeat take one bit each
+    BitBuffer repeat_buffer;
+    repeat_buffer.Write(299, 9);
+    repeat_buffer.Write(9, 6);
+    repeat_buffer.Write(5, 7);
+    for (size_t length : { 1, 0, 0, 0, 1 })
+    {
+        repeat_buffer.Write(length, 3);
+    }
+    repeat_buffer.Write(1, 1);
+    repeat_buffer.Write(0, 2);
+    EXPECT_THROW(ReadHeader(repeat_buffer, 9, 512), std::runtime_error);
+    EXPECT_EQ(repeat_buffer.read_position, repeat_buffer.bits.size());
+
+    // Three codes of one bit
+    BitBuffer oversubscribed_buffer;
+    oversubscribed_buffer.Write(0, 9);
+    oversubscribed_buffer.Write(1, 6);
+    oversubscribed_buffer.Write(5, 7);
+    for (size_t i = 0; i < 5; ++i)
+    {
+        oversubscribed_buffer.Write(i < 3, 3);
+    }
+    EXPECT_THROW(ReadHeader(oversubscribed_buffer, 9, 512), std::runtime_error);
+
+    std::vector<uint8_t> excessive_table = { static_cast<uint8_t>(MAX_HEADER_CODE_LENGTH + 1) };
+    std::vector<CodeLengthToken> tokens(1);
+    EXPECT_THROW(TokenizeCodeLengths(excessive_table, tokens), std::invalid_argument);
+}
@@ -0,0 +1,162 @@
+#include "compressorcontext.h"
+#include "huffman.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+// Count the heap allocations of the test binary
+static std::atomic<size_t> allocations_count { 0 };
+
+void* operator new(size_t size)
+{
+    ++allocations_count;
+    if (void* pointer = std::malloc(size == 0 ? 1 : size))
+    {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    std::free(pointer);
+}
+
+std::vector<std::vector<unsigned char>> GenerateBuffers()
+{
+    std::mt19937 generator(5);
+    std::vector<std::vector<unsigned char>> buffers = { {}, { 'a' }, { 'a', 'a', 'a' } };
+
+    // Log records, random bytes and a skewed distribution that needs the code length limit
+    for (size_t i = 0; i < 100; ++i)
+    {
+        std::string line = "2024-05-01 12:00:" + std::to_string(10 + i % 50)
+            + " INFO request served status=200 duration_ms=" + std::to_string(generator() % 300);
+        buffers.emplace_back(line.begin(), line.end());
+    }
+    std::vector<unsigned char> random_buffer(1000);
+    for (auto& character : random_buffer)
+    {
+        character = static_cast<unsigned char>(generator());
+    }
+    buffers.push_back(random_buffer);
+
+    std::vector<unsigned char> skewed_buffer;
+    uint64_t previous_count = 1;
+    uint64_t count = 1;
+    for (unsigned char character = 0; character < 20; ++character)
+    {
+        skewed_buffer.insert(skewed_buffer.end(), count, character);
+        count = std::exchange(previous_count, count) + count;
+    }
+    buffers.push_back(skewed_buffer);
+    return buffers;
+}
+
+TEST(CompressorContextTest, BatchRoundTrip)
+{
+    auto buffers = GenerateBuffers();
+    std::vector<std::span<const unsigned char>> buffer_spans(buffers.begin(), buffers.end());
+
+    for (size_t max_code_length : { 9, 15, 32 })
+    {
+        CompressorContext context(max_code_length);
+        std::vector<unsigned char> output;
+        std::vector<size_t> record_ends;
+        context.CompressBatch(buffer_spans, output, record_ends);
+        ASSERT_EQ(record_ends.size(), buffers.size());
+
+        size_t record_begin = 0;
+        for (size_t i = 0; i < buffers.size(); ++i)
+        {
+            std::vector<unsigned char> content;
+            auto record = std::span(output).subspan(record_begin, record_ends[i] - record_begin);
+            EXPECT_EQ(context.Decompress(record, content), record.size());
+            EXPECT_EQ(content, buffers[i]) << "buffer " << i;
+            record_begin = record_ends[i];
+        }
+    }
+}
+
+TEST(CompressorContextTest, RecordIsReadByHuffmanCoder)
+{
+    std::string text = "a record of the batch, a record read by the archive decoder";
+    std::vector<unsigned char> buffer(text.begin(), text.end());
+
+    CompressorContext context;
+    std::vector<unsigned char> record;
+    context.Compress(buffer, record);
+
+    // Put the record after a file header, as the only block of the file
+    std::string file_name = "test_record.txt";
+    {
+        FileWriter writer("test_record.huff");
+        HuffmanCoder().EncodeFileHeader(file_name, buffer.size(), writer);
+        writer.WriteCharacters(record);
+    }
+    {
+        HuffmanCoder huffman_coder;
+        FileReader reader("test_record.huff");
+        huffman_coder.Decode(reader);
+    }
+
+    FileReader reader(file_name);
+    EXPECT_EQ(reader.ReadCharacters(buffer.size() + 1), buffer);
+}
+
+TEST(CompressorContextTest, NoAllocationsInSteadyState)
+{
+    auto buffers = GenerateBuffers();
+    std::vector<std::span<const unsigned char>> buffer_spans(buffers.begin(), buffers.end());
+
+    CompressorContext context;
+    std::vector<unsigned char> output;
+    std::vector<size_t> record_ends;
+    std::vector<unsigned char> content;
+    content.reserve(64 << 10);
+
+    // The first batch sizes the output vectors
+    context.CompressBatch(buffer_spans, output, record_ends);
+
+    size_t allocations_before = allocations_count;
+    for (size_t i = 0; i < 10; ++i)
+    {
+        context.CompressBatch(buffer_spans, output, record_ends);
+
+        size_t record_begin = 0;
+        for (auto record_end : record_ends)
+        {
+            content.clear();
+            context.Decompress(std::span(output).subspan(record_begin, record_end - record_begin),
+                               content);
+            record_begin = record_end;
+        }
+    }
+    EXPECT_EQ(allocations_count - allocations_before, 0);
+}
+
+TEST(CompressorContextTest, CorruptedRecordsThrow)
+{
+    CompressorContext context;
+    std::vector<unsigned char> content;
+    EXPECT_THROW(context.Decompress({}, content), std::runtime_error);
+
+    std::vector<unsigned char> record;
+    std::string text = "truncated record";
+    context.Compress(std::vector<unsigned char>(text.begin(), text.end()), record);
+    record.resize(record.size() / 2);
+    EXPECT_THROW(context.Decompress(record, content), std::runtime_error);
+
+    EXPECT_THROW(CompressorContext(8), std::invalid_argument);
+}
@@ -0,0 +1,42 @@
+#include "contenthash.h"
+
+#include <gtest/gtest.h>
+#include <string_view>
+#include <vector>
+
+uint64_t HashString(std::string_view text, uint64_t seed = 0)
+{
+    ContentHasher hasher(seed);
+    hasher.Update({ reinterpret_cast<const unsigned char*>(text.data()), text.size() });
+    return hasher.GetDigest();
+}
+
+TEST(ContentHashTest, KnownHashes)
+{
+    EXPECT_EQ(HashString(""), 0xEF46DB3751D8E999);
+    EXPECT_EQ(HashString("abc"), 0x44BC2CF5AD770999);
+    EXPECT_EQ(HashString("Nobody inspects the spammish repetition"), 0xFBCEA83C8A378BF1);
+    EXPECT_NE(HashString("abc", 1), HashString("abc"));
+}
+
+TEST(ContentHashTest, ChunksDoNotChangeHash)
+{
+    std::vector<unsigned char> content(1000);
+    for (size_t i = 0; i < content.size(); ++i)
+    {
+        content[i] = static_cast<unsigned char>(i * 7 + i / 13);
+    }
+
+    ContentHasher whole_hasher;
+    whole_hasher.Update(content);
+    for (size_t chunk_size : { 1, 5, 31, 32, 33, 100 })
+    {
+        ContentHasher hasher;
+        for (size_t position = 0; position < content.size(); position += chunk_size)
+        {
+            hasher.Update(std::span(content).subspan(
+                position, std::min(chunk_size, content.size() - position)));
+        }
+        EXPECT_EQ(hasher.GetDigest(), whole_hasher.GetDigest()) << "chunk size " << chunk_size;
+    }
+}
@@ -0,0 +1,110 @@
+#include "daemon.h"
+#include "filereader.h"
+#include "huffman.h"
+
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+TEST(DaemonTest, BufferJobsRoundTrip)
+{
+    std::string socket_path = "test_daemon.sock";
+    CompressionServer server(socket_path, 2);
+    std::thread server_thread([&server] { server.Run(); });
+
+    {
+        // Two clients at once, each one sends its jobs over the same connection
+        CompressionClient client_1(socket_path);
+        CompressionClient client_2(socket_path);
+        std::vector<unsigned char> record;
+        std::vector<unsigned char> buffer;
+        for (size_t i = 0; i < 100; ++i)
+        {
+            std::string line = "2024-05-01 12:00:" + std::to_string(i) + " INFO request served";
+            std::vector<unsigned char> original(line.begin(), line.end());
+            auto& client = i % 2 == 0 ? client_1 : client_2;
+            client.CompressBuffer(original, record);
+            client.DecompressBuffer(record, buffer);
+            EXPECT_EQ(buffer, original);
+        }
+        client_1.CompressBuffer({}, record);
+        client_1.DecompressBuffer(record, buffer);
+        EXPECT_TRUE(buffer.empty());
+
+        // A failed job is replied with its error and the connection stays usable
+        std::vector<unsigned char> corrupted_record = { 0xFF, 0xFF, 0xFF };
+        EXPECT_THROW(client_2.DecompressBuffer(corrupted_record, buffer), std::runtime_error);
+        client_2.CompressBuffer(record, buffer);
+        EXPECT_FALSE(buffer.empty());
+    }
+
+    server.Stop();
+    server_thread.join();
+    EXPECT_THROW(CompressionClient client(socket_path), std::runtime_error);
+}
+
+TEST(DaemonTest, FileJobsRoundTrip)
+{
+    std::string socket_path = "test_daemon.sock";
+    CompressionServer server(socket_path, 1);
+    std::thread server_thread([&server] { server.Run(); });
+
+    std::filesystem::remove_all("test_daemon_output");
+    {
+        CompressionClient client(socket_path);
+        client.CompressFiles("test_daemon.huff", { "test_1.txt" }, DEFAULT_LEVEL);
+        client.CompressFiles("test_daemon.huff", { "test_2.txt" }, MAX_LEVEL, true);
+        client.DecompressArchive("test_daemon.huff", "test_daemon_output");
+
+        EXPECT_THROW(client.CompressFiles("test_daemon.huff", { "test_1.txt" }, 0),
+                     std::runtime_error);
+        EXPECT_THROW(client.CompressFiles("test_daemon.huff", { "test_missing.txt" }, 1),
+                     std::runtime_error);
+        EXPECT_THROW(client.DecompressArchive("test_missing.huff"), std::runtime_error);
+    }
+    server.Stop();
+    server_thread.join();
+
+    for (std::string file_name : { "test_1.txt", "test_2.txt" })
+    {
+        FileReader original_reader(file_name);
+        FileReader restored_reader("test_daemon_output/" + file_name);
+        EXPECT_EQ(restored_reader.ReadCharacters(restored_reader.GetFileSize()),
+                  original_reader.ReadCharacters(original_reader.GetFileSize()));
+    }
+}
+
+TEST(DaemonTest, IdleConnectionsHoldNoWorker)
+{
+    std::string socket_path = "test_daemon.sock";
+    CompressionServer server(socket_path, 1);
+    std::thread server_thread([&server] { server.Run(); });
+
+    struct stat socket_status {};
+    ASSERT_EQ(stat(socket_path.c_str(), &socket_status), 0);
+    EXPECT_EQ(socket_status.st_mode & 0777, 0600u);
+
+    {
+        // The only worker is free again once the first client is replied, it stays connected
+        CompressionClient idle_client(socket_path);
+        CompressionClient client(socket_path);
+        std::vector<unsigned char> record;
+        std::vector<unsigned char> buffer;
+        std::vector<unsigned char> original = { 'a', 'b', 'c' };
+        idle_client.CompressBuffer(original, record);
+        for (size_t i = 0; i < 10; ++i)
+        {
+            client.CompressBuffer(original, record);
+            client.DecompressBuffer(record, buffer);
+            EXPECT_EQ(buffer, original);
+        }
+        idle_client.DecompressBuffer(record, buffer);
+        EXPECT_EQ(buffer, original);
+    }
+
+    server.Stop();
+    server_thread.join();
+}
@@ -78,3 +78,59 @@ TEST(FileReaderTest, ResetPositionToStart)
     auto character_after_reset = reader.ReadCharacter();
     ASSERT_EQ(character_after_reset.value(), 'N');
 }
+
+TEST(FileReaderTest, ReadCharactersFromPosition)
+{
+    FileReader reader("test_1.txt");
+    ASSERT_EQ(reader.GetFileSize(), 878);
+
+    reader.SetPosition(1);
+    auto characters = reader.ReadCharacters(4);
+    ASSERT_EQ(std::string(characters.begin(), characters.end()), "apol");
+
+    reader.SetPosition(reader.GetFileSize() - 2);
+    ASSERT_EQ(reader.ReadCharacters(4).size(), 2);
+}
+
+TEST(FileTest, MixBitsAndBytesAcrossTheBuffer)
+{
+    // More than the buffer of the reader, with bits between the bytes
+    std::vector<unsigned char> characters(200000);
+    for (size_t i = 0; i < characters.size(); ++i)
+    {
+        characters[i] = static_cast<unsigned char>(i * 7);
+    }
+    {
+        FileWriter writer("test_mixed.txt");
+        writer.WriteHuffmanInt(0b101, 3);
+        writer.AlignToByte();
+        writer.WriteCharacters(characters);
+        writer.WriteHuffmanInt(0x123456789ABCDEF, 60);
+        writer.WriteHuffmanInt(0b11, 2);
+    }
+
+    FileReader reader("test_mixed.txt");
+    ASSERT_EQ(reader.GetFileSize(), 1 + characters.size() + 8);
+    EXPECT_EQ(reader.PeekBits(2), 0b01);
+    EXPECT_EQ(reader.PeekBits(3), 0b101);
+    reader.SkipBits(1);
+    EXPECT_EQ(reader.ReadHuffmanInt(2), 0b10);
+    EXPECT_EQ(reader.GetPosition(), 1);
+    auto middle = characters.begin() + 100000;
+    EXPECT_EQ(reader.ReadCharacters(100000), std::vector(characters.begin(), middle));
+    EXPECT_EQ(reader.ReadHuffmanInt(8), *middle);
+    EXPECT_EQ(reader.ReadCharacters(99999), std::vector(middle + 1, characters.end()));
+    EXPECT_EQ(reader.ReadHuffmanInt(60), 0x123456789ABCDEF);
+    EXPECT_EQ(reader.ReadHuffmanInt(2), 0b11);
+    EXPECT_EQ(reader.PeekBits(8), 0);
+    reader.SkipBits(2); // the padding of the last byte
+    EXPECT_THROW(reader.ReadBit(), std::runtime_error);
+
+    // Back within the file after its end
+    reader.SetPosition(2);
+    EXPECT_EQ(reader.ReadCharacter(), characters[1]);
+    EXPECT_TRUE(reader.HasMoreCharacters());
+    reader.SetPosition(reader.GetFileSize());
+    EXPECT_FALSE(reader.HasMoreCharacters());
+    EXPECT_EQ(reader.ReadCharacter(), std::nullopt);
+}
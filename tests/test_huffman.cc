@@ -1,20 +1,297 @@
 #include "huffman.h"
 
+#include <cmath>
+#include <filesystem>
+#include <fstream>
 #include <gtest/gtest.h>
 
-TEST(HuffmanCoderTest, MoveCodesToCanonicalForm)
+TEST(HuffmanCoderTest, SampledTableEncodesEveryCharacter)
 {
-    HuffmanCodes correct_canonical_codes {
-        { { 1, 1 }, "0" }, { { 2, 0 }, "10" }, { { 3, 2 }, "110" }, { { 3, 3 }, "111" }
-    };
-    HuffmanCodes codes {
-        { { 1, 1 }, "0" }, { { 2, 0 }, "11" }, { { 3, 2 }, "101" }, { { 3, 3 }, "100" }
+    EncodingOptions options { .frequency_mode = FrequencyMode::Sampled,
+                              .sample_chunks_count = 4,
+                              .sample_chunk_size = 16,
+                              .table_scope = TableScope::File,
+                              .collect_stats = true };
+
+    EncodingStats stats;
+    {
+        HuffmanCoder huffman_coder(options);
+        FileReader reader("test_1.txt");
+        FileWriter writer("test_sampled.huff");
+        stats = huffman_coder.Encode(reader, writer);
+    }
+
+    EXPECT_EQ(stats.original_size, 878);
+    EXPECT_GE(stats.encoded_bits, stats.exact_table_bits);
+
+    std::string original_file_text;
+    {
+        FileReader reader("test_1.txt");
+        auto characters = reader.ReadCharacters(stats.original_size);
+        original_file_text.assign(characters.begin(), characters.end());
+    }
+
+    std::filesystem::remove("test_1.txt");
+    {
+        HuffmanCoder huffman_coder;
+        FileReader reader("test_sampled.huff");
+        huffman_coder.Decode(reader);
+    }
+
+    FileReader reader("test_1.txt");
+    auto characters = reader.ReadCharacters(stats.original_size + 1);
+    EXPECT_EQ(std::string(characters.begin(), characters.end()), original_file_text);
+}
+
+TEST(HuffmanCoderTest, ExactTableStatsMatchWrittenBits)
+{
+    EncodingOptions options { .collect_stats = true };
+
+    HuffmanCoder huffman_coder(options);
+    FileReader reader("test_2.txt");
+    FileWriter writer("test_exact.huff");
+    auto stats = huffman_coder.Encode(reader, writer);
+
+    EXPECT_EQ(stats.file_name, "test_2.txt");
+    EXPECT_EQ(stats.encoded_bits, stats.exact_table_bits);
+    EXPECT_EQ(stats.encoded_bits, writer.GetBitsWritten());
+}
+
+TEST(HuffmanCoderTest, FileSizeMismatchThrows)
+{
+    std::string original_file_text;
+    {
+        FileReader reader("test_2.txt");
+        auto characters = reader.ReadCharacters(reader.GetFileSize());
+        original_file_text.assign(characters.begin(), characters.end());
+    }
+    {
+        HuffmanCoder huffman_coder;
+        FileReader reader("test_2.txt");
+        FileWriter writer("test_size.huff");
+        huffman_coder.Encode(reader, writer);
+    }
+
+    // The 64-bit size follows the 16-bit length of the name and its characters
+    size_t file_size_position = 2 + std::string("test_2.txt").size();
+    auto write_file_size = [&](uint64_t file_size)
+    {
+        std::fstream archive("test_size.huff", std::ios::binary | std::ios::in | std::ios::out);
+        archive.seekp(static_cast<std::streamoff>(file_size_position));
+        for (size_t i = 0; i < 8; ++i, file_size >>= 8)
+        {
+            archive.put(static_cast<char>(file_size & UINT8_MAX));
+        }
     };
 
     HuffmanCoder huffman_coder;
-    auto [canonical_codes, _] = huffman_coder.MoveCodesToCanonicalForm(codes);
-    for (const auto& [key, code] : canonical_codes)
+    for (uint64_t file_size : { original_file_text.size() - 1, original_file_text.size() + 1 })
     {
-        ASSERT_EQ(code, correct_canonical_codes[key]);
+        write_file_size(file_size);
+        FileReader reader("test_size.huff");
+        EXPECT_THROW(huffman_coder.Decode(reader), std::runtime_error) << file_size;
     }
+
+    write_file_size(original_file_text.size());
+    {
+        FileReader reader("test_size.huff");
+        huffman_coder.Decode(reader);
+    }
+
+    FileReader reader("test_2.txt");
+    auto characters = reader.ReadCharacters(original_file_text.size() + 1);
+    EXPECT_EQ(std::string(characters.begin(), characters.end()), original_file_text);
+}
+
+TEST(HuffmanCoderTest, CorruptedBlockLengthsThrow)
+{
+    // The header of a 16-byte file records 16-byte blocks, each block then declares more
+    auto decode_error = [](auto write_block)
+    {
+        {
+            FileWriter writer("test_length.huff");
+            HuffmanCoder().EncodeFileHeader("test_length.txt", 16, writer);
+            write_block(writer);
+            writer.AlignToByte();
+            writer.WriteCharacters(std::vector<unsigned char>(100));
+        }
+        std::string error;
+        try
+        {
+            FileReader reader("test_length.huff");
+            HuffmanCoder().Decode(reader);
+        }
+        catch (const std::runtime_error& exception)
+        {
+            error = exception.what();
+        }
+        std::filesystem::remove("test_length.txt");
+        return error;
+    };
+
+    // The lengths are refused before the bytes are read or their memory is taken
+    EXPECT_EQ(decode_error(
+                  [](FileWriter& writer)
+                  {
+                      writer.WriteHuffmanInt(static_cast<uint16_t>(BlockType::Stored));
+                      writer.WriteHuffmanInt(64, 32);
+                  }),
+              "The stored block is larger than its file header says");
+    auto write_ans_block = [](uint64_t block_size, uint64_t code_size)
+    {
+        return [=](FileWriter& writer)
+        {
+            writer.WriteHuffmanInt(static_cast<uint16_t>(BlockType::Ans));
+            writer.WriteHuffmanInt(block_size, 32);
+            writer.WriteHuffmanInt(1);
+            writer.WriteHuffmanInt('a', 8);
+            writer.WriteHuffmanInt((1 << 12) - 1, 12);
+            writer.WriteHuffmanInt(code_size, 32);
+        };
+    };
+    EXPECT_EQ(decode_error(write_ans_block(UINT32_MAX, 8)),
+              "The rANS block is larger than its file header says");
+    EXPECT_EQ(decode_error(write_ans_block(16, 64)),
+              "The rANS code is longer than its block allows");
+    std::filesystem::remove("test_length.huff");
+}
+
+class LimitedHuffmanCoder : public HuffmanCoder
+{
+public:
+    using HuffmanCoder::BuildCodeTable;
+    using HuffmanCoder::HuffmanCoder;
+};
+
+TEST(HuffmanCoderTest, CodeLengthsAreLimited)
+{
+    // Fibonacci frequencies give the longest possible codes
+    CharacterFrequencies character_frequencies(30);
+    uint64_t previous_frequency = 1;
+    uint64_t frequency = 1;
+    for (auto& character_frequency : character_frequencies)
+    {
+        character_frequency = frequency;
+        frequency += std::exchange(previous_frequency, frequency);
+    }
+
+    LimitedHuffmanCoder huffman_coder(EncodingOptions { .max_code_length = 12 });
+    auto table = huffman_coder.BuildCodeTable(character_frequencies);
+    ASSERT_EQ(table.code_lengths.size(), character_frequencies.size());
+
+    // The lengths still describe a complete prefix code
+    double kraft_sum = 0;
+    for (auto length : table.code_lengths)
+    {
+        EXPECT_GT(length, 0);
+        EXPECT_LE(length, 12);
+        kraft_sum += std::ldexp(1.0, -static_cast<int>(length));
+    }
+    EXPECT_DOUBLE_EQ(kraft_sum, 1.0);
+}
+
+TEST(HuffmanCoderTest, Order1TablesShrinkText)
+{
+    {
+        FileReader reader("test_1.txt");
+        auto characters = reader.ReadCharacters(reader.GetFileSize());
+        FileWriter writer("test_order1.txt");
+        for (size_t i = 0; i < 64; ++i)
+        {
+            for (auto character : characters)
+            {
+                writer.WriteCharacter(character);
+            }
+        }
+    }
+
+    EncodingOptions order0_options { .collect_stats = true };
+    EncodingOptions order1_options { .order1_contexts = true, .collect_stats = true };
+
+    EncodingStats order0_stats;
+    EncodingStats order1_stats;
+    {
+        HuffmanCoder huffman_coder(order0_options);
+        FileReader reader("test_order1.txt");
+        FileWriter writer("test_order0.huff");
+        order0_stats = huffman_coder.Encode(reader, writer);
+    }
+    {
+        HuffmanCoder huffman_coder(order1_options);
+        FileReader reader("test_order1.txt");
+        FileWriter writer("test_order1.huff");
+        order1_stats = huffman_coder.Encode(reader, writer);
+    }
+    EXPECT_LT(order1_stats.encoded_bits, order0_stats.encoded_bits * 3 / 4);
+
+    std::string original_file_text;
+    {
+        FileReader reader("test_order1.txt");
+        auto characters = reader.ReadCharacters(reader.GetFileSize());
+        original_file_text.assign(characters.begin(), characters.end());
+    }
+
+    std::filesystem::remove("test_order1.txt");
+    {
+        HuffmanCoder huffman_coder;
+        FileReader reader("test_order1.huff");
+        huffman_coder.Decode(reader);
+    }
+
+    FileReader reader("test_order1.txt");
+    auto characters = reader.ReadCharacters(original_file_text.size() + 1);
+    EXPECT_EQ(std::string(characters.begin(), characters.end()), original_file_text);
+}
+
+TEST(HuffmanCoderTest, WordBlocksShrinkText)
+{
+    {
+        FileReader reader("test_1.txt");
+        auto characters = reader.ReadCharacters(reader.GetFileSize());
+        FileWriter writer("test_words.txt");
+        for (size_t i = 0; i < 64; ++i)
+        {
+            for (auto character : characters)
+            {
+                writer.WriteCharacter(character);
+            }
+        }
+    }
+
+    EncodingOptions character_options { .collect_stats = true };
+    EncodingOptions word_options { .max_tokens_count = 4096, .collect_stats = true };
+
+    EncodingStats character_stats;
+    EncodingStats word_stats;
+    {
+        HuffmanCoder huffman_coder(character_options);
+        FileReader reader("test_words.txt");
+        FileWriter writer("test_characters.huff");
+        character_stats = huffman_coder.Encode(reader, writer);
+    }
+    {
+        HuffmanCoder huffman_coder(word_options);
+        FileReader reader("test_words.txt");
+        FileWriter writer("test_words.huff");
+        word_stats = huffman_coder.Encode(reader, writer);
+    }
+    EXPECT_LT(word_stats.encoded_bits, character_stats.encoded_bits / 2);
+
+    std::string original_file_text;
+    {
+        FileReader reader("test_words.txt");
+        auto characters = reader.ReadCharacters(reader.GetFileSize());
+        original_file_text.assign(characters.begin(), characters.end());
+    }
+
+    std::filesystem::remove("test_words.txt");
+    {
+        HuffmanCoder huffman_coder;
+        FileReader reader("test_words.huff");
+        huffman_coder.Decode(reader);
+    }
+
+    FileReader reader("test_words.txt");
+    auto characters = reader.ReadCharacters(original_file_text.size() + 1);
+    EXPECT_EQ(std::string(characters.begin(), characters.end()), original_file_text);
 }
@@ -0,0 +1,84 @@
+#include "memorybudget.h"
+
+#include <atomic>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <thread>
+
+TEST(MemoryBudgetTest, TakesOnlyFreeBytes)
+{
+    MemoryBudget memory_budget(100);
+    EXPECT_TRUE(memory_budget.TryAcquire(60));
+    EXPECT_FALSE(memory_budget.TryAcquire(50));
+    EXPECT_TRUE(memory_budget.TryAcquire(40));
+
+    memory_budget.Release(60);
+    EXPECT_TRUE(memory_budget.TryAcquire(50));
+    memory_budget.Release(50);
+    memory_budget.Release(40);
+
+    // A task larger than the budget takes all of it
+    EXPECT_TRUE(memory_budget.TryAcquire(1000));
+    EXPECT_FALSE(memory_budget.TryAcquire(1));
+    memory_budget.Release(1000);
+    EXPECT_TRUE(memory_budget.TryAcquire(100));
+}
+
+TEST(MemoryBudgetTest, AcquireWaitsForRelease)
+{
+    MemoryBudget memory_budget(100);
+    memory_budget.Acquire(80);
+
+    std::atomic<bool> is_acquired = false;
+    std::thread waiting_thread(
+        [&]
+        {
+            MemoryReservation reservation(memory_budget, 50);
+            is_acquired = true;
+        });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(is_acquired);
+
+    memory_budget.Release(80);
+    waiting_thread.join();
+    EXPECT_TRUE(is_acquired);
+    EXPECT_TRUE(memory_budget.TryAcquire(100));
+}
+
+TEST(MemoryBudgetTest, FitToMemoryLimit)
+{
+    EncodingOptions options = GetLevelOptions(1);
+    options.threads_count = 4;
+    EXPECT_EQ(FitToMemoryLimit(options).block_size, options.block_size);
+    EXPECT_EQ(FitToMemoryLimit(options).threads_count, 4);
+
+    // The blocks shrink until one thread encoding them and one decoding them fit, and two encoded
+    // ranges no longer fit ahead
+    options.memory_limit = 8 << 20;
+    auto fitted_options = FitToMemoryLimit(options);
+    EXPECT_LT(fitted_options.block_size, options.block_size);
+    EXPECT_GE(fitted_options.block_size, MIN_BUDGETED_BLOCK_SIZE);
+    EXPECT_LE(EstimateEncodingMemory(fitted_options, fitted_options.block_size),
+              GetBudgetedMemory(options.memory_limit));
+    EXPECT_LE(EstimateDecodingMemory(UINT64_MAX, fitted_options.block_size, 0),
+              GetBudgetedMemory(options.memory_limit));
+    EXPECT_EQ(fitted_options.threads_count, 1);
+
+    // The decoding tables and the mapped window of a large file alone do not fit
+    options.memory_limit = 6 << 20;
+    EXPECT_THROW(FitToMemoryLimit(options), std::invalid_argument);
+
+    options.memory_limit = 256 << 20;
+    fitted_options = FitToMemoryLimit(options);
+    EXPECT_EQ(fitted_options.block_size, options.block_size);
+    EXPECT_EQ(fitted_options.threads_count, 4);
+
+    options.memory_limit = 1 << 20;
+    EXPECT_THROW(FitToMemoryLimit(options), std::invalid_argument);
+
+    // The Burrows-Wheeler transform of the smallest block needs more than a few MiB
+    options = GetLevelOptions(MAX_LEVEL);
+    options.memory_limit = 5 << 20;
+    EXPECT_THROW(FitToMemoryLimit(options), std::invalid_argument);
+}
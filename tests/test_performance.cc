@@ -0,0 +1,296 @@
+#include "filereader.h"
+#include "filewriter.h"
+
+#include <algorithm>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace pt = boost::property_tree;
+
+/*
+ * Throughput and peak memory of ./archiver compressing and decompressing generated corpora, against
+ * the baseline in tests/performance_baseline.json. Set ARCHIVER_PERF_TOLERANCE to override the
+ * allowed throughput drop, ARCHIVER_PERF_BASELINE to read another baseline, and
+ * ARCHIVER_PERF_UPDATE=1 to write the measurements to the baseline instead of checking them.
+ */
+
+constexpr size_t CORPUS_SIZE = 8 << 20;
+constexpr int RUNS_COUNT = 5;
+
+/*
+ * A corpus compressed at a level.
+ */
+struct PerformanceCase
+{
+    std::string name;
+    std::string corpus_name;
+    int level;
+    std::vector<std::string> options = {}; // e.g. --ans, after the level
+};
+
+/*
+ * The best of the runs of a case.
+ */
+struct PerformanceResult
+{
+    double compress_mb_s = 0;
+    double decompress_mb_s = 0;
+    double compress_peak_rss_mib = 0;
+    double decompress_peak_rss_mib = 0;
+};
+
+/*
+ * Write a corpus in chunks, so that the test keeps little memory for the processes it forks.
+ * @param corpus_name The corpus: text or JSON logs.
+ * @param writer The file writer.
+ */
+void WriteCorpus(const std::string& corpus_name, FileWriter& writer)
+{
+    std::mt19937 generator(corpus_name == "text" ? 1 : 2);
+    std::vector<std::string> words = { "the",  "of",  "and",  "to",   "a",      "in",
+                                       "is",   "that", "for", "it",   "as",     "was",
+                                       "with", "be",  "by",   "on",   "not",    "which",
+                                       "this", "war", "from", "were", "empire", "century" };
+    std::vector<std::string> paths = { "/api/v1/items", "/api/v1/users", "/health", "/login" };
+
+    std::vector<unsigned char> chunk;
+    size_t corpus_size = 0;
+    for (size_t i = 0; corpus_size < CORPUS_SIZE; ++i)
+    {
+        std::string piece;
+        if (corpus_name == "text")
+        {
+            piece = words[generator() % words.size()] + (generator() % 12 == 0 ? "\n" : " ");
+        }
+        else
+        {
+            piece = R"({"ts":"2024-05-01T12:)" + std::to_string(10 + i / 6000 % 50) + ":"
+                + std::to_string(10 + i / 100 % 50) + R"(Z","level":"INFO","path":")"
+                + paths[generator() % paths.size()] + R"(","duration_ms":)"
+                + std::to_string(generator() % 300) + "}\n";
+        }
+        piece.resize(std::min(piece.size(), CORPUS_SIZE - corpus_size));
+        chunk.insert(chunk.end(), piece.begin(), piece.end());
+        corpus_size += piece.size();
+
+        if (chunk.size() >= 1 << 16 || corpus_size == CORPUS_SIZE)
+        {
+            writer.WriteCharacters(chunk);
+            chunk.clear();
+        }
+    }
+}
+
+/*
+ * Run ./archiver in a directory and wait for it.
+ * @param arguments The arguments after the program name.
+ * @param directory The working directory.
+ * @param peak_rss_mib Set to the peak resident memory of the process in MiB.
+ * @return The processor time of the process in seconds, user and system, which the other
+ * processes on the machine disturb less than the wall-clock time.
+ */
+double RunArchiver(const std::vector<std::string>& arguments,
+                   const std::string& directory,
+                   double& peak_rss_mib)
+{
+    std::vector<char*> argv = { const_cast<char*>(ARCHIVER_PATH) };
+    for (const auto& argument : arguments)
+    {
+        argv.push_back(const_cast<char*>(argument.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        if (chdir(directory.c_str()) == 0)
+        {
+            execv(ARCHIVER_PATH, argv.data());
+        }
+        _exit(127);
+    }
+
+    int status = 0;
+    rusage usage {};
+    if (pid < 0 || wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status)
+        || WEXITSTATUS(status) != 0)
+    {
+        throw std::runtime_error("./archiver failed");
+    }
+
+    peak_rss_mib = static_cast<double>(usage.ru_maxrss) / 1024; // KiB on Linux
+    auto to_seconds = [](const timeval& time)
+    { return static_cast<double>(time.tv_sec) + static_cast<double>(time.tv_usec) / 1e6; };
+    return to_seconds(usage.ru_utime) + to_seconds(usage.ru_stime);
+}
+
+PerformanceResult MeasureCase(const PerformanceCase& performance_case)
+{
+    auto directory = std::filesystem::absolute("test_performance_" + performance_case.name);
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory / "output");
+    auto corpus_path = directory / (performance_case.corpus_name + ".txt");
+    auto archive_path = directory / "corpus.huff";
+
+    {
+        FileWriter writer(corpus_path.string());
+        WriteCorpus(performance_case.corpus_name, writer);
+    }
+
+    PerformanceResult result;
+    auto size_mb = static_cast<double>(CORPUS_SIZE) / 1e6;
+    for (int run = 0; run < RUNS_COUNT; ++run)
+    {
+        std::vector<std::string> arguments = { "-l", std::to_string(performance_case.level) };
+        arguments.insert(
+            arguments.end(), performance_case.options.begin(), performance_case.options.end());
+        arguments.insert(arguments.end(), { "-c", archive_path.string(), corpus_path.string() });
+        double compress_rss = 0;
+        double compress_seconds = RunArchiver(arguments, directory.string(), compress_rss);
+        double decompress_rss = 0;
+        double decompress_seconds = RunArchiver({ "-d", archive_path.string() },
+                                                (directory / "output").string(),
+                                                decompress_rss);
+
+        // Keep the fastest runs and the smallest peaks, which the other processes disturb least
+        result.compress_mb_s = std::max(result.compress_mb_s, size_mb / compress_seconds);
+        result.decompress_mb_s = std::max(result.decompress_mb_s, size_mb / decompress_seconds);
+        result.compress_peak_rss_mib = run == 0
+            ? compress_rss
+            : std::min(result.compress_peak_rss_mib, compress_rss);
+        result.decompress_peak_rss_mib = run == 0
+            ? decompress_rss
+            : std::min(result.decompress_peak_rss_mib, decompress_rss);
+    }
+
+    FileReader original_reader(corpus_path.string());
+    FileReader restored_reader((directory / "output" / corpus_path.filename()).string());
+    EXPECT_EQ(restored_reader.GetFileSize(), CORPUS_SIZE) << performance_case.name;
+    bool is_restored = true;
+    while (original_reader.HasMoreCharacters() && is_restored)
+    {
+        auto original_chunk = original_reader.ReadCharacters(1 << 16);
+        is_restored = restored_reader.ReadCharacters(1 << 16) == original_chunk;
+    }
+    EXPECT_TRUE(is_restored) << performance_case.name;
+    std::filesystem::remove_all(directory);
+    return result;
+}
+
+/*
+ * Write the results in the format of the baseline.
+ */
+void WriteResults(const std::string& path,
+                  double throughput_tolerance,
+                  double peak_rss_tolerance,
+                  const std::vector<PerformanceCase>& cases,
+                  const std::vector<PerformanceResult>& results)
+{
+    std::ofstream file(path);
+    file << "{\n    \"throughput_tolerance\": " << throughput_tolerance
+         << ",\n    \"peak_rss_tolerance\": " << peak_rss_tolerance << ",\n    \"cases\": {";
+    for (size_t i = 0; i < cases.size(); ++i)
+    {
+        char line[256];
+        std::snprintf(line,
+                      sizeof(line),
+                      "%s\n        \"%s\": { \"compress_mb_s\": %.1f, \"decompress_mb_s\": %.1f, "
+                      "\"compress_peak_rss_mib\": %.1f, \"decompress_peak_rss_mib\": %.1f }",
+                      i == 0 ? "" : ",",
+                      cases[i].name.c_str(),
+                      results[i].compress_mb_s,
+                      results[i].decompress_mb_s,
+                      results[i].compress_peak_rss_mib,
+                      results[i].decompress_peak_rss_mib);
+        file << line;
+    }
+    file << "\n    }\n}\n";
+}
+
+TEST(PerformanceTest, ThroughputAndPeakMemoryKeepToTheBaseline)
+{
+    if (std::string(BUILD_TYPE) != "Release")
+    {
+        GTEST_SKIP() << "The baseline is measured on a Release build";
+    }
+
+    const char* baseline_override = std::getenv("ARCHIVER_PERF_BASELINE");
+    std::string baseline_path = baseline_override ? baseline_override : PERFORMANCE_BASELINE_PATH;
+    pt::ptree baseline;
+    pt::read_json(baseline_path, baseline);
+    auto throughput_tolerance = baseline.get<double>("throughput_tolerance");
+    auto peak_rss_tolerance = baseline.get<double>("peak_rss_tolerance");
+    if (const char* tolerance = std::getenv("ARCHIVER_PERF_TOLERANCE"))
+    {
+        throughput_tolerance = std::stod(tolerance);
+    }
+
+    std::vector<PerformanceCase> cases = { { "text-level-1", "text", 1 },
+                                           { "text-level-6", "text", 6 },
+                                           { "text-level-9", "text", 9 },
+                                           { "text-ans", "text", 6, { "--ans" } },
+                                           { "logs-level-1", "logs", 1 },
+                                           { "logs-level-6", "logs", 6 },
+                                           { "logs-level-9", "logs", 9 },
+                                           { "logs-ans", "logs", 6, { "--ans" } } };
+    std::vector<PerformanceResult> results;
+    for (const auto& performance_case : cases)
+    {
+        results.push_back(MeasureCase(performance_case));
+    }
+
+    // The results are kept next to the test for tracking them over time
+    WriteResults("performance_results.json",
+                 throughput_tolerance,
+                 peak_rss_tolerance,
+                 cases,
+                 results);
+    const char* update = std::getenv("ARCHIVER_PERF_UPDATE");
+    if (update != nullptr && std::string(update) == "1")
+    {
+        WriteResults(baseline_path, throughput_tolerance, peak_rss_tolerance, cases, results);
+        GTEST_SKIP() << "The baseline is updated at " << baseline_path;
+    }
+
+    for (size_t i = 0; i < cases.size(); ++i)
+    {
+        const auto& result = results[i];
+        auto expected = baseline.get_child_optional("cases." + cases[i].name);
+        if (!expected)
+        {
+            ADD_FAILURE() << cases[i].name << " has no baseline, run with ARCHIVER_PERF_UPDATE=1";
+            continue;
+        }
+
+        std::printf("%-14s compress %7.1f MB/s %6.1f MiB  decompress %7.1f MB/s %6.1f MiB\n",
+                    cases[i].name.c_str(),
+                    result.compress_mb_s,
+                    result.compress_peak_rss_mib,
+                    result.decompress_mb_s,
+                    result.decompress_peak_rss_mib);
+        EXPECT_GE(result.compress_mb_s,
+                  expected->get<double>("compress_mb_s") * (1 - throughput_tolerance))
+            << cases[i].name;
+        EXPECT_GE(result.decompress_mb_s,
+                  expected->get<double>("decompress_mb_s") * (1 - throughput_tolerance))
+            << cases[i].name;
+        EXPECT_LE(result.compress_peak_rss_mib,
+                  expected->get<double>("compress_peak_rss_mib") * (1 + peak_rss_tolerance))
+            << cases[i].name;
+        EXPECT_LE(result.decompress_peak_rss_mib,
+                  expected->get<double>("decompress_peak_rss_mib") * (1 + peak_rss_tolerance))
+            << cases[i].name;
+    }
+}
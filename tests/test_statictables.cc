@@ -0,0 +1,190 @@
+#include "compressorcontext.h"
+#include "huffman.h"
+#include "statictables.h"
+
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+TEST(StaticTablesTest, EveryCodeDecodesToItsSymbol)
+{
+    ASSERT_EQ(GetStaticTablesCount(), 3);
+    for (size_t table_index = 0; table_index < GetStaticTablesCount(); ++table_index)
+    {
+        const auto& table = GetStaticTable(table_index);
+        for (uint16_t symbol = 0; symbol <= BLOCK_END; ++symbol)
+        {
+            if (symbol > FILENAME_END && symbol != BLOCK_END)
+            {
+                continue;
+            }
+            size_t index = GetStaticSymbolIndex(symbol);
+            ASSERT_GT(table.code_lengths[index], 0);
+            ASSERT_LE(table.code_lengths[index], MAX_STATIC_CODE_LENGTH);
+
+            size_t bits_read = 0;
+            auto read_bit = [&] { return (table.reversed_codes[index] >> bits_read++) & 1; };
+            EXPECT_EQ(DecodeStaticSymbol(table, read_bit), symbol);
+            EXPECT_EQ(bits_read, table.code_lengths[index]);
+        }
+    }
+    EXPECT_THROW(GetStaticTable(GetStaticTablesCount()), std::runtime_error);
+}
+
+TEST(StaticTablesTest, StaticScopeRoundTrip)
+{
+    std::mt19937 generator(11);
+    {
+        // Log lines the JSON table fits, then bytes no table fits
+        FileWriter writer("test_static.txt");
+        for (size_t i = 0; i < 2000; ++i)
+        {
+            std::string line = R"({"level":"INFO","msg":"request served","duration_ms":)"
+                + std::to_string(generator() % 300) + "}\n";
+            for (auto character : line)
+            {
+                writer.WriteCharacter(static_cast<unsigned char>(character));
+            }
+        }
+        for (size_t i = 0; i < 5000; ++i)
+        {
+            writer.WriteCharacter(static_cast<unsigned char>(generator()));
+        }
+    }
+
+    EncodingOptions options { .frequency_mode = FrequencyMode::Sampled,
+                              .table_scope = TableScope::Static,
+                              .block_size = 16 << 10,
+                              .collect_stats = true };
+    EncodingStats stats;
+    {
+        HuffmanCoder huffman_coder(options);
+        FileReader reader("test_static.txt");
+        FileWriter writer("test_static.huff");
+        stats = huffman_coder.Encode(reader, writer);
+    }
+    EXPECT_LT(stats.encoded_bits, stats.original_size * 8 * 3 / 4);
+
+    std::string original_file_text;
+    {
+        FileReader reader("test_static.txt");
+        auto characters = reader.ReadCharacters(reader.GetFileSize());
+        original_file_text.assign(characters.begin(), characters.end());
+    }
+
+    std::filesystem::remove("test_static.txt");
+    {
+        HuffmanCoder huffman_coder;
+        FileReader reader("test_static.huff");
+        huffman_coder.Decode(reader);
+    }
+
+    FileReader reader("test_static.txt");
+    auto characters = reader.ReadCharacters(original_file_text.size() + 1);
+    EXPECT_EQ(std::string(characters.begin(), characters.end()), original_file_text);
+}
+
+TEST(StaticTablesTest, StaticScopePicksTableWithoutStoredCheck)
+{
+    // Without the stored block check the blocks are still counted to pick their table
+    EncodingOptions options { .frequency_mode = FrequencyMode::Sampled,
+                              .table_scope = TableScope::Static,
+                              .block_size = 16 << 10,
+                              .stored_threshold = 0.0,
+                              .collect_stats = true };
+    auto encode = [&options](const std::string& text, uint64_t& encoded_bits)
+    {
+        {
+            FileWriter writer("test_static.txt");
+            writer.WriteCharacters({ text.begin(), text.end() });
+        }
+        {
+            HuffmanCoder huffman_coder(options);
+            FileReader reader("test_static.txt");
+            FileWriter writer("test_static.huff");
+            encoded_bits = huffman_coder.Encode(reader, writer).encoded_bits;
+        }
+
+        // The first block follows the file header: its type, then the index of its table
+        HuffmanCoder huffman_coder;
+        FileReader reader("test_static.huff");
+        huffman_coder.RestoreFileHeader(reader);
+        EXPECT_EQ(reader.ReadHuffmanInt(), static_cast<uint16_t>(BlockType::Static));
+        size_t table_index = reader.ReadHuffmanInt(8);
+
+        std::filesystem::remove("test_static.txt");
+        reader.SetPosition(0);
+        huffman_coder.Decode(reader);
+        FileReader restored_reader("test_static.txt");
+        auto characters = restored_reader.ReadCharacters(text.size() + 1);
+        EXPECT_EQ(std::string(characters.begin(), characters.end()), text);
+        return table_index;
+    };
+
+    std::mt19937 generator(13);
+    std::string logs;
+    std::string prose;
+    while (logs.size() < 64 << 10)
+    {
+        logs += R"({"level":"INFO","msg":"request served","duration_ms":)"
+            + std::to_string(generator() % 300) + "}\n";
+        prose += "The archive keeps the files in the order they are given, and each file starts "
+                 "at a byte boundary. ";
+    }
+
+    uint64_t logs_bits = 0;
+    uint64_t prose_bits = 0;
+    size_t logs_table_index = encode(logs, logs_bits);
+    size_t prose_table_index = encode(prose, prose_bits);
+    EXPECT_EQ(logs_table_index, 1);
+    EXPECT_EQ(prose_table_index, 0);
+    EXPECT_LT(logs_bits, logs.size() * 8 * 3 / 4);
+    EXPECT_LT(prose_bits, prose.size() * 8 * 3 / 4);
+}
+
+TEST(StaticTablesTest, SmallFilesSkipTheirTableHeader)
+{
+    {
+        std::string text = "The archive keeps the files in the order they are given, and each "
+                           "file starts at a byte boundary so that it can be copied as it is.";
+        FileWriter writer("test_static.txt");
+        for (auto character : text)
+        {
+            writer.WriteCharacter(static_cast<unsigned char>(character));
+        }
+    }
+
+    auto encode = [](const EncodingOptions& options)
+    {
+        HuffmanCoder huffman_coder(options);
+        FileReader reader("test_static.txt");
+        FileWriter writer("test_static.huff");
+        return huffman_coder.Encode(reader, writer).encoded_bits;
+    };
+    uint64_t own_table_bits = encode({ .collect_stats = true });
+    uint64_t static_table_bits = encode({ .static_tables = true, .collect_stats = true });
+    EXPECT_LT(static_table_bits + 100, own_table_bits);
+}
+
+TEST(StaticTablesTest, SmallRecordsUseStaticTables)
+{
+    std::string line = R"({"ts":"2024-05-01T12:00:10Z","level":"INFO","msg":"request served"})";
+    std::vector<unsigned char> buffer(line.begin(), line.end());
+
+    CompressorContext context;
+    std::vector<unsigned char> record;
+    context.Compress(buffer, record);
+    EXPECT_EQ(record[0] | (record[1] & 1) << 8, static_cast<uint16_t>(BlockType::Static));
+    EXPECT_LT(record.size(), buffer.size() * 3 / 4);
+
+    std::vector<unsigned char> output;
+    EXPECT_EQ(context.Decompress(record, output), record.size());
+    EXPECT_EQ(output, buffer);
+
+    // The table index follows the 9-bit block type
+    record[1] |= 0xFE;
+    output.clear();
+    EXPECT_THROW(context.Decompress(record, output), std::runtime_error);
+}
@@ -0,0 +1,147 @@
+#include "archiver.h"
+#include "trace.h"
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <map>
+#include <set>
+#include <string>
+
+namespace pt = boost::property_tree;
+
+TEST(TraceTest, ThreadsRecordBalancedStages)
+{
+    if (!TRACING_BUILT)
+    {
+        GTEST_SKIP() << "Tracing is compiled out of this build";
+    }
+
+    // Small blocks and sync points, so that the files are split over the threads
+    EncodingOptions options = GetLevelOptions(MAX_LEVEL);
+    options.block_size = 256;
+    options.sync_interval = 512;
+    options.threads_count = 3;
+    std::filesystem::remove_all("test_trace_output");
+
+    StartTracing();
+    Archiver("test_trace.huff", { "test_1.txt", "test_2.txt" }, options).Compress();
+    Archiver("test_trace.huff", 2).Decompress("test_trace_output");
+    WriteTrace("test_trace.json");
+
+    pt::ptree trace;
+    pt::read_json("test_trace.json", trace);
+
+    std::map<std::string, int> depths; // by thread
+    std::set<std::string> stages;
+    std::set<std::string> files;
+    for (const auto& [_, event] : trace.get_child("traceEvents"))
+    {
+        auto phase = event.get<std::string>("ph");
+        auto thread = event.get<std::string>("tid");
+        if (phase == "B")
+        {
+            ++depths[thread];
+            stages.insert(event.get<std::string>("name"));
+            files.insert(event.get<std::string>("args.file"));
+        }
+        else if (phase == "E")
+        {
+            ASSERT_GT(depths[thread]--, 0);
+        }
+    }
+
+    for (const auto& [thread, depth] : depths)
+    {
+        EXPECT_EQ(depth, 0) << "thread " << thread;
+    }
+    EXPECT_GE(depths.size(), 3);
+    for (std::string stage :
+         { "histogram", "tree build", "canonicalize", "encode", "decode", "read", "flush" })
+    {
+        EXPECT_TRUE(stages.count(stage)) << stage;
+    }
+    EXPECT_TRUE(files.count("test_1.txt"));
+    EXPECT_TRUE(files.count("test_2.txt"));
+}
+
+TEST(TraceTest, FullBufferKeepsTheLatestEvents)
+{
+    if (!TRACING_BUILT)
+    {
+        GTEST_SKIP() << "Tracing is compiled out of this build";
+    }
+
+    StartTracing();
+    SetTraceFile("a \"quoted\"\tname");
+    for (size_t i = 0; i < TRACE_BUFFER_EVENTS; ++i)
+    {
+        SetTraceBlock(i);
+        TraceScope outer_scope(TraceStage::Encode);
+        TraceScope inner_scope(TraceStage::Flush);
+    }
+    WriteTrace("test_trace.json");
+
+    // One event per line, the file is too large for a quick JSON parse in a debug build
+    std::ifstream file("test_trace.json");
+    size_t begins_count = 0;
+    size_t ends_count = 0;
+    std::string line;
+    std::string last_begin;
+    while (std::getline(file, line))
+    {
+        if (line.find("\"ph\":\"B\"") != std::string::npos)
+        {
+            ++begins_count;
+            last_begin = line;
+        }
+        ends_count += line.find("\"ph\":\"E\"") != std::string::npos;
+    }
+    EXPECT_EQ(begins_count, ends_count);
+    EXPECT_LE(begins_count + ends_count, TRACE_BUFFER_EVENTS);
+    EXPECT_GE(begins_count + ends_count, TRACE_BUFFER_EVENTS - 4);
+    EXPECT_NE(last_begin.find(R"("args":{"file":"a \"quoted\"\u0009name","block":)"
+                              + std::to_string(TRACE_BUFFER_EVENTS - 1) + "}"),
+              std::string::npos);
+}
+
+TEST(TraceTest, NonAsciiFileNamesStayValidJson)
+{
+    if (!TRACING_BUILT)
+    {
+        GTEST_SKIP() << "Tracing is compiled out of this build";
+    }
+
+    // A UTF-8 name is kept as it is, a byte that is not UTF-8 is escaped
+    StartTracing();
+    SetTraceFile("donn\xC3\xA9" "es.txt");
+    {
+        TraceScope trace_scope(TraceStage::Encode);
+    }
+    SetTraceFile("latin\xE9\xFF.txt");
+    {
+        TraceScope trace_scope(TraceStage::Decode);
+    }
+    WriteTrace("test_trace.json");
+
+    std::ifstream file("test_trace.json");
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    EXPECT_NE(text.find("\"file\":\"donn\xC3\xA9" "es.txt\""), std::string::npos);
+    EXPECT_NE(text.find(R"("file":"latin\u00e9\u00ff.txt")"), std::string::npos);
+
+    pt::ptree trace;
+    pt::read_json("test_trace.json", trace);
+    std::set<std::string> files;
+    for (const auto& [_, event] : trace.get_child("traceEvents"))
+    {
+        if (event.get<std::string>("ph") == "B")
+        {
+            files.insert(event.get<std::string>("args.file"));
+        }
+    }
+    EXPECT_TRUE(files.count("donn\xC3\xA9" "es.txt"));
+    EXPECT_TRUE(files.count("latin\xC3\xA9\xC3\xBF.txt"));
+}
@@ -0,0 +1,141 @@
+#include "huffman.h"
+#include "transform.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+TEST(TransformTest, SuffixArrayMatchesSortedSuffixes)
+{
+    std::mt19937 generator(42);
+    for (int32_t alphabet_size : { 2, 3, 16 })
+    {
+        std::uniform_int_distribution<int32_t> distribution(1, alphabet_size - 1);
+        for (size_t text_size : { 1, 2, 7, 100, 1000 })
+        {
+            std::vector<int32_t> text(text_size);
+            std::generate(text.begin(), text.end() - 1, [&] { return distribution(generator); });
+            text.back() = 0;
+
+            std::vector<int32_t> sorted_suffixes(text_size);
+            std::iota(sorted_suffixes.begin(), sorted_suffixes.end(), 0);
+            std::sort(sorted_suffixes.begin(),
+                      sorted_suffixes.end(),
+                      [&](int32_t lhs, int32_t rhs)
+                      {
+                          return std::lexicographical_compare(
+                              text.begin() + lhs, text.end(), text.begin() + rhs, text.end());
+                      });
+
+            ASSERT_EQ(BuildSuffixArray(text, alphabet_size), sorted_suffixes);
+        }
+    }
+}
+
+TEST(TransformTest, BwtOfBanana)
+{
+    std::string banana = "banana";
+    auto transformed = ApplyBwt(std::vector<unsigned char>(banana.begin(), banana.end()));
+
+    // The rotations of "banana$" sorted, the original one is the fourth row
+    ASSERT_EQ(transformed.size(), 4 + banana.size());
+    EXPECT_EQ(transformed[0], 4);
+    EXPECT_EQ(std::string(transformed.begin() + 4, transformed.end()), "annbaa");
+}
+
+TEST(TransformTest, TransformsRoundTrip)
+{
+    std::mt19937 generator(7);
+    std::uniform_int_distribution<int> distribution(0, 3);
+
+    std::vector<std::vector<unsigned char>> blocks = { {}, { 'a' }, { 0, 0, 0, 0 } };
+    for (size_t run_length : { 3, 4, 5, 258, 259, 260, 600 })
+    {
+        blocks.emplace_back(run_length, 'x');
+    }
+    std::vector<unsigned char> random_block(10000);
+    std::generate(random_block.begin(),
+                  random_block.end(),
+                  [&] { return static_cast<unsigned char>(distribution(generator) * 85); });
+    blocks.push_back(random_block);
+
+    for (const auto& block : blocks)
+    {
+        EXPECT_EQ(InvertBwt(ApplyBwt(block)), block);
+        EXPECT_EQ(InvertMtf(ApplyMtf(block)), block);
+        EXPECT_EQ(InvertRle(ApplyRle(block)), block);
+        for (uint16_t transforms = 0; transforms <= ALL_TRANSFORMS; ++transforms)
+        {
+            EXPECT_EQ(InvertTransforms(ApplyTransforms(block, transforms), transforms), block);
+        }
+    }
+}
+
+TEST(TransformTest, CorruptedBlocksThrow)
+{
+    EXPECT_THROW(InvertBwt({ 1, 0 }), std::runtime_error);
+    EXPECT_THROW(InvertBwt({ 9, 0, 0, 0, 'a' }), std::runtime_error);
+    EXPECT_THROW(InvertRle({ 'a', 'a', 'a', 'a' }), std::runtime_error);
+    EXPECT_THROW(InvertRle({ 'a', 'a', 'a', 'a', 255 }, 16), std::runtime_error);
+    EXPECT_EQ(InvertRle({ 'a', 'a', 'a', 'a', 12 }, 16).size(), 16);
+    EXPECT_THROW(InvertTransforms({ 1, 0, 0, 0, 'a', 'a', 'a', 'a', 255 }, 5, 16),
+                 std::runtime_error);
+    EXPECT_THROW(InvertTransforms({}, 8), std::runtime_error);
+}
+
+TEST(TransformTest, TransformedBlocksShrinkLogs)
+{
+    {
+        FileWriter writer("test_transform.txt");
+        for (size_t i = 0; i < 2000; ++i)
+        {
+            std::string line = "2024-05-01 12:00:" + std::to_string(10 + i % 50)
+                + " INFO request served status=200 path=/api/v1/items\n";
+            for (auto character : line)
+            {
+                writer.WriteCharacter(character);
+            }
+        }
+    }
+
+    EncodingOptions plain_options { .collect_stats = true };
+    EncodingOptions transform_options { .transforms = ALL_TRANSFORMS, .collect_stats = true };
+
+    EncodingStats plain_stats;
+    EncodingStats transform_stats;
+    {
+        HuffmanCoder huffman_coder(plain_options);
+        FileReader reader("test_transform.txt");
+        FileWriter writer("test_plain.huff");
+        plain_stats = huffman_coder.Encode(reader, writer);
+    }
+    {
+        HuffmanCoder huffman_coder(transform_options);
+        FileReader reader("test_transform.txt");
+        FileWriter writer("test_transform.huff");
+        transform_stats = huffman_coder.Encode(reader, writer);
+    }
+    EXPECT_LT(transform_stats.encoded_bits, plain_stats.encoded_bits / 4);
+
+    std::string original_file_text;
+    {
+        FileReader reader("test_transform.txt");
+        auto characters = reader.ReadCharacters(reader.GetFileSize());
+        original_file_text.assign(characters.begin(), characters.end());
+    }
+
+    std::filesystem::remove("test_transform.txt");
+    {
+        HuffmanCoder huffman_coder;
+        FileReader reader("test_transform.huff");
+        huffman_coder.Decode(reader);
+    }
+
+    FileReader reader("test_transform.txt");
+    auto characters = reader.ReadCharacters(original_file_text.size() + 1);
+    EXPECT_EQ(std::string(characters.begin(), characters.end()), original_file_text);
+}
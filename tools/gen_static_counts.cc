@@ -0,0 +1,362 @@
+/*
+ * Generate the reference character counts of the built-in tables of src/statictables.cc.
+ *
+ * Each table gets a corpus of CORPUS_SIZE bytes drawn from std::mt19937 with a fixed seed, which
+ * the standard specifies bit for bit, and the draws only use its raw output, so every platform
+ * prints the same counts:
+ *   - English prose (seed 1): sentences of 4 to 20 words drawn by a Zipf law from the most common
+ *     English words, with capitals, commas, a few numbers and names, wrapped at 72 columns into
+ *     paragraphs.
+ *   - JSON logs (seed 2): one object per line with an ISO 8601 timestamp, a level, a service, a
+ *     request id, a method, a path, a status, a duration and a message.
+ *   - CSV (seed 3): a header, then rows of a date, a first and a last name, a city, an amount and
+ *     a currency.
+ * The counts are scaled to about 2^16 in all, and every byte value counts at least once, so that
+ * it gets a code.
+ *
+ * Usage: gen_static_counts > counts.txt, then replace the arrays of src/statictables.cc with the
+ * output.
+ */
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+
+constexpr size_t CORPUS_SIZE = 1 << 20;
+constexpr uint64_t SCALED_TOTAL = 1 << 16;
+constexpr uint64_t ZIPF_SCALE = 720720;
+
+using CharacterCounts = std::array<uint64_t, 256>;
+
+/*
+ * Draw a number below the bound from the raw output of the generator.
+ * @param generator The generator.
+ * @param bound The bound.
+ * @return The number.
+ */
+size_t Draw(std::mt19937& generator, size_t bound)
+{
+    return generator() % bound;
+}
+
+/*
+ * Pick an item of a list by a Zipf law, the first items are the most frequent.
+ * @param generator The generator.
+ * @param items The items.
+ * @return The item.
+ */
+std::string_view PickZipf(std::mt19937& generator, const std::vector<std::string_view>& items)
+{
+    // The weight of the i-th item is 1 / (i + 4), about the shares of the common English words
+    uint64_t total = 0;
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        total += ZIPF_SCALE / (i + 4);
+    }
+    uint64_t draw = generator() % total;
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        uint64_t weight = ZIPF_SCALE / (i + 4);
+        if (draw < weight)
+        {
+            return items[i];
+        }
+        draw -= weight;
+    }
+    return items.back();
+}
+
+/*
+ * Pick an item of a list with equal chances.
+ * @param generator The generator.
+ * @param items The items.
+ * @return The item.
+ */
+std::string_view PickUniform(std::mt19937& generator, const std::vector<std::string_view>& items)
+{
+    return items[Draw(generator, items.size())];
+}
+
+/*
+ * Write a number with leading zeros.
+ * @param number The number.
+ * @param width The number of digits at least.
+ * @return The digits.
+ */
+std::string Pad(uint64_t number, size_t width)
+{
+    auto digits = std::to_string(number);
+    return std::string(width > digits.size() ? width - digits.size() : 0, '0') + digits;
+}
+
+std::string GenerateEnglish(std::mt19937& generator)
+{
+    const std::vector<std::string_view> words = {
+        "the", "of", "and", "to", "a", "in", "that", "is", "was", "he", "for", "it", "with", "as",
+        "his", "on", "be", "at", "by", "i", "this", "had", "not", "are", "but", "from", "or",
+        "have", "an", "they", "which", "one", "you", "were", "her", "all", "she", "there", "would",
+        "their", "we", "him", "been", "has", "when", "who", "will", "more", "no", "if", "out", "so",
+        "said", "what", "up", "its", "about", "into", "than", "them", "can", "only", "other", "new",
+        "some", "could", "time", "these", "two", "may", "then", "do", "first", "any", "my", "now",
+        "such", "like", "our", "over", "man", "me", "even", "most", "made", "after", "also", "did",
+        "many", "before", "must", "through", "back", "years", "where", "much", "your", "way",
+        "well", "down", "should", "because", "each", "just", "those", "people", "how", "too",
+        "little", "state", "good", "very", "make", "world", "still", "own", "see", "men", "work",
+        "long", "get", "here", "between", "both", "life", "being", "under", "never", "day", "same",
+        "another", "know", "while", "last", "might", "us", "great", "old", "year", "off", "come",
+        "since", "against", "go", "came", "right", "used", "take", "three", "house", "without",
+        "again", "place", "around", "small", "found", "thought", "went", "say", "part", "once",
+        "general", "high", "upon", "school", "every", "water", "light", "country", "question",
+        "number", "morning", "letter", "family", "together", "window", "company", "process",
+        "system", "program", "public", "position", "service", "special", "possible", "important",
+        "business", "city", "community", "experience", "policy", "economic", "political", "history",
+        "information", "development", "government", "during", "something", "problem", "children",
+        "social", "play", "point", "power", "money", "music", "science", "simple", "story", "study",
+        "party", "price", "private", "project", "provide", "picture", "particular", "perhaps",
+        "open", "become", "building", "body", "began", "big", "give", "given", "making", "voice",
+        "view", "complete", "course", "church", "common", "society", "period", "product",
+        "practice", "space", "economy", "physical", "increase", "support", "example", "village",
+        "evening", "quickly", "surprise", "beautiful",
+    };
+    const std::vector<std::string_view> names = {
+        "London", "Mary", "John", "England", "Paris", "Thomas", "Elizabeth",
+        "America", "James", "Monday", "March", "Charles", "Anna", "Henry",
+    };
+
+    std::string text;
+    size_t line_length = 0;
+    auto append_word = [&](std::string_view word)
+    {
+        if (line_length + 1 + word.size() > 72)
+        {
+            text += '\n';
+            line_length = 0;
+        }
+        else if (line_length > 0)
+        {
+            text += ' ';
+            ++line_length;
+        }
+        text += word;
+        line_length += word.size();
+    };
+
+    while (text.size() < CORPUS_SIZE)
+    {
+        size_t sentences_count = 3 + Draw(generator, 6);
+        for (size_t sentence = 0; sentence < sentences_count; ++sentence)
+        {
+            size_t words_count = 4 + Draw(generator, 17);
+            for (size_t i = 0; i < words_count; ++i)
+            {
+                std::string word;
+                size_t kind = Draw(generator, 100);
+                if (kind < 3)
+                {
+                    word = PickUniform(generator, names);
+                }
+                else if (kind < 4)
+                {
+                    word = std::to_string(1 + Draw(generator, 1999));
+                }
+                else
+                {
+                    word = PickZipf(generator, words);
+                    if (word == "i")
+                    {
+                        word = "I";
+                    }
+                }
+                if (i == 0 && word[0] >= 'a' && word[0] <= 'z')
+                {
+                    word[0] = static_cast<char>(word[0] - 'a' + 'A');
+                }
+
+                if (i + 1 == words_count)
+                {
+                    size_t end = Draw(generator, 20);
+                    word += end == 0 ? "?" : end == 1 ? "!" : ".";
+                }
+                else if (Draw(generator, 10) == 0)
+                {
+                    word += Draw(generator, 8) == 0 ? ";" : ",";
+                }
+                else if (Draw(generator, 60) == 0)
+                {
+                    word = "\"" + word + "\"";
+                }
+                append_word(word);
+            }
+        }
+        text += "\n\n";
+        line_length = 0;
+    }
+    text.resize(CORPUS_SIZE);
+    return text;
+}
+
+std::string GenerateJsonLogs(std::mt19937& generator)
+{
+    const std::vector<std::string_view> levels = { "INFO", "INFO", "INFO", "INFO",
+                                                   "DEBUG", "WARN", "ERROR" };
+    const std::vector<std::string_view> services = { "api", "auth", "billing", "search",
+                                                     "worker", "gateway" };
+    const std::vector<std::string_view> methods = { "GET", "GET", "GET", "POST", "PUT", "DELETE" };
+    const std::vector<std::string_view> paths = { "/v1/users", "/v1/orders", "/v1/sessions",
+                                                  "/v2/search", "/v1/invoices", "/health" };
+    const std::vector<std::string_view> messages = {
+        "request served", "request served",    "cache miss",         "user authenticated",
+        "slow query",     "retrying upstream", "connection refused", "payment accepted",
+    };
+    const std::vector<unsigned> statuses = { 200, 200, 200, 200, 201, 204, 301, 400, 404, 500 };
+    constexpr std::string_view hex_digits = "0123456789abcdef";
+
+    std::string text;
+    uint64_t seconds = 0;
+    while (text.size() < CORPUS_SIZE)
+    {
+        seconds += Draw(generator, 3);
+        std::string request_id;
+        for (size_t i = 0; i < 16; ++i)
+        {
+            request_id += hex_digits[Draw(generator, hex_digits.size())];
+        }
+
+        std::string path(PickUniform(generator, paths));
+        if (path != "/health")
+        {
+            path += '/';
+            path += std::to_string(Draw(generator, 100000));
+        }
+
+        // The operands of + are not sequenced, hence the draws go first in a fixed order
+        auto milliseconds = Draw(generator, 1000);
+        auto level = PickUniform(generator, levels);
+        auto service = PickUniform(generator, services);
+        auto method = PickUniform(generator, methods);
+        auto status = statuses[Draw(generator, statuses.size())];
+        auto duration = Draw(generator, 5000);
+        auto message = PickUniform(generator, messages);
+
+        std::string line = R"({"ts":"2024-)";
+        line += Pad(1 + seconds / 86400 / 28 % 12, 2) + "-" + Pad(1 + seconds / 86400 % 28, 2)
+            + "T" + Pad(seconds / 3600 % 24, 2) + ":" + Pad(seconds / 60 % 60, 2) + ":"
+            + Pad(seconds % 60, 2) + "." + Pad(milliseconds, 3);
+        line += R"(Z","level":")";
+        line += level;
+        line += R"(","service":")";
+        line += service;
+        line += R"(","request_id":")" + request_id + R"(","method":")";
+        line += method;
+        line += R"(","path":")" + path + R"(","status":)" + std::to_string(status);
+        line += R"(,"duration_ms":)" + std::to_string(duration / 10) + "."
+            + std::to_string(duration % 10) + R"(,"msg":")";
+        line += message;
+        line += "\"}\n";
+        text += line;
+    }
+    text.resize(CORPUS_SIZE);
+    return text;
+}
+
+std::string GenerateCsv(std::mt19937& generator)
+{
+    const std::vector<std::string_view> first_names = {
+        "James", "Mary", "Robert", "Patricia", "John", "Jennifer", "Michael", "Linda",
+        "David", "Elizabeth", "William", "Barbara", "Richard", "Susan", "Joseph", "Jessica",
+    };
+    const std::vector<std::string_view> last_names = {
+        "Smith", "Johnson", "Williams", "Brown", "Jones", "Garcia", "Miller", "Davis",
+        "Rodriguez", "Martinez", "Hernandez", "Lopez", "Wilson", "Anderson", "Taylor", "Moore",
+    };
+    const std::vector<std::string_view> cities = {
+        "New York", "Los Angeles", "Chicago", "Houston", "Phoenix", "Philadelphia",
+        "San Antonio", "San Diego", "Dallas", "Austin", "Berlin", "London",
+    };
+    const std::vector<std::string_view> currencies = { "USD", "USD", "USD", "EUR", "GBP" };
+
+    std::string text = "date,first_name,last_name,city,amount,currency\n";
+    while (text.size() < CORPUS_SIZE)
+    {
+        auto month = Draw(generator, 12);
+        auto day = Draw(generator, 28);
+        auto first_name = PickUniform(generator, first_names);
+        auto last_name = PickUniform(generator, last_names);
+        auto city = PickUniform(generator, cities);
+        auto dollars = Draw(generator, 10000);
+        auto cents = Draw(generator, 90);
+        auto currency = PickUniform(generator, currencies);
+
+        std::string row = "2024-" + Pad(1 + month, 2) + "-" + Pad(1 + day, 2) + ",";
+        for (auto field : { first_name, last_name, city })
+        {
+            row += field;
+            row += ',';
+        }
+        row += std::to_string(dollars) + "." + std::to_string(10 + cents) + ",";
+        row += currency;
+        row += '\n';
+        text += row;
+    }
+    text.resize(CORPUS_SIZE);
+    return text;
+}
+
+/*
+ * Count the characters of a corpus, scaled to about SCALED_TOTAL in all.
+ * @param corpus The corpus.
+ * @return The counts, each one at least one.
+ */
+CharacterCounts CountCharacters(const std::string& corpus)
+{
+    CharacterCounts counts {};
+    for (auto character : corpus)
+    {
+        ++counts[static_cast<unsigned char>(character)];
+    }
+    for (auto& count : counts)
+    {
+        count = std::max<uint64_t>((count * SCALED_TOTAL + corpus.size() / 2) / corpus.size(), 1);
+    }
+    return counts;
+}
+
+void PrintCounts(std::string_view name, const CharacterCounts& counts)
+{
+    std::cout << "constexpr CharacterCounts " << name << " = {\n";
+    for (size_t row = 0; row < counts.size(); row += 16)
+    {
+        std::cout << "   ";
+        for (size_t i = row; i < row + 16; ++i)
+        {
+            std::cout << ' ' << counts[i] << ',';
+        }
+        std::cout << '\n';
+    }
+    std::cout << "};\n";
+}
+
+} // namespace
+
+int main()
+{
+    std::mt19937 english_generator(1);
+    std::mt19937 json_log_generator(2);
+    std::mt19937 csv_generator(3);
+
+    PrintCounts("ENGLISH_COUNTS", CountCharacters(GenerateEnglish(english_generator)));
+    std::cout << '\n';
+    PrintCounts("JSON_LOG_COUNTS", CountCharacters(GenerateJsonLogs(json_log_generator)));
+    std::cout << '\n';
+    PrintCounts("CSV_COUNTS", CountCharacters(GenerateCsv(csv_generator)));
+    return 0;
+}